@@ -0,0 +1,31 @@
+#!/bin/sh
+#
+# Runs the VM benchmarks and prints, for each script, the instructions the VM
+# dispatched and its best run time over three runs.
+#
+# Usage: bench/run.sh [path/to/interpreter]
+#
+# Instruction counts need a build configured with -DLOX_VM_STATS=ON. Counting
+# slows dispatch a little, so take run times from a build without it:
+#
+#   cmake -B build-stats -DCMAKE_BUILD_TYPE=Release -DLOX_VM_STATS=ON
+#   cmake --build build-stats
+#   bench/run.sh build-stats/interpreter
+
+set -e
+
+interpreter=${1:-"$(dirname "$0")/../build/interpreter"}
+
+printf '%-20s %15s %12s\n' script instructions "best ms"
+for script in "$(dirname "$0")"/*.lox; do
+  best=
+  for run in 1 2 3; do
+    stats=$("$interpreter" run --stats "$script" 2>&1 >/dev/null)
+    ms=$(echo "$stats" | sed -n 's/^Run time: \([0-9.]*\) ms$/\1/p')
+    if [ -z "$best" ] || awk -v a="$ms" -v b="$best" 'BEGIN { exit !(a < b) }'; then
+      best=$ms
+    fi
+  done
+  count=$(echo "$stats" | sed -n 's/^Instructions dispatched: \([0-9]*\)$/\1/p')
+  printf '%-20s %15s %12s\n' "$(basename "$script")" "${count:--}" "$best"
+done
@@ -0,0 +1,68 @@
+#!/bin/sh
+#
+# Chooses the VM's superinstructions from opcode-pair profiles of the
+# benchmarks.
+#
+# Usage: bench/superinstructions.sh profile path/to/interpreter
+#        bench/superinstructions.sh generate [count]
+#
+# `profile` runs every benchmark with --profile-pairs and saves the pairs it
+# dispatched to bench/profiles/<script>.pairs; it needs a build configured
+# with -DLOX_VM_STATS=ON. `generate` prints src/vm/Superinstructions.h for the
+# `count` (default 10) hottest pairs across those profiles, each weighted by
+# its share of its own script's dispatches so no one benchmark dominates. The
+# superinstructions build target regenerates the header this way:
+#
+#   cmake --build build --target superinstructions
+
+set -e
+
+bench=$(dirname "$0")
+
+# Opcodes that leave the current instruction stream (jumps, calls and
+# returns) cannot start a pair; every other opcode has a BODY_ macro in VM.cpp.
+control='^(JUMP|JUMP_IF_FALSE|JUMP_IF_TRUE|JUMP_IF_FUNCTION|CALL|INVOKE|SUPER_INVOKE|RETURN|RETURN_NIL)$'
+
+case $1 in
+profile)
+  interpreter=${2:?"usage: $0 profile path/to/interpreter"}
+  mkdir -p "$bench/profiles"
+  for script in "$bench"/*.lox; do
+    name=$(basename "$script" .lox)
+    "$interpreter" run --profile-pairs="$bench/profiles/$name.pairs" \
+      "$script" >/dev/null
+  done
+  ;;
+generate)
+  count=${2:-10}
+  echo '// Generated by bench/superinstructions.sh from bench/profiles; do not edit.'
+  echo '#ifndef SUPERINSTRUCTIONS_H'
+  echo '#define SUPERINSTRUCTIONS_H'
+  echo
+  echo '// Fused opcode pairs, hottest first, with their share of dispatches.'
+  printf '%-79s\\\n' '#define LOX_SUPERINSTRUCTIONS(X)'
+  awk -v control="$control" '
+    FNR == 1 { file++ }
+    { count[file, $2 " " $3] = $1; total[file] += $1; pairs[$2 " " $3] = 1 }
+    END {
+      for (pair in pairs) {
+        split(pair, ops, " ")
+        if (ops[1] ~ control) continue
+        share = 0
+        for (f = 1; f <= file; f++) share += count[f, pair] / total[f]
+        printf "%.6f %s %s\n", share / file, ops[1], ops[2]
+      }
+    }' "$bench"/profiles/*.pairs |
+    sort -rn | head -n "$count" |
+    awk '{
+      entry = sprintf("X(%s, %s) /* %.1f%% */", $2, $3, $1 * 100)
+      printf "  %-77s\\\n", entry
+    }'
+  echo
+  echo '#endif // SUPERINSTRUCTIONS_H'
+  ;;
+*)
+  echo "usage: $0 profile path/to/interpreter | generate [count]" >&2
+  exit 1
+  ;;
+esac
@@ -0,0 +1,116 @@
+#!/usr/bin/perl
+
+# Golden-output tests for the parse, evaluate and run commands.
+#
+# Every tests/<command>/<name>.lox is run as `interpreter <command> <name>.lox`
+# and its stdout, stderr and exit code are compared with <name>.expected:
+#
+#   <stdout>
+#   --- stderr
+#   <stderr>
+#   --- exit <code>
+#
+# A first line of the form `// args: ...` passes extra arguments before the
+# path. run scripts are checked once more under each of the collector modes in
+# %modes, and must give the same output in every one.
+#
+# Usage: perl golden_test.pl [path/to/interpreter]   (default: build/interpreter)
+#        perl golden_test.pl --update [path/to/interpreter]
+# --update rewrites every .expected file from the current output instead; check
+# the diff before committing it.
+
+use strict;
+use warnings;
+
+use File::Basename qw(dirname);
+use File::Temp qw(tempfile);
+
+my $update = @ARGV && $ARGV[0] eq "--update";
+shift @ARGV if $update;
+
+# Extra arguments each script of a command is also run with.
+my %modes = (
+    run => ["--incremental-gc", "--incremental-gc=0.001", "--gc-threads=1", "--gc-threads=4"],
+);
+
+my $root        = dirname(__FILE__);
+my $interpreter = $ARGV[0] // "$root/build/interpreter";
+unless (-x $interpreter) {
+    print "ERROR: Interpreter '$interpreter' not found; build it first.\n";
+    exit 1;
+}
+
+# --- Runs one script and returns its output in the .expected format ---
+sub run_script {
+    my ($command, $args, $script) = @_;
+    my (undef, $out_file) = tempfile(UNLINK => 1);
+    my (undef, $err_file) = tempfile(UNLINK => 1);
+    system("\"$interpreter\" $command $args \"$script\" > \"$out_file\" 2> \"$err_file\"");
+    my $status = $? >> 8;
+    return slurp($out_file) . "--- stderr\n" . slurp($err_file) . "--- exit $status\n";
+}
+
+sub slurp {
+    my ($filename) = @_;
+    open(my $fh, '<', $filename) or die "ERROR: Cannot open $filename: $!\n";
+    local $/;
+    my $text = <$fh>;
+    close($fh);
+    return $text // "";
+}
+
+# --- Main Script ---
+
+my $tests  = 0;
+my $failed = 0;
+for my $script (sort glob("$root/tests/*/*.lox")) {
+    my $command = (split m{/}, dirname($script))[-1];
+    (my $expected_file = $script) =~ s/\.lox$/.expected/;
+    my ($args) = slurp($script) =~ m{\A// args: (.*)\n};
+    $args //= "";
+
+    my $actual = run_script($command, $args, $script);
+    $tests++;
+    if ($update) {
+        open(my $fh, '>', $expected_file) or die "ERROR: Cannot write $expected_file: $!\n";
+        print $fh $actual;
+        close($fh);
+        next;
+    }
+    unless (-f $expected_file) {
+        print "MISSING: $expected_file\n";
+        $failed++;
+        next;
+    }
+    my $expected = slurp($expected_file);
+    for my $mode ("", @{ $modes{$command} // [] }) {
+        my $mode_args = "$mode $args";
+        my $output = $mode eq "" ? $actual : run_script($command, $mode_args, $script);
+        next if $output eq $expected;
+        print "FAILED: $command $mode_args $script\n";
+        # Report only the first differing line
+        my @actual   = split /\n/, $output, -1;
+        my @expected = split /\n/, $expected, -1;
+        for my $i (0 .. ($#actual > $#expected ? $#actual : $#expected)) {
+            my $actual_line   = $actual[$i] // "<end of output>";
+            my $expected_line = $expected[$i] // "<end of output>";
+            next if $actual_line eq $expected_line;
+            print "  line ", $i + 1, ":\n  Expected: $expected_line\n  Actual:   $actual_line\n";
+            last;
+        }
+        $failed++;
+        last;
+    }
+}
+
+# --- Final Report ---
+if ($update) {
+    print "Updated $tests expected outputs.\n";
+    exit 0;
+}
+if ($failed) {
+    print "$failed of $tests tests failed.\n";
+    exit 1;
+}
+print "All $tests tests passed.\n";
+exit 0;
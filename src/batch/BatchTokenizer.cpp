@@ -0,0 +1,258 @@
+#include "BatchTokenizer.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <print>
+#include <thread>
+#include <tuple> // For std::tie
+#include <unordered_map>
+#include <vector>
+
+#include <sys/stat.h> // For stat, S_ISDIR
+
+#include "io/BatchFileLoader.h"
+#include "scanner/Scanner.h"
+#include "util/ConcurrentQueue.h"
+#include "util/CpuTopology.h"
+#include "util/Xxh3.h"
+
+namespace {
+
+// Files each scan worker hands to its loader at once.
+constexpr size_t kScanBatchSize = 64;
+
+// The listing produced by scanning one distinct file content, kept with
+// that content so a cache hit can be confirmed against it.
+struct ScanOutput {
+  std::string contents;
+  bool had_scan_error = false;
+  std::string out;
+  std::string err;
+};
+
+// What tokenizing one path produced, held until it is its turn to print.
+// Paths with identical contents share one ScanOutput.
+struct FileListing {
+  bool readable = false;
+  std::shared_ptr<const ScanOutput> output;
+};
+
+// Listings of distinct contents scanned in the run that are still waiting
+// to be printed. Vendored copies make many batch inputs byte-identical;
+// those are scanned once and the listing is replayed. Contents are
+// fingerprinted by XXH3, and a hit is confirmed by comparing the bytes, so a
+// hash collision can never change the output. Entries only observe their
+// listing: once every path sharing it has printed, the listing and its
+// contents are freed, and a later copy is simply scanned again. Safe to
+// share between scan workers.
+class ListingCache {
+public:
+  std::shared_ptr<const ScanOutput> find(uint64_t hash,
+                                         const std::string &contents) {
+    std::lock_guard lock(mutex_);
+    auto [first, last] = entries_.equal_range(hash);
+    for (auto it = first; it != last; ++it) {
+      auto output = it->second.lock();
+      if (output && output->contents == contents) { // Compares sizes first
+        return output;
+      }
+    }
+    return nullptr;
+  }
+
+  void insert(uint64_t hash, const std::shared_ptr<const ScanOutput> &output) {
+    std::lock_guard lock(mutex_);
+    entries_.emplace(hash, output);
+    if (entries_.size() >= sweep_at_) {
+      std::erase_if(entries_, [](const auto &entry) {
+        return entry.second.expired();
+      });
+      sweep_at_ = std::max(kMinSweepAt, 2 * entries_.size());
+    }
+  }
+
+private:
+  // Entries whose listing has been freed are swept out whenever the map has
+  // doubled since the last sweep.
+  static constexpr size_t kMinSweepAt = 64;
+
+  std::mutex mutex_;
+  std::unordered_multimap<uint64_t, std::weak_ptr<const ScanOutput>> entries_;
+  size_t sweep_at_ = kMinSweepAt;
+};
+
+FileListing tokenizeContents(std::optional<std::string> contents,
+                             ListingCache &cache) {
+  FileListing listing;
+  if (!contents) {
+    return listing;
+  }
+  listing.readable = true;
+  uint64_t hash = xxh3Hash64(*contents);
+  if ((listing.output = cache.find(hash, *contents))) {
+    return listing;
+  }
+  // Two workers may race to scan the same new content; both produce the
+  // same listing, so either entry is fine.
+  auto output = std::make_shared<ScanOutput>();
+  {
+    Scanner scanner(*contents);
+    output->had_scan_error =
+        scanner.writeTokenListing(output->out, output->err);
+  }
+  output->contents = std::move(*contents);
+  cache.insert(hash, output);
+  listing.output = std::move(output);
+  return listing;
+}
+
+struct ExitStatus {
+  bool had_read_error = false;
+  bool had_scan_error = false;
+
+  int code() const {
+    if (had_read_error) {
+      return 1;
+    }
+    return had_scan_error ? 65 : 0;
+  }
+};
+
+void printListing(const std::string &path, FileListing &listing,
+                  ExitStatus &status) {
+  if (!listing.readable) {
+    std::println(stderr, "Error: Could not open file: {}", path);
+    status.had_read_error = true;
+  } else {
+    const ScanOutput &output = *listing.output;
+    if (!output.err.empty()) {
+      std::print(stderr, "==> {} <==\n{}", path, output.err);
+    }
+    std::print("==> {} <==\n{}", path, output.out);
+    status.had_scan_error |= output.had_scan_error;
+  }
+  listing = FileListing{}; // Release this path's hold on the listing
+}
+
+bool isDirectory(const std::string &path) {
+  struct stat info;
+  return ::stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+// A file to tokenize; `file` indexes the run's list of files found.
+struct ScanJob {
+  size_t file;
+  std::string path;
+};
+
+// A file found by the walk, tagged with the argument it came from so the
+// output can be grouped back into argument order.
+struct FoundFile {
+  size_t argument;
+  std::string path;
+};
+
+} // namespace
+
+int tokenizeFiles(std::span<const std::string> arguments,
+                  const BatchTokenizeOptions &options) {
+  unsigned threads = options.threads != 0
+                         ? options.threads
+                         : std::max(1u, std::thread::hardware_concurrency());
+
+  ConcurrentQueue<ScanJob> jobs;
+  ListingCache cache;
+  std::mutex files_mutex;
+  std::vector<FoundFile> files;
+  auto addFile = [&](size_t argument, std::string path) {
+    size_t file;
+    {
+      std::lock_guard lock(files_mutex);
+      file = files.size();
+      files.push_back(FoundFile{argument, path});
+    }
+    jobs.push(ScanJob{file, std::move(path)});
+  };
+
+  // Listings scanned but not yet printed, by file index.
+  std::mutex ready_mutex;
+  std::condition_variable listing_ready;
+  std::unordered_map<size_t, FileListing> ready;
+
+  // Scan workers start before the walk so files are tokenized while the
+  // rest of the tree is still being read.
+  std::optional<CpuTopology> topology;
+  if (options.pin_threads) {
+    topology = CpuTopology::detect();
+  }
+  auto scanWorker = [&](unsigned worker) {
+    // Pin before the loader exists so its ring and every buffer below are
+    // allocated on this worker's node.
+    if (topology) {
+      pinCurrentThread(topology->cpuForWorker(worker));
+    }
+    BatchFileLoader loader(kScanBatchSize);
+    std::vector<ScanJob> batch;
+    std::vector<std::string> paths;
+    std::vector<FileListing> scanned;
+    while (jobs.popBatch(batch, kScanBatchSize)) {
+      paths.clear();
+      for (ScanJob &job : batch) {
+        paths.push_back(std::move(job.path));
+      }
+      scanned.assign(batch.size(), FileListing{});
+      loader.load(paths, [&](size_t index, std::optional<std::string> contents) {
+        scanned[index] = tokenizeContents(std::move(contents), cache);
+      });
+      {
+        std::lock_guard lock(ready_mutex);
+        for (size_t i = 0; i < batch.size(); ++i) {
+          ready.emplace(batch[i].file, std::move(scanned[i]));
+        }
+      }
+      listing_ready.notify_one();
+    }
+  };
+  std::vector<std::jthread> scan_workers;
+  for (unsigned i = 0; i < threads; ++i) {
+    scan_workers.emplace_back(scanWorker, i);
+  }
+
+  for (size_t argument = 0; argument < arguments.size(); ++argument) {
+    const std::string &path = arguments[argument];
+    if (isDirectory(path)) {
+      walkDirectory(path, options.filter, threads, [&](std::string file) {
+        addFile(argument, std::move(file));
+      });
+    } else {
+      addFile(argument, path);
+    }
+  }
+  jobs.close();
+
+  // Only now is the print order known. Listings scanned before this point
+  // wait in `ready`; from here each is printed, and released, as soon as it
+  // and every file sorting before it are scanned.
+  std::vector<size_t> order(files.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::ranges::sort(order, [&](size_t a, size_t b) {
+    return std::tie(files[a].argument, files[a].path) <
+           std::tie(files[b].argument, files[b].path);
+  });
+  ExitStatus status;
+  for (size_t file : order) {
+    FileListing listing;
+    {
+      std::unique_lock lock(ready_mutex);
+      listing_ready.wait(lock, [&] { return ready.contains(file); });
+      listing = std::move(ready.extract(file).mapped());
+    }
+    printListing(files[file].path, listing, status);
+  }
+  return status.code();
+}
@@ -0,0 +1,38 @@
+#ifndef BATCH_TOKENIZER_H
+#define BATCH_TOKENIZER_H
+
+#include <span>
+#include <string>
+
+#include "io/DirectoryWalker.h"
+
+struct BatchTokenizeOptions {
+  WalkFilter filter;    // Which files under directory arguments to tokenize
+  unsigned threads = 0; // Walk and scan workers each; 0 = hardware threads
+  // Pin each scan worker to its own CPU, dealt round-robin across NUMA
+  // nodes, with node-local allocation. A worker reads and scans each file it
+  // takes, so the file's buffers, token arrays and listing are all first
+  // touched, and stay, on that worker's node.
+  bool pin_threads = false;
+};
+
+// Tokenizes several files in one run (`tokenize a.lox dir/ ...`). Each
+// file's listing is printed under a "==> path <==" header (repeated on stderr
+// when the file has scan errors). A file whose contents are byte-identical to
+// one scanned earlier, whose listing has not been printed yet, reuses that
+// listing instead of being scanned again; the output is the same either way.
+//
+// Scan workers (see BatchTokenizeOptions) take the files in batches, read
+// each batch through their own BatchFileLoader and tokenize it. A directory
+// argument's tree is walked in parallel (see walkDirectory) while the workers
+// tokenize files as they are found; its files are printed in sorted path
+// order, in the place of that argument. Once every argument has been walked,
+// each file is printed as soon as it and the files before it have been
+// scanned.
+//
+// Returns the process exit code: 1 if any file could not be read, otherwise
+// 65 if any file had scan errors, otherwise 0.
+int tokenizeFiles(std::span<const std::string> paths,
+                  const BatchTokenizeOptions &options);
+
+#endif // BATCH_TOKENIZER_H
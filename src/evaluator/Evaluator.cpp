@@ -0,0 +1,291 @@
+#include "Evaluator.h"
+
+#include <format>
+#include <print>
+#include <utility> // For std::move
+
+namespace {
+
+// Output is buffered and written in chunks of about this size.
+constexpr size_t kOutputFlushSize = 64 * 1024;
+
+} // namespace
+
+Evaluator::Evaluator(const Ast &ast, Scanner &scanner, Resolution resolution)
+    : ast_(ast), scanner_(scanner), literals_(ast.nodeCount()),
+      resolution_(std::move(resolution)),
+      globals_(resolution_.global_count, Value::undefined()) {
+  const std::vector<double> &numbers = scanner_.materializeNumbers();
+  for (NodeIndex node = 0; node < ast_.nodeCount(); ++node) {
+    if (ast_.kind(node) != NodeKind::Literal) {
+      continue;
+    }
+    uint32_t token = ast_.token(node);
+    const Token &literal = scanner_.tokens()[token];
+    switch (literal.type) {
+    case TokenType::NUMBER:
+      literals_[node] = Value::number(numbers[token]);
+      break;
+    case TokenType::STRING:
+      literals_[node] =
+          Value::object(heap_.makeString(scanner_.stringValue(literal)));
+      break;
+    case TokenType::TRUE:
+      literals_[node] = Value::boolean(true);
+      break;
+    case TokenType::FALSE:
+      literals_[node] = Value::boolean(false);
+      break;
+    default: // nil
+      break;
+    }
+  }
+}
+
+std::optional<RuntimeError> Evaluator::run() {
+  std::optional<RuntimeError> failure;
+  try {
+    execute(ast_.root());
+  } catch (RuntimeError &error) {
+    failure = std::move(error);
+  }
+  flushOutput();
+  return failure;
+}
+
+void Evaluator::execute(NodeIndex node) {
+  // Statement boundaries are safepoints: no expression temporaries are live,
+  // so every reachable value is in literals_, locals_ or globals_.
+  if (heap_.shouldCollect()) {
+    collectGarbage();
+  }
+  auto [lhs, rhs] = ast_.data(node);
+  switch (ast_.kind(node)) {
+  case NodeKind::Program:
+    for (NodeIndex statement : ast_.list(lhs)) {
+      execute(statement);
+    }
+    break;
+  case NodeKind::Expression: {
+    Value value = evaluate(lhs);
+    if (rhs != 0) { // A bare trailing expression prints its value
+      writeValue(value, out_);
+      out_ += '\n';
+    }
+    break;
+  }
+  case NodeKind::Print:
+    writeValue(evaluate(lhs), out_);
+    out_ += '\n';
+    if (out_.size() >= kOutputFlushSize) {
+      flushOutput();
+    }
+    break;
+  case NodeKind::Var: {
+    Value value = lhs != kNoNode ? evaluate(lhs) : Value();
+    Binding binding = resolution_.bindings[node];
+    if (binding.scope == Binding::Scope::Global) {
+      globals_[binding.slot] = value;
+    } else {
+      locals_.push_back(value); // Its slot is the next one
+    }
+    break;
+  }
+  case NodeKind::Block: {
+    size_t scope = locals_.size();
+    for (NodeIndex statement : ast_.list(lhs)) {
+      execute(statement);
+    }
+    locals_.resize(scope);
+    break;
+  }
+  case NodeKind::If:
+    if (!evaluate(lhs).isFalsey()) {
+      execute(ast_.extra(rhs));
+    } else if (NodeIndex else_branch = ast_.extra(rhs + 1);
+               else_branch != kNoNode) {
+      execute(else_branch);
+    }
+    break;
+  case NodeKind::While:
+    while (!evaluate(lhs).isFalsey()) {
+      execute(rhs);
+    }
+    break;
+  case NodeKind::For: {
+    NodeIndex initializer = ast_.extra(lhs);
+    NodeIndex condition = ast_.extra(lhs + 1);
+    NodeIndex increment = ast_.extra(lhs + 2);
+    // The initializer's variable is scoped to the loop.
+    size_t scope = locals_.size();
+    if (initializer != kNoNode) {
+      execute(initializer);
+    }
+    while (condition == kNoNode || !evaluate(condition).isFalsey()) {
+      execute(rhs);
+      if (increment != kNoNode) {
+        evaluate(increment);
+      }
+    }
+    locals_.resize(scope);
+    break;
+  }
+  case NodeKind::Function:
+  case NodeKind::Class:
+    error(ast_.token(node),
+          "Function and class declarations need the 'run' command.");
+  case NodeKind::Return:
+    error(ast_.token(node), "Can't return from top-level code.");
+  default:
+    break; // Expressions never appear in statement position
+  }
+}
+
+Value Evaluator::evaluate(NodeIndex node) {
+  auto [lhs, rhs] = ast_.data(node);
+  switch (ast_.kind(node)) {
+  case NodeKind::Literal:
+    return literals_[node];
+  case NodeKind::Grouping:
+    return evaluate(lhs);
+  case NodeKind::Unary: {
+    Value operand = evaluate(lhs);
+    if (scanner_.tokens()[ast_.token(node)].type == TokenType::BANG) {
+      return Value::boolean(operand.isFalsey());
+    }
+    if (!operand.isNumber()) {
+      error(ast_.token(node), "Operand must be a number.");
+    }
+    return Value::number(-operand.asNumber());
+  }
+  case NodeKind::Binary:
+    return binary(node);
+  case NodeKind::Logical: {
+    Value left = evaluate(lhs);
+    bool is_or = scanner_.tokens()[ast_.token(node)].type == TokenType::OR;
+    if (is_or != left.isFalsey()) { // `or` with truthy, `and` with falsey
+      return left;
+    }
+    return evaluate(rhs);
+  }
+  case NodeKind::Variable: {
+    if (Value *slot = lookup(node)) {
+      return *slot;
+    }
+    uint32_t name = ast_.token(node);
+    error(name, std::format("Undefined variable '{}'.", text(name)));
+  }
+  case NodeKind::Assign: {
+    Value value = evaluate(lhs);
+    uint32_t name = ast_.token(node);
+    if (Value *slot = lookup(node)) {
+      *slot = value;
+      return value;
+    }
+    error(name, std::format("Undefined variable '{}'.", text(name)));
+  }
+  case NodeKind::Call:
+    // Nothing `evaluate` can create is callable.
+    evaluate(lhs);
+    for (NodeIndex argument : ast_.list(rhs)) {
+      evaluate(argument);
+    }
+    error(ast_.token(node), "Can only call functions and classes.");
+  case NodeKind::Get:
+    evaluate(lhs);
+    error(ast_.token(node), "Only instances have properties.");
+  case NodeKind::Set:
+    evaluate(lhs);
+    error(ast_.token(node), "Only instances have fields.");
+  case NodeKind::This:
+    error(ast_.token(node), "Can't use 'this' outside of a class.");
+  case NodeKind::Super:
+    error(ast_.token(node), "Can't use 'super' outside of a class.");
+  default:
+    return Value(); // Statements never appear in expression position
+  }
+}
+
+Value Evaluator::binary(NodeIndex node) {
+  auto [lhs, rhs] = ast_.data(node);
+  Value left = evaluate(lhs);
+  Value right = evaluate(rhs);
+  uint32_t op = ast_.token(node);
+  TokenType type = scanner_.tokens()[op].type;
+
+  switch (type) {
+  case TokenType::EQUAL_EQUAL:
+    return Value::boolean(valuesEqual(left, right));
+  case TokenType::BANG_EQUAL:
+    return Value::boolean(!valuesEqual(left, right));
+  case TokenType::PLUS:
+    if (isString(left) && isString(right)) {
+      return Value::object(
+          heap_.concatenate(asString(left), asString(right)));
+    }
+    if (!(left.isNumber() & right.isNumber())) {
+      error(op, "Operands must be two numbers or two strings.");
+    }
+    return Value::number(left.asNumber() + right.asNumber());
+  default:
+    break;
+  }
+
+  // The rest are numeric; one combined test keeps the fast path to a
+  // single branch.
+  if (!(left.isNumber() & right.isNumber())) {
+    error(op, "Operands must be numbers.");
+  }
+  double a = left.asNumber();
+  double b = right.asNumber();
+  switch (type) {
+  case TokenType::MINUS:
+    return Value::number(a - b);
+  case TokenType::STAR:
+    return Value::number(a * b);
+  case TokenType::SLASH:
+    return Value::number(a / b);
+  case TokenType::GREATER:
+    return Value::boolean(a > b);
+  case TokenType::GREATER_EQUAL:
+    return Value::boolean(a >= b);
+  case TokenType::LESS:
+    return Value::boolean(a < b);
+  case TokenType::LESS_EQUAL:
+    return Value::boolean(a <= b);
+  default:
+    return Value();
+  }
+}
+
+Value *Evaluator::lookup(NodeIndex node) {
+  Binding binding = resolution_.bindings[node];
+  if (binding.scope == Binding::Scope::Local) {
+    return &locals_[binding.slot];
+  }
+  Value &global = globals_[binding.slot];
+  return global.isUndefined() ? nullptr : &global;
+}
+
+void Evaluator::collectGarbage() {
+  heap_.collect([this](Heap &heap) {
+    for (Value &literal : literals_) {
+      heap.markValue(literal);
+    }
+    for (Value &local : locals_) {
+      heap.markValue(local);
+    }
+    for (Value &global : globals_) {
+      heap.markValue(global);
+    }
+  });
+}
+
+void Evaluator::error(uint32_t token, std::string message) {
+  throw RuntimeError{scanner_.tokens()[token].line, std::move(message)};
+}
+
+void Evaluator::flushOutput() {
+  std::print("{}", out_);
+  out_.clear();
+}
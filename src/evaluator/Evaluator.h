@@ -0,0 +1,65 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "parser/Ast.h"
+#include "parser/Resolver.h"
+#include "runtime/Heap.h"
+#include "runtime/RuntimeError.h"
+#include "runtime/Value.h"
+#include "scanner/Scanner.h"
+
+// Tree-walking evaluator over the flat Ast, for the `evaluate` command. It
+// runs expressions and the statements built from them (print, var, blocks,
+// if, while, for); function and class declarations are left to the bytecode
+// VM. Values are NaN-boxed (see Value), so evaluating an expression moves
+// 8-byte words and allocates only for string concatenation; garbage strings
+// are collected between statements. Variables are bound to slots before the
+// program runs (see Resolver.h), so reading one indexes an array instead of
+// searching by name.
+class Evaluator {
+public:
+  // resolution is resolveVariables' result for the program, which must have
+  // had no diagnostics.
+  Evaluator(const Ast &ast, Scanner &scanner, Resolution resolution);
+
+  // Runs the program, printing the output of `print` statements and the
+  // value of a bare trailing expression to stdout. Returns the error that
+  // stopped it, if any.
+  std::optional<RuntimeError> run();
+
+private:
+  void execute(NodeIndex node);
+  Value evaluate(NodeIndex node);
+  Value binary(NodeIndex node);
+
+  // The variable a Variable or Assign node refers to, if it is defined.
+  Value *lookup(NodeIndex node);
+
+  [[noreturn]] void error(uint32_t token, std::string message);
+  std::string_view text(uint32_t token) const {
+    return scanner_.lexeme(scanner_.tokens()[token]);
+  }
+  void flushOutput();
+  void collectGarbage();
+
+  const Ast &ast_;
+  Scanner &scanner_;
+  Heap heap_;
+  // Parallel to the nodes: the value of every Literal node, made once so
+  // loops do not re-convert numbers or re-allocate strings.
+  std::vector<Value> literals_;
+  Resolution resolution_;
+  // Block-scoped variables by slot, innermost last; without closures a flat
+  // stack that is cut back at the end of each block is all scoping needs.
+  std::vector<Value> locals_;
+  // By slot; Value::undefined() until the variable is defined.
+  std::vector<Value> globals_;
+  std::string out_;
+};
+
+#endif // EVALUATOR_H
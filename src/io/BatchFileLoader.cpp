@@ -0,0 +1,505 @@
+#include "BatchFileLoader.h"
+
+#include <algorithm> // For std::max, std::min
+#include <cerrno>
+#include <vector>
+
+#include <fcntl.h>    // For open, O_RDONLY, O_CLOEXEC, AT_FDCWD
+#include <sys/stat.h> // For fstat, struct statx, STATX_SIZE
+#include <unistd.h>   // For read, close
+
+#if defined(__linux__)
+#include <atomic> // For std::atomic_ref
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>    // For mmap, munmap
+#include <sys/syscall.h> // For __NR_io_uring_setup, __NR_io_uring_enter
+#endif
+
+std::optional<std::string> BatchFileLoader::readFile(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+  struct stat info;
+  size_t capacity = 4096;
+  if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+    capacity = static_cast<size_t>(info.st_size);
+  }
+  std::string contents(capacity, '\0');
+  size_t filled = 0;
+  while (true) {
+    if (filled == contents.size()) {
+      contents.resize(contents.size() * 2);
+    }
+    ssize_t count =
+        ::read(fd, contents.data() + filled, contents.size() - filled);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count < 0) {
+      ::close(fd);
+      return std::nullopt;
+    }
+    if (count == 0) {
+      break;
+    }
+    filled += static_cast<size_t>(count);
+  }
+  ::close(fd);
+  contents.resize(filled);
+  return contents;
+}
+
+#if defined(__linux__)
+
+// Minimal io_uring wrapper: the SQ/CQ rings and SQE array mapped from the
+// ring fd, following the layout the kernel reports in io_uring_params.
+class BatchFileLoader::Ring {
+public:
+  static std::unique_ptr<Ring> create(unsigned entries) {
+    io_uring_params params{};
+    int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      return nullptr; // ENOSYS on old kernels, EPERM under some sandboxes
+    }
+    auto ring = std::unique_ptr<Ring>(new Ring(fd));
+    if (!ring->map(params)) {
+      return nullptr;
+    }
+    return ring;
+  }
+
+  ~Ring() {
+    if (sqes_ptr_ != MAP_FAILED) {
+      ::munmap(sqes_ptr_, sqes_size_);
+    }
+    if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) {
+      ::munmap(cq_ptr_, cq_size_);
+    }
+    if (sq_ptr_ != MAP_FAILED) {
+      ::munmap(sq_ptr_, sq_size_);
+    }
+    ::close(fd_);
+  }
+
+  // Whether another SQE can be queued before the next submit.
+  bool hasSpace() const { return sq_local_tail_ - submitted_tail_ <= sq_mask_; }
+
+  // Returns a zeroed SQE to fill in; callers never queue more than the ring
+  // holds (see BatchFileLoader::load).
+  io_uring_sqe *nextSqe() {
+    unsigned tail = sq_local_tail_++;
+    unsigned index = tail & sq_mask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    return sqe;
+  }
+
+  // Publishes queued SQEs and waits for at least min_complete completions.
+  bool submitAndWait(unsigned min_complete) {
+    std::atomic_ref<unsigned>(*sq_tail_).store(sq_local_tail_,
+                                               std::memory_order_release);
+    unsigned to_submit = sq_local_tail_ - submitted_tail_;
+    while (true) {
+      long result = ::syscall(__NR_io_uring_enter, fd_, to_submit, min_complete,
+                              IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (result >= 0) {
+        submitted_tail_ += static_cast<unsigned>(result);
+        to_submit -= static_cast<unsigned>(result);
+        if (to_submit == 0) {
+          return true;
+        }
+        continue;
+      }
+      if (errno != EINTR) {
+        return false;
+      }
+    }
+  }
+
+  template <typename Visitor> void reap(Visitor &&visit) {
+    unsigned head = *cq_head_;
+    unsigned tail =
+        std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire);
+    for (; head != tail; ++head) {
+      const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+      visit(cqe.user_data, cqe.res);
+    }
+    std::atomic_ref<unsigned>(*cq_head_).store(head,
+                                               std::memory_order_release);
+  }
+
+private:
+  explicit Ring(int fd) : fd_(fd) {}
+
+  bool map(const io_uring_params &params) {
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+    sq_ptr_ = ::mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED) {
+      return false;
+    }
+    cq_ptr_ = single_mmap ? sq_ptr_
+                          : ::mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE, fd_,
+                                   IORING_OFF_CQ_RING);
+    if (cq_ptr_ == MAP_FAILED) {
+      return false;
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ptr_ = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes_ptr_ == MAP_FAILED) {
+      return false;
+    }
+    sqes_ = static_cast<io_uring_sqe *>(sqes_ptr_);
+
+    auto *sq = static_cast<char *>(sq_ptr_);
+    auto *cq = static_cast<char *>(cq_ptr_);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    sq_local_tail_ = submitted_tail_ = *sq_tail_;
+    return true;
+  }
+
+  int fd_;
+  void *sq_ptr_ = MAP_FAILED;
+  void *cq_ptr_ = MAP_FAILED;
+  void *sqes_ptr_ = MAP_FAILED;
+  size_t sq_size_ = 0;
+  size_t cq_size_ = 0;
+  size_t sqes_size_ = 0;
+
+  unsigned *sq_tail_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned *sq_array_ = nullptr;
+  unsigned *cq_head_ = nullptr;
+  unsigned *cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe *cqes_ = nullptr;
+  io_uring_sqe *sqes_ = nullptr;
+
+  unsigned sq_local_tail_ = 0;  // Queued but not yet published
+  unsigned submitted_tail_ = 0; // Consumed by the kernel
+};
+
+namespace {
+
+enum class Op : uint64_t { Open, Statx, Read, Close };
+
+// A READ's length is 32 bits; a bigger file takes several.
+constexpr size_t kMaxReadSize = size_t{1} << 30;
+
+// The user_data of an ASYNC_CANCEL, whose own completion is ignored.
+constexpr uint64_t kCancelUserData = UINT64_MAX;
+
+uint64_t userData(size_t slot, Op op) {
+  return (static_cast<uint64_t>(slot) << 2) | static_cast<uint64_t>(op);
+}
+
+// Per-file state while its operations are in flight.
+struct FileSlot {
+  size_t index = 0;
+  int fd = -1; // Open until its CLOSE completes
+  int open_result = 0;
+  bool open_done = false;
+  bool statx_done = false;
+  bool reading = false;
+  bool delivered = false;
+  unsigned outstanding = 0; // Submitted operations not yet completed
+  struct statx stat_buffer {};
+  size_t expected_size = 0; // 0 if unknown: read until EOF
+  std::string contents;
+  size_t filled = 0;
+};
+
+} // namespace
+
+BatchFileLoader::BatchFileLoader(unsigned max_in_flight)
+    : max_in_flight_(max_in_flight == 0 ? 1 : max_in_flight),
+      // Every file has at most two operations queued at once.
+      ring_(Ring::create(2 * max_in_flight_)) {}
+
+#else
+
+class BatchFileLoader::Ring {};
+
+BatchFileLoader::BatchFileLoader(unsigned max_in_flight)
+    : max_in_flight_(max_in_flight == 0 ? 1 : max_in_flight) {}
+
+#endif
+
+BatchFileLoader::~BatchFileLoader() = default;
+
+void BatchFileLoader::load(std::span<const std::string> paths,
+                           const CompletionHandler &on_loaded) {
+#if defined(__linux__)
+  if (ring_) {
+    std::vector<FileSlot> slots(std::min<size_t>(max_in_flight_, paths.size()));
+    std::vector<size_t> free_slots;
+    for (size_t i = slots.size(); i-- > 0;) {
+      free_slots.push_back(i);
+    }
+    size_t next_path = 0;
+    size_t busy_slots = 0;
+
+    auto queueRead = [&](size_t slot_index) {
+      FileSlot &slot = slots[slot_index];
+      if (slot.filled == slot.contents.size()) {
+        slot.contents.resize(std::max<size_t>(4096, slot.contents.size() * 2));
+      }
+      io_uring_sqe *sqe = ring_->nextSqe();
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = slot.fd;
+      sqe->addr = reinterpret_cast<uint64_t>(slot.contents.data() + slot.filled);
+      sqe->len = static_cast<uint32_t>(
+          std::min(slot.contents.size() - slot.filled, kMaxReadSize));
+      sqe->off = slot.filled;
+      sqe->user_data = userData(slot_index, Op::Read);
+      slot.outstanding++;
+      slot.reading = true;
+    };
+
+    auto queueClose = [&](size_t slot_index) {
+      FileSlot &slot = slots[slot_index];
+      io_uring_sqe *sqe = ring_->nextSqe();
+      sqe->opcode = IORING_OP_CLOSE;
+      sqe->fd = slot.fd;
+      sqe->user_data = userData(slot_index, Op::Close);
+      slot.outstanding++;
+    };
+
+    auto deliver = [&](size_t slot_index, std::optional<std::string> contents) {
+      FileSlot &slot = slots[slot_index];
+      slot.delivered = true;
+      on_loaded(slot.index, std::move(contents));
+    };
+
+    // Both the open and the statx have completed: start reading, or give up.
+    auto openedAndSized = [&](size_t slot_index) {
+      FileSlot &slot = slots[slot_index];
+      if (slot.open_result == -EINVAL || slot.open_result == -EOPNOTSUPP) {
+        // Kernel predates IORING_OP_OPENAT: read this one the slow way.
+        deliver(slot_index, readFile(paths[slot.index]));
+        return;
+      }
+      if (slot.open_result < 0) {
+        deliver(slot_index, std::nullopt);
+        return;
+      }
+      slot.contents.assign(slot.expected_size, '\0');
+      queueRead(slot_index);
+    };
+
+    while (next_path < paths.size() || busy_slots > 0) {
+      while (next_path < paths.size() && !free_slots.empty()) {
+        size_t slot_index = free_slots.back();
+        free_slots.pop_back();
+        FileSlot &slot = slots[slot_index];
+        slot = FileSlot{};
+        slot.index = next_path;
+        const char *path = paths[next_path].c_str();
+        ++next_path;
+        ++busy_slots;
+
+        io_uring_sqe *open_sqe = ring_->nextSqe();
+        open_sqe->opcode = IORING_OP_OPENAT;
+        open_sqe->fd = AT_FDCWD;
+        open_sqe->addr = reinterpret_cast<uint64_t>(path);
+        open_sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        open_sqe->user_data = userData(slot_index, Op::Open);
+
+        io_uring_sqe *statx_sqe = ring_->nextSqe();
+        statx_sqe->opcode = IORING_OP_STATX;
+        statx_sqe->fd = AT_FDCWD;
+        statx_sqe->addr = reinterpret_cast<uint64_t>(path);
+        statx_sqe->len = STATX_SIZE;
+        statx_sqe->off = reinterpret_cast<uint64_t>(&slot.stat_buffer);
+        statx_sqe->user_data = userData(slot_index, Op::Statx);
+        slot.outstanding = 2;
+      }
+
+      if (!ring_->submitAndWait(1)) {
+        break; // Fatal ring error: finish the rest with blocking reads below
+      }
+
+      ring_->reap([&](uint64_t user_data, int result) {
+        size_t slot_index = static_cast<size_t>(user_data >> 2);
+        FileSlot &slot = slots[slot_index];
+        slot.outstanding--;
+        switch (static_cast<Op>(user_data & 3)) {
+        case Op::Open:
+          slot.open_result = result;
+          slot.open_done = true;
+          if (result >= 0) {
+            slot.fd = result;
+          }
+          if (slot.statx_done) {
+            openedAndSized(slot_index);
+          }
+          break;
+        case Op::Statx:
+          if (result == 0) {
+            slot.expected_size = static_cast<size_t>(slot.stat_buffer.stx_size);
+          }
+          slot.statx_done = true;
+          if (slot.open_done) {
+            openedAndSized(slot_index);
+          }
+          break;
+        case Op::Read:
+          slot.reading = false;
+          if (result < 0) {
+            deliver(slot_index, std::nullopt);
+            queueClose(slot_index);
+            break;
+          }
+          slot.filled += static_cast<size_t>(result);
+          if (result == 0 ||
+              (slot.expected_size != 0 && slot.filled == slot.expected_size)) {
+            slot.contents.resize(slot.filled);
+            deliver(slot_index, std::move(slot.contents));
+            queueClose(slot_index);
+          } else {
+            queueRead(slot_index);
+          }
+          break;
+        case Op::Close:
+          if (result == -EINVAL || result == -EOPNOTSUPP) {
+            ::close(slot.fd); // Kernel predates IORING_OP_CLOSE
+          }
+          slot.fd = -1;
+          break;
+        }
+        if (slot.outstanding == 0 && slot.delivered) {
+          free_slots.push_back(slot_index);
+          --busy_slots;
+        }
+      });
+    }
+
+    if (busy_slots == 0) {
+      return;
+    }
+    // The ring failed under us (it should not: the CQ cannot overflow). The
+    // kernel may still be writing into the slots' buffers, so cancel what is
+    // in flight and wait for it before they go, close every file left open,
+    // and finish every file not yet delivered with blocking reads. CLOSEs
+    // are left to finish.
+    std::vector<bool> in_use(slots.size(), true);
+    for (size_t slot_index : free_slots) {
+      in_use[slot_index] = false;
+    }
+    bool drained = true;
+    auto reapDrained = [&] {
+      ring_->reap([&](uint64_t user_data, int result) {
+        if (user_data == kCancelUserData) {
+          return;
+        }
+        FileSlot &slot = slots[static_cast<size_t>(user_data >> 2)];
+        slot.outstanding--;
+        switch (static_cast<Op>(user_data & 3)) {
+        case Op::Open:
+          slot.open_done = true;
+          if (result >= 0) {
+            slot.fd = result;
+          }
+          break;
+        case Op::Statx:
+          slot.statx_done = true;
+          break;
+        case Op::Read:
+          slot.reading = false;
+          break;
+        case Op::Close:
+          if (result == -EINVAL || result == -EOPNOTSUPP) {
+            ::close(slot.fd);
+          }
+          slot.fd = -1;
+          break;
+        }
+      });
+    };
+    auto cancel = [&](size_t slot_index, Op op) {
+      while (drained && !ring_->hasSpace()) {
+        drained = ring_->submitAndWait(0);
+        reapDrained();
+      }
+      if (!drained) {
+        return;
+      }
+      io_uring_sqe *sqe = ring_->nextSqe();
+      sqe->opcode = IORING_OP_ASYNC_CANCEL;
+      sqe->fd = -1;
+      sqe->addr = userData(slot_index, op);
+      sqe->user_data = kCancelUserData;
+    };
+    for (size_t slot_index = 0; slot_index < slots.size(); ++slot_index) {
+      const FileSlot &slot = slots[slot_index];
+      if (!in_use[slot_index] || slot.outstanding == 0) {
+        continue;
+      }
+      if (!slot.open_done) {
+        cancel(slot_index, Op::Open);
+      }
+      if (!slot.statx_done) {
+        cancel(slot_index, Op::Statx);
+      }
+      if (slot.reading) {
+        cancel(slot_index, Op::Read);
+      }
+    }
+    auto outstanding = [&] {
+      return std::any_of(slots.begin(), slots.end(), [](const FileSlot &slot) {
+        return slot.outstanding > 0;
+      });
+    };
+    while (drained && outstanding()) {
+      drained = ring_->submitAndWait(1);
+      reapDrained();
+    }
+    // The kernel holds its own reference to a file a request is using, so
+    // the descriptors can go even if the wait failed.
+    std::vector<size_t> undelivered;
+    for (size_t slot_index = 0; slot_index < slots.size(); ++slot_index) {
+      FileSlot &slot = slots[slot_index];
+      if (slot.fd >= 0) {
+        ::close(slot.fd);
+        slot.fd = -1;
+      }
+      if (in_use[slot_index] && !slot.delivered) {
+        undelivered.push_back(slot.index);
+      }
+    }
+    if (!drained) {
+      // Nothing says the kernel is done with the buffers: leave them to it.
+      // Moving the vector keeps every slot where it is.
+      new std::vector<FileSlot>(std::move(slots)); // Deliberately leaked
+    }
+    ring_.reset();
+    for (size_t index : undelivered) {
+      on_loaded(index, readFile(paths[index]));
+    }
+    for (size_t i = next_path; i < paths.size(); ++i) {
+      on_loaded(i, readFile(paths[i]));
+    }
+    return;
+  }
+#endif
+
+  for (size_t i = 0; i < paths.size(); ++i) {
+    on_loaded(i, readFile(paths[i]));
+  }
+}
@@ -0,0 +1,42 @@
+#ifndef BATCH_FILE_LOADER_H
+#define BATCH_FILE_LOADER_H
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+
+// Reads many small files with as few syscalls as possible. On Linux the
+// open/statx/read/close of up to `max_in_flight` files are queued on an
+// io_uring (set up with raw syscalls, no liburing) and submitted together;
+// where io_uring is unavailable each file is read with blocking calls instead.
+class BatchFileLoader {
+public:
+  // Called once per path, in completion order, with the index of the path
+  // and its contents (std::nullopt if it could not be read).
+  using CompletionHandler =
+      std::function<void(size_t index, std::optional<std::string> contents)>;
+
+  explicit BatchFileLoader(unsigned max_in_flight = 128);
+  ~BatchFileLoader();
+
+  BatchFileLoader(const BatchFileLoader &) = delete;
+  BatchFileLoader &operator=(const BatchFileLoader &) = delete;
+
+  void load(std::span<const std::string> paths,
+            const CompletionHandler &on_loaded);
+
+  bool usingIoUring() const { return ring_ != nullptr; }
+
+  // Blocking open/fstat/read/close of a single file.
+  static std::optional<std::string> readFile(const std::string &path);
+
+private:
+  class Ring;
+
+  unsigned max_in_flight_;
+  std::unique_ptr<Ring> ring_; // Null when io_uring could not be set up
+};
+
+#endif // BATCH_FILE_LOADER_H
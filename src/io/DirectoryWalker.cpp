@@ -0,0 +1,140 @@
+#include "DirectoryWalker.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <dirent.h>   // For opendir, readdir, closedir
+#include <fnmatch.h>  // For fnmatch
+#include <sys/stat.h> // For stat, lstat
+
+namespace {
+
+bool matchesAny(const std::vector<std::string> &patterns,
+                const std::string &name, const std::string &relative_path) {
+  for (const std::string &pattern : patterns) {
+    bool path_pattern = pattern.find('/') != std::string::npos;
+    const std::string &subject = path_pattern ? relative_path : name;
+    if (::fnmatch(pattern.c_str(), subject.c_str(),
+                  path_pattern ? FNM_PATHNAME : 0) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Directories waiting to be read, plus how many workers are mid-read (and so
+// may still add more). The walk is over when both are zero.
+class WalkState {
+public:
+  void push(std::string relative_dir) {
+    {
+      std::lock_guard lock(mutex_);
+      pending_.push_back(std::move(relative_dir));
+    }
+    changed_.notify_one();
+  }
+
+  // Blocks for the next directory; returns false when the walk is finished.
+  bool take(std::string &relative_dir) {
+    std::unique_lock lock(mutex_);
+    changed_.wait(lock, [this] { return !pending_.empty() || active_ == 0; });
+    if (pending_.empty()) {
+      return false;
+    }
+    relative_dir = std::move(pending_.back());
+    pending_.pop_back();
+    ++active_;
+    return true;
+  }
+
+  void finished() {
+    bool walk_done;
+    {
+      std::lock_guard lock(mutex_);
+      --active_;
+      walk_done = active_ == 0 && pending_.empty();
+    }
+    if (walk_done) {
+      changed_.notify_all();
+    }
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::vector<std::string> pending_; // LIFO keeps the frontier small
+  unsigned active_ = 0;
+};
+
+} // namespace
+
+bool WalkFilter::includesFile(const std::string &name,
+                              const std::string &relative_path) const {
+  return matchesAny(include, name, relative_path) &&
+         !matchesAny(exclude, name, relative_path);
+}
+
+bool WalkFilter::excludes(const std::string &name,
+                          const std::string &relative_path) const {
+  return matchesAny(exclude, name, relative_path);
+}
+
+void walkDirectory(const std::string &root, const WalkFilter &filter,
+                   unsigned threads,
+                   const std::function<void(std::string path)> &on_file) {
+  std::string root_prefix = root;
+  if (!root_prefix.empty() && root_prefix.back() != '/') {
+    root_prefix += '/';
+  }
+
+  WalkState state;
+  state.push("");
+
+  auto worker = [&] {
+    std::string relative_dir;
+    while (state.take(relative_dir)) {
+      std::string dir_path = root_prefix + relative_dir;
+      if (DIR *dir = ::opendir(dir_path.empty() ? "." : dir_path.c_str())) {
+        while (const dirent *entry = ::readdir(dir)) {
+          std::string name = entry->d_name;
+          if (name == "." || name == "..") {
+            continue;
+          }
+          std::string relative_path = relative_dir + name;
+          unsigned char type = entry->d_type;
+          if (type == DT_UNKNOWN || type == DT_LNK) {
+            // Some filesystems do not fill d_type; links to regular files
+            // count as files, links to directories are not followed.
+            struct stat info;
+            std::string full_path = root_prefix + relative_path;
+            bool is_link = type == DT_LNK;
+            if ((is_link ? ::stat(full_path.c_str(), &info)
+                         : ::lstat(full_path.c_str(), &info)) != 0) {
+              continue;
+            }
+            type = S_ISREG(info.st_mode)                 ? DT_REG
+                   : S_ISDIR(info.st_mode) && !is_link ? DT_DIR
+                                                         : DT_UNKNOWN;
+          }
+          if (type == DT_DIR) {
+            if (!filter.excludes(name, relative_path)) {
+              state.push(relative_path + '/');
+            }
+          } else if (type == DT_REG &&
+                     filter.includesFile(name, relative_path)) {
+            on_file(root_prefix + relative_path);
+          }
+        }
+        ::closedir(dir);
+      }
+      state.finished();
+    }
+  };
+
+  std::vector<std::jthread> workers;
+  for (unsigned i = 1; i < threads; ++i) {
+    workers.emplace_back(worker);
+  }
+  worker(); // The calling thread walks too
+}
@@ -0,0 +1,32 @@
+#ifndef DIRECTORY_WALKER_H
+#define DIRECTORY_WALKER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Which files a walk reports. A pattern containing '/' is matched (with
+// fnmatch) against the path relative to the walk root; any other pattern is
+// matched against the entry's name alone. Excluded directories are not
+// descended into.
+struct WalkFilter {
+  std::vector<std::string> include = {"*.lox"};
+  std::vector<std::string> exclude;
+
+  bool includesFile(const std::string &name,
+                    const std::string &relative_path) const;
+  bool excludes(const std::string &name,
+                const std::string &relative_path) const;
+};
+
+// Walks the tree under root with `threads` workers, each reading whole
+// directories and handing subdirectories back to the shared work list, so
+// wide trees are read in parallel. on_file is called (concurrently, from the
+// worker threads) with "root/relative/path" for every matching regular file
+// as soon as it is seen; the order is unspecified. Symbolic links to
+// directories are not followed.
+void walkDirectory(const std::string &root, const WalkFilter &filter,
+                   unsigned threads,
+                   const std::function<void(std::string path)> &on_file);
+
+#endif // DIRECTORY_WALKER_H
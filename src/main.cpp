@@ -1,15 +1,48 @@
+#include <algorithm>
+#include <charconv> // For std::from_chars
+#include <chrono>
+#include <cmath> // For std::isfinite
 #include <filesystem>
+#include <format>
 #include <fstream>
+#include <functional> // For std::ranges::greater
+#include <iterator> // For std::back_inserter
 #include <optional>
 #include <print> // C++23
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <system_error> // For std::errc
 #include <vector>
 
+#include "batch/BatchTokenizer.h"
+#include "evaluator/Evaluator.h"
+#include "parser/AstPrinter.h"
+#include "parser/ParallelParser.h"
 #include "scanner/Scanner.h"
+#include "vm/Compiler.h"
+#include "vm/VM.h"
 
 namespace {
+void print_usage() {
+  std::println(stderr, "Usage: ./your_program tokenize [--include=GLOB] "
+                       "[--exclude=GLOB] [--jobs=N] [--pin-threads] "
+                       "<path>...");
+  std::println(stderr, "       ./your_program parse|evaluate [--max-errors=N] "
+                       "<path>");
+  std::println(stderr, "       ./your_program run [--stats] "
+                       "[--profile-pairs=FILE] [--incremental-gc[=MS]] "
+                       "[--gc-threads=N] <path>");
+}
+
+// Parses the whole of text as a number into value; false if it is not one.
+template <typename T>
+[[nodiscard]] bool parse_number(std::string_view text, T &value) {
+  auto [end, error] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  return error == std::errc{} && end == text.data() + text.size();
+}
+
 [[nodiscard]] std::optional<std::string>
 read_file_contents(std::string_view filename_sv) {
   std::filesystem::path file_path = filename_sv;
@@ -22,20 +55,303 @@ read_file_contents(std::string_view filename_sv) {
   buffer << file.rdbuf();
   return buffer.str();
 }
+
+// Splits the arguments after `tokenize` into paths and batch options
+// (--include=GLOB and --exclude=GLOB, each repeatable; --jobs=N and
+// --pin-threads). The options apply whenever there is more than one path or
+// a directory; a single plain file is scanned on its own, without a header.
+// Returns nothing if N is not a positive count.
+[[nodiscard]] std::optional<std::vector<std::string>>
+parse_tokenize_arguments(int argc, char *argv[],
+                         BatchTokenizeOptions &options) {
+  std::vector<std::string> paths;
+  bool default_include = true;
+  for (int i = 2; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg.starts_with("--include=")) {
+      if (default_include) {
+        options.filter.include.clear();
+        default_include = false;
+      }
+      options.filter.include.emplace_back(arg.substr(10));
+    } else if (arg.starts_with("--exclude=")) {
+      options.filter.exclude.emplace_back(arg.substr(10));
+    } else if (arg.starts_with("--jobs=")) {
+      if (!parse_number(arg.substr(7), options.threads) ||
+          options.threads == 0) {
+        return std::nullopt;
+      }
+    } else if (arg == "--pin-threads") {
+      options.pin_threads = true;
+    } else {
+      paths.emplace_back(arg);
+    }
+  }
+  return paths;
+}
+
+// Reads, scans and parses the file named on the command line of `parse` or
+// `evaluate` and hands the scanner and tree to use_program, returning its
+// exit code. Scan and syntax errors are reported on stderr instead, with
+// exit code 65. Options: --max-errors=N stops after N syntax errors
+// (default 100, 0 for no limit); an N that is not a count is a usage error,
+// with exit code 1.
+template <typename UseProgram>
+[[nodiscard]] int with_parsed_program(int argc, char *argv[],
+                                      UseProgram use_program) {
+  std::string_view path;
+  size_t max_errors = 100;
+  for (int i = 2; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg.starts_with("--max-errors=")) {
+      if (!parse_number(arg.substr(13), max_errors)) {
+        print_usage();
+        return 1;
+      }
+    } else {
+      path = arg;
+    }
+  }
+
+  auto file_content_optional = read_file_contents(path);
+  if (!file_content_optional) {
+    return 1;
+  }
+  Scanner scanner(*file_content_optional);
+  scanner.scanTokens();
+  scanner.materializeNumbers();
+
+  // Large files are split at top-level declarations and parsed on all cores.
+  auto [ast, diagnostics, stopped] =
+      parseProgramParallel(scanner, 0, max_errors);
+
+  std::string err;
+  scanner.writeDiagnostics(err);
+  for (const ParseDiagnostic &diagnostic : diagnostics) {
+    std::format_to(std::back_inserter(err), "[line {}] Error{}: {}\n",
+                   diagnostic.line, diagnostic.location, diagnostic.message);
+  }
+  if (stopped) {
+    std::format_to(std::back_inserter(err),
+                   "Stopped after {} errors (see --max-errors).\n",
+                   diagnostics.size());
+  }
+  std::print(stderr, "{}", err);
+  if (scanner.hadError() || !diagnostics.empty()) {
+    return 65;
+  }
+  return use_program(scanner, ast);
+}
+
+// Prints the AST of the file.
+[[nodiscard]] int run_parse(int argc, char *argv[]) {
+  return with_parsed_program(argc, argv, [](Scanner &scanner, const Ast &ast) {
+    std::string out;
+    writeAst(ast, scanner, out);
+    std::print("{}", out);
+    return 0;
+  });
+}
+
+// Evaluates the file with the tree-walking evaluator. Scoping errors are
+// reported on stderr with exit code 65, as `run` does, and runtime errors
+// with exit code 70.
+[[nodiscard]] int run_evaluate(int argc, char *argv[]) {
+  return with_parsed_program(argc, argv, [](Scanner &scanner, const Ast &ast) {
+    Resolution resolution = resolveVariables(ast, scanner);
+    if (!resolution.diagnostics.empty()) {
+      std::string err;
+      for (const ParseDiagnostic &diagnostic : resolution.diagnostics) {
+        std::format_to(std::back_inserter(err), "[line {}] Error{}: {}\n",
+                       diagnostic.line, diagnostic.location,
+                       diagnostic.message);
+      }
+      std::print(stderr, "{}", err);
+      return 65;
+    }
+    Evaluator evaluator(ast, scanner, std::move(resolution));
+    if (auto error = evaluator.run()) {
+      std::println(stderr, "{}\n[line {}]", error->message, error->line);
+      return 70;
+    }
+    return 0;
+  });
+}
+
+// Writes every opcode pair the VM dispatched as "count first second" lines,
+// most frequent first.
+[[nodiscard]] bool write_pair_profile(const VM &vm, std::string_view path) {
+  struct Pair {
+    uint64_t count;
+    size_t first;
+    size_t second;
+  };
+  std::vector<Pair> pairs;
+  const VM::PairCounts &counts = vm.pairCounts();
+  for (size_t first = 0; first < kOpCodeCount; ++first) {
+    for (size_t second = 0; second < kOpCodeCount; ++second) {
+      if (counts[first][second] != 0) {
+        pairs.push_back(Pair{counts[first][second], first, second});
+      }
+    }
+  }
+  std::ranges::sort(pairs, std::ranges::greater{}, &Pair::count);
+
+  std::string text;
+  for (const Pair &pair : pairs) {
+    std::format_to(std::back_inserter(text), "{} {} {}\n", pair.count,
+                   kOpCodeNames[pair.first], kOpCodeNames[pair.second]);
+  }
+  std::ofstream file{std::filesystem::path(path)};
+  file << text;
+  if (!file) {
+    std::println(stderr, "Error: Could not write file: {}", path);
+    return false;
+  }
+  return true;
+}
+
+// Compiles the file to bytecode and runs it on the VM. Scan and compile
+// errors are reported with exit code 65, runtime errors with exit code 70.
+// Options: --stats reports the VM's run time, instruction count and garbage
+// collections on stderr; --profile-pairs=FILE writes the opcode pairs it
+// dispatched to FILE, with superinstructions turned off (see
+// bench/superinstructions.sh); --incremental-gc[=MS] collects the old
+// generation incrementally, in pauses of about MS milliseconds (default 1);
+// --gc-threads=N marks it on N threads otherwise (default: hardware threads).
+// An MS or N that is not a positive number is a usage error, with exit code 1.
+[[nodiscard]] int run_program(int argc, char *argv[]) {
+  std::string_view path;
+  bool stats = false;
+  std::string_view profile_path;
+  std::optional<double> pause_budget_ms;
+  unsigned gc_threads = 0;
+  for (int i = 2; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--stats") {
+      stats = true;
+    } else if (arg.starts_with("--profile-pairs=")) {
+      profile_path = arg.substr(std::string_view("--profile-pairs=").size());
+    } else if (arg == "--incremental-gc") {
+      pause_budget_ms = 1.0;
+    } else if (arg.starts_with("--incremental-gc=")) {
+      // A zero budget would turn incremental marking off.
+      double budget = 0;
+      if (!parse_number(
+              arg.substr(std::string_view("--incremental-gc=").size()),
+              budget) ||
+          !std::isfinite(budget) || budget <= 0) {
+        print_usage();
+        return 1;
+      }
+      pause_budget_ms = budget;
+    } else if (arg.starts_with("--gc-threads=")) {
+      if (!parse_number(arg.substr(13), gc_threads) || gc_threads == 0) {
+        print_usage();
+        return 1;
+      }
+    } else {
+      path = arg;
+    }
+  }
+
+#ifndef LOX_VM_STATS
+  if (!profile_path.empty()) {
+    std::println(stderr, "Error: --profile-pairs needs a build configured "
+                         "with -DLOX_VM_STATS=ON");
+    return 1;
+  }
+#endif
+
+  auto file_content_optional = read_file_contents(path);
+  if (!file_content_optional) {
+    return 1;
+  }
+  Scanner scanner(*file_content_optional);
+  scanner.scanTokens();
+  scanner.materializeNumbers();
+
+  VM vm;
+  vm.heap().setMarkThreads(gc_threads);
+  if (pause_budget_ms) {
+    vm.heap().setPauseBudget(
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::milli>(*pause_budget_ms)));
+  }
+  std::vector<ParseDiagnostic> diagnostics;
+  CompileOptions options;
+  options.superinstructions = profile_path.empty();
+  ObjFunction *script =
+      compileProgram(scanner, vm.heap(), vm.globals(), diagnostics, options);
+
+  std::string err;
+  scanner.writeDiagnostics(err);
+  for (const ParseDiagnostic &diagnostic : diagnostics) {
+    std::format_to(std::back_inserter(err), "[line {}] Error{}: {}\n",
+                   diagnostic.line, diagnostic.location, diagnostic.message);
+  }
+  std::print(stderr, "{}", err);
+  if (scanner.hadError() || script == nullptr) {
+    return 65;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::optional<RuntimeError> error = vm.run(script);
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  if (error) {
+    std::println(stderr, "{}\n[line {}]", error->message, error->line);
+  }
+  if (stats) {
+#ifdef LOX_VM_STATS
+    std::println(stderr, "Instructions dispatched: {}", vm.dispatchCount());
+#else
+    std::println(stderr, "Instructions dispatched: not counted (configure "
+                         "with -DLOX_VM_STATS=ON)");
+#endif
+    std::println(stderr, "Run time: {:.1f} ms", elapsed.count());
+    const GcStats &gc = vm.heap().stats();
+    std::println(stderr, "GC: {} minor, {} major collections",
+                 gc.minor_collections, gc.major_collections);
+    std::println(stderr, "GC pauses: {}, {:.2f} ms total, {:.2f} ms max",
+                 gc.pauses, gc.total_pause_ms, gc.max_pause_ms);
+    double promotion_rate =
+        gc.bytes_allocated == 0
+            ? 0
+            : 100.0 * static_cast<double>(gc.bytes_promoted) /
+                  static_cast<double>(gc.bytes_allocated);
+    std::println(stderr, "GC promotion: {} of {} nursery bytes ({:.1f}%)",
+                 gc.bytes_promoted, gc.bytes_allocated, promotion_rate);
+  }
+  if (!profile_path.empty() && !write_pair_profile(vm, profile_path)) {
+    return 1;
+  }
+  return error ? 70 : 0;
+}
 } // namespace
 
 int main(int argc, char *argv[]) {
   if (argc < 3) {
-    std::println(stderr, "Usage: ./your_program tokenize <filename>");
+    print_usage();
     return 1;
   }
 
   const std::string_view command = argv[1];
-  const std::string_view filename_arg = argv[2];
   bool scan_had_error = false;
 
   if (command == "tokenize") {
-    auto file_content_optional = read_file_contents(filename_arg);
+    BatchTokenizeOptions batch_options;
+    std::optional<std::vector<std::string>> paths =
+        parse_tokenize_arguments(argc, argv, batch_options);
+    if (!paths) {
+      print_usage();
+      return 1;
+    }
+    if (paths->size() != 1 || std::filesystem::is_directory((*paths)[0])) {
+      return tokenizeFiles(*paths, batch_options);
+    }
+
+    auto file_content_optional = read_file_contents((*paths)[0]);
     if (!file_content_optional) {
       return 1;
     }
@@ -44,10 +360,14 @@ int main(int argc, char *argv[]) {
     std::string_view source_view = owned_file_contents;
 
     Scanner scanner(source_view);
-    scan_had_error = scanner.scanAndPrintTokens();
-
-    std::println("EOF  null");
+    scan_had_error = scanner.scanAndPrintTokens(); // Ends with the EOF token
 
+  } else if (command == "parse") {
+    return run_parse(argc, argv);
+  } else if (command == "evaluate") {
+    return run_evaluate(argc, argv);
+  } else if (command == "run") {
+    return run_program(argc, argv);
   } else {
     std::println(stderr, "Unknown command: {}", command);
     return 1;
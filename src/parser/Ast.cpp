@@ -0,0 +1,85 @@
+#include "Ast.h"
+
+void Ast::appendProgram(const Ast &part, std::vector<NodeIndex> &top_level) {
+  // The part's root is dropped, so its node i lands at node_base + i.
+  uint32_t node_base = static_cast<uint32_t>(kinds_.size()) - 1;
+  uint32_t extra_base = static_cast<uint32_t>(extra_.size());
+  auto node = [node_base](uint32_t index) {
+    return index == kNoNode ? kNoNode : index + node_base;
+  };
+
+  kinds_.insert(kinds_.end(), part.kinds_.begin() + 1, part.kinds_.end());
+  tokens_.insert(tokens_.end(), part.tokens_.begin() + 1, part.tokens_.end());
+  extra_.insert(extra_.end(), part.extra_.begin(), part.extra_.end());
+  data_.reserve(data_.size() + part.data_.size() - 1);
+
+  // Rewrites the node indices stored in the part's extra array; each extra
+  // entry belongs to exactly one node, so each is patched once.
+  auto relocateNodes = [&](uint32_t first, uint32_t count) {
+    for (uint32_t i = first; i < first + count; ++i) {
+      extra_[extra_base + i] = node(extra_[extra_base + i]);
+    }
+  };
+
+  for (size_t i = 1; i < part.kinds_.size(); ++i) {
+    auto [lhs, rhs] = part.data_[i];
+    switch (part.kinds_[i]) {
+    case NodeKind::Program:
+    case NodeKind::Literal:
+    case NodeKind::Variable:
+    case NodeKind::This:
+    case NodeKind::Super: // lhs is a token
+      break;
+    case NodeKind::Grouping:
+    case NodeKind::Unary:
+    case NodeKind::Assign:
+    case NodeKind::Get:
+    case NodeKind::Expression: // rhs is the bare flag
+    case NodeKind::Print:
+    case NodeKind::Var:
+    case NodeKind::Return:
+      lhs = node(lhs);
+      break;
+    case NodeKind::Binary:
+    case NodeKind::Logical:
+    case NodeKind::Set:
+    case NodeKind::While:
+      lhs = node(lhs);
+      rhs = node(rhs);
+      break;
+    case NodeKind::Call:
+      lhs = node(lhs);
+      relocateNodes(rhs + 1, part.extra_[rhs]);
+      rhs += extra_base;
+      break;
+    case NodeKind::Block:
+      relocateNodes(lhs + 1, part.extra_[lhs]);
+      lhs += extra_base;
+      break;
+    case NodeKind::If:
+      lhs = node(lhs);
+      relocateNodes(rhs, 2);
+      rhs += extra_base;
+      break;
+    case NodeKind::For:
+      relocateNodes(lhs, 3);
+      lhs += extra_base;
+      rhs = node(rhs);
+      break;
+    case NodeKind::Function: // Parameters are tokens
+      lhs += extra_base;
+      relocateNodes(rhs + 1, part.extra_[rhs]);
+      rhs += extra_base;
+      break;
+    case NodeKind::Class: // lhs is a token
+      relocateNodes(rhs + 1, part.extra_[rhs]);
+      rhs += extra_base;
+      break;
+    }
+    data_.push_back(NodeData{lhs, rhs});
+  }
+
+  for (NodeIndex statement : part.list(part.data_[part.root()].lhs)) {
+    top_level.push_back(node(statement));
+  }
+}
@@ -0,0 +1,120 @@
+#ifndef AST_H
+#define AST_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Syntax tree for a Lox program, stored flat in the style of Zig's AST: a
+// node is an index into parallel arrays holding its kind, its main token
+// (an index into the Scanner's token buffer) and two 32-bit operands. Child
+// nodes are referred to by index, never by pointer, so a whole tree is four
+// contiguous arrays and a pass over it is a linear scan. Variable-length
+// child lists live in the `extra` array as a count followed by the items.
+//
+// Node 0 is the Program root. No other node refers to it, so 0 doubles as
+// "no node" in optional operands (kNoNode).
+
+using NodeIndex = uint32_t;
+inline constexpr NodeIndex kNoNode = 0;
+
+// What lhs/rhs hold for each kind. "list" is an extra index of a counted
+// list; the main token is noted where it is not the obvious one.
+enum class NodeKind : uint8_t {
+  Program, // lhs: list of top-level statements
+
+  // Expressions
+  Literal,  // token: the NUMBER/STRING/TRUE/FALSE/NIL token
+  Grouping, // lhs: inner expression
+  Unary,    // token: operator; lhs: operand
+  Binary,   // token: operator; lhs, rhs: operands
+  Logical,  // token: `and`/`or`; lhs, rhs: operands
+  Variable, // token: name
+  Assign,   // token: name; lhs: value
+  Call,     // token: ')'; lhs: callee; rhs: list of arguments
+  Get,      // token: property name; lhs: object
+  Set,      // token: property name; lhs: object; rhs: value
+  This,     // token: `this`
+  Super,    // token: `super`; lhs: method name token
+
+  // Statements
+  Expression, // lhs: expression; rhs: 1 for a bare trailing expression
+              // (no ';' before the end of the file), else 0
+  Print,      // lhs: expression
+  Var,        // token: name; lhs: initializer or kNoNode
+  Block,      // lhs: list of statements
+  If,         // lhs: condition; rhs: extra index of {then, else or kNoNode}
+  While,      // lhs: condition; rhs: body
+  For,        // lhs: extra index of {initializer, condition, increment},
+              // each optional; rhs: body
+  Function,   // token: name; lhs: list of parameter name tokens;
+              // rhs: list of body statements
+  Return,     // lhs: value or kNoNode
+  Class,      // token: name; lhs: superclass name token, or 0 if none
+              // (token 0 can never be one); rhs: list of Function nodes
+};
+
+struct NodeData {
+  uint32_t lhs;
+  uint32_t rhs;
+};
+
+// Every node costs one entry in each array.
+static_assert(sizeof(NodeKind) + sizeof(uint32_t) + sizeof(NodeData) <= 16);
+
+class Ast {
+public:
+  NodeKind kind(NodeIndex node) const { return kinds_[node]; }
+  uint32_t token(NodeIndex node) const { return tokens_[node]; }
+  NodeData data(NodeIndex node) const { return data_[node]; }
+  uint32_t extra(uint32_t index) const { return extra_[index]; }
+  // The counted list starting at extra index `index`.
+  std::span<const uint32_t> list(uint32_t index) const {
+    return {extra_.data() + index + 1, extra_[index]};
+  }
+
+  NodeIndex root() const { return 0; }
+  size_t nodeCount() const { return kinds_.size(); }
+
+  // Building
+  void reserve(size_t nodes) {
+    kinds_.reserve(nodes);
+    tokens_.reserve(nodes);
+    data_.reserve(nodes);
+  }
+  NodeIndex addNode(NodeKind kind, uint32_t token, uint32_t lhs = 0,
+                    uint32_t rhs = 0) {
+    kinds_.push_back(kind);
+    tokens_.push_back(token);
+    data_.push_back(NodeData{lhs, rhs});
+    return static_cast<NodeIndex>(kinds_.size() - 1);
+  }
+  void setData(NodeIndex node, NodeData data) { data_[node] = data; }
+  // Appends the items as-is and returns the extra index of the first.
+  uint32_t addExtra(std::span<const uint32_t> items) {
+    auto index = static_cast<uint32_t>(extra_.size());
+    extra_.insert(extra_.end(), items.begin(), items.end());
+    return index;
+  }
+  // Appends a counted list and returns its extra index.
+  uint32_t addList(std::span<const uint32_t> items) {
+    auto index = static_cast<uint32_t>(extra_.size());
+    extra_.push_back(static_cast<uint32_t>(items.size()));
+    extra_.insert(extra_.end(), items.begin(), items.end());
+    return index;
+  }
+
+  // Appends the statements of a program parsed separately over the same
+  // token buffer, relocating its node and extra indices, and pushes the
+  // relocated top-level statements onto top_level. This is how regions
+  // parsed in parallel are stitched into one tree.
+  void appendProgram(const Ast &part, std::vector<NodeIndex> &top_level);
+
+private:
+  std::vector<NodeKind> kinds_;
+  std::vector<uint32_t> tokens_;
+  std::vector<NodeData> data_;
+  std::vector<uint32_t> extra_;
+};
+
+#endif // AST_H
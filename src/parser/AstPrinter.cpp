@@ -0,0 +1,219 @@
+#include "AstPrinter.h"
+
+#include <format>
+#include <iterator> // For std::back_inserter
+
+namespace {
+
+class AstPrinter {
+public:
+  AstPrinter(const Ast &ast, Scanner &scanner, std::string &out)
+      : ast_(ast), scanner_(scanner), out_(out) {}
+
+  void node(NodeIndex index);
+
+private:
+  std::string_view text(uint32_t token) {
+    return scanner_.lexeme(scanner_.tokens()[token]);
+  }
+  void literal(uint32_t token);
+  void function(NodeIndex index);
+  // Appends " " followed by the node, so children read "(op a b)".
+  void spaced(NodeIndex index) {
+    out_ += ' ';
+    node(index);
+  }
+
+  const Ast &ast_;
+  Scanner &scanner_;
+  std::string &out_;
+  Scanner::NumberTextBuffer number_text_;
+};
+
+void AstPrinter::literal(uint32_t token) {
+  const Token &literal = scanner_.tokens()[token];
+  switch (literal.type) {
+  case TokenType::NUMBER:
+    // Literals that failed to convert were reported by the scanner, and
+    // nothing is printed when the scan had errors.
+    out_ += Scanner::formatDoubleForLoxLiteral(
+        scanner_.numberValue(token).value_or(0), number_text_);
+    break;
+  case TokenType::STRING:
+    out_ += scanner_.stringValue(literal);
+    break;
+  default: // true, false, nil
+    out_ += scanner_.lexeme(literal);
+    break;
+  }
+}
+
+void AstPrinter::function(NodeIndex index) {
+  auto out_it = std::back_inserter(out_);
+  auto [params, body] = ast_.data(index);
+  std::format_to(out_it, "(fun {}(", text(ast_.token(index)));
+  bool first = true;
+  for (uint32_t param : ast_.list(params)) {
+    std::format_to(out_it, "{}{}", first ? "" : " ", text(param));
+    first = false;
+  }
+  out_ += ')';
+  for (NodeIndex statement : ast_.list(body)) {
+    spaced(statement);
+  }
+  out_ += ')';
+}
+
+void AstPrinter::node(NodeIndex index) {
+  auto out_it = std::back_inserter(out_);
+  uint32_t token = ast_.token(index);
+  auto [lhs, rhs] = ast_.data(index);
+  switch (ast_.kind(index)) {
+  case NodeKind::Program:
+    for (NodeIndex statement : ast_.list(lhs)) {
+      node(statement);
+      out_ += '\n';
+    }
+    break;
+
+  case NodeKind::Literal:
+    literal(token);
+    break;
+  case NodeKind::Grouping:
+    out_ += "(group";
+    spaced(lhs);
+    out_ += ')';
+    break;
+  case NodeKind::Unary:
+    std::format_to(out_it, "({}", text(token));
+    spaced(lhs);
+    out_ += ')';
+    break;
+  case NodeKind::Binary:
+  case NodeKind::Logical:
+    std::format_to(out_it, "({}", text(token));
+    spaced(lhs);
+    spaced(rhs);
+    out_ += ')';
+    break;
+  case NodeKind::Variable:
+  case NodeKind::This:
+    out_ += text(token);
+    break;
+  case NodeKind::Assign:
+    std::format_to(out_it, "(= {}", text(token));
+    spaced(lhs);
+    out_ += ')';
+    break;
+  case NodeKind::Call:
+    out_ += "(call";
+    spaced(lhs);
+    for (NodeIndex argument : ast_.list(rhs)) {
+      spaced(argument);
+    }
+    out_ += ')';
+    break;
+  case NodeKind::Get:
+    out_ += "(.";
+    spaced(lhs);
+    std::format_to(out_it, " {})", text(token));
+    break;
+  case NodeKind::Set:
+    out_ += "(=";
+    spaced(lhs);
+    std::format_to(out_it, " {}", text(token));
+    spaced(rhs);
+    out_ += ')';
+    break;
+  case NodeKind::Super:
+    std::format_to(out_it, "(super {})", text(lhs));
+    break;
+
+  case NodeKind::Expression:
+    if (rhs != 0) { // Bare trailing expression
+      node(lhs);
+    } else {
+      out_ += "(;";
+      spaced(lhs);
+      out_ += ')';
+    }
+    break;
+  case NodeKind::Print:
+    out_ += "(print";
+    spaced(lhs);
+    out_ += ')';
+    break;
+  case NodeKind::Var:
+    std::format_to(out_it, "(var {}", text(token));
+    if (lhs != kNoNode) {
+      out_ += " =";
+      spaced(lhs);
+    }
+    out_ += ')';
+    break;
+  case NodeKind::Block:
+    out_ += "(block";
+    for (NodeIndex statement : ast_.list(lhs)) {
+      spaced(statement);
+    }
+    out_ += ')';
+    break;
+  case NodeKind::If: {
+    NodeIndex else_branch = ast_.extra(rhs + 1);
+    out_ += else_branch != kNoNode ? "(if-else" : "(if";
+    spaced(lhs);
+    spaced(ast_.extra(rhs));
+    if (else_branch != kNoNode) {
+      spaced(else_branch);
+    }
+    out_ += ')';
+    break;
+  }
+  case NodeKind::While:
+    out_ += "(while";
+    spaced(lhs);
+    spaced(rhs);
+    out_ += ')';
+    break;
+  case NodeKind::For:
+    // Missing clauses print as "()".
+    out_ += "(for";
+    for (uint32_t clause = lhs; clause < lhs + 3; ++clause) {
+      if (ast_.extra(clause) != kNoNode) {
+        spaced(ast_.extra(clause));
+      } else {
+        out_ += " ()";
+      }
+    }
+    spaced(rhs);
+    out_ += ')';
+    break;
+  case NodeKind::Function:
+    function(index);
+    break;
+  case NodeKind::Return:
+    out_ += "(return";
+    if (lhs != kNoNode) {
+      spaced(lhs);
+    }
+    out_ += ')';
+    break;
+  case NodeKind::Class:
+    std::format_to(out_it, "(class {}", text(token));
+    if (lhs != 0) {
+      std::format_to(out_it, " < {}", text(lhs));
+    }
+    for (NodeIndex method : ast_.list(rhs)) {
+      out_ += ' ';
+      function(method);
+    }
+    out_ += ')';
+    break;
+  }
+}
+
+} // namespace
+
+void writeAst(const Ast &ast, Scanner &scanner, std::string &out) {
+  AstPrinter(ast, scanner, out).node(ast.root());
+}
@@ -0,0 +1,15 @@
+#ifndef AST_PRINTER_H
+#define AST_PRINTER_H
+
+#include <string>
+
+#include "parser/Ast.h"
+#include "scanner/Scanner.h"
+
+// Appends the program in the parenthesized prefix form of Crafting
+// Interpreters' AstPrinter, one top-level statement per line: `(+ 1.0 2.0)`,
+// `(group x)`, `(var a = 1.0)`, `(print a)`, `(; f())`, ... A bare trailing
+// expression prints as the expression alone.
+void writeAst(const Ast &ast, Scanner &scanner, std::string &out);
+
+#endif // AST_PRINTER_H
@@ -0,0 +1,125 @@
+#include "ParallelParser.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace {
+
+// Below this many tokens per region, thread start-up and stitching cost more
+// than they save.
+constexpr uint32_t kMinRegionTokens = 16 * 1024;
+
+// Token indices where a top-level `fun`, `class` or `var` declaration starts
+// right after a `;` or `}` that closes the previous statement, outside any
+// braces or parentheses. In a valid program every such token begins a
+// declaration, so the file can be cut there.
+std::vector<uint32_t> findDeclarationBoundaries(const std::vector<Token> &tokens) {
+  std::vector<uint32_t> boundaries;
+  int depth = 0;
+  TokenType previous = TokenType::SEMICOLON; // Start of file
+  for (uint32_t i = 0; i < tokens.size(); ++i) {
+    TokenType type = tokens[i].type;
+    switch (type) {
+    case TokenType::LEFT_BRACE:
+    case TokenType::LEFT_PAREN:
+      ++depth;
+      break;
+    case TokenType::RIGHT_BRACE:
+    case TokenType::RIGHT_PAREN:
+      --depth;
+      break;
+    case TokenType::FUN:
+    case TokenType::CLASS:
+    case TokenType::VAR:
+      if (depth == 0 && (previous == TokenType::SEMICOLON ||
+                         previous == TokenType::RIGHT_BRACE)) {
+        boundaries.push_back(i);
+      }
+      break;
+    default:
+      break;
+    }
+    previous = type;
+  }
+  return boundaries;
+}
+
+ParseResult parseSerially(Scanner &scanner, size_t error_limit) {
+  Parser parser(scanner);
+  parser.setErrorLimit(error_limit);
+  Ast ast = parser.parseProgram();
+  return ParseResult{std::move(ast), parser.diagnostics(), parser.stopped()};
+}
+
+} // namespace
+
+ParseResult parseProgramParallel(Scanner &scanner, unsigned threads,
+                                 size_t error_limit) {
+  const std::vector<Token> &tokens = scanner.scanTokens();
+  auto eof = static_cast<uint32_t>(tokens.size() - 1);
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  if (threads == 1 || eof < 2 * kMinRegionTokens) {
+    return parseSerially(scanner, error_limit);
+  }
+
+  // Group declarations into regions of at least kMinRegionTokens, aiming for
+  // a few regions per thread so uneven regions still balance.
+  uint32_t target = std::max(kMinRegionTokens, eof / (threads * 4));
+  std::vector<uint32_t> starts = {0};
+  for (uint32_t boundary : findDeclarationBoundaries(tokens)) {
+    if (boundary - starts.back() >= target && eof - boundary >= target / 2) {
+      starts.push_back(boundary);
+    }
+  }
+  if (starts.size() == 1) {
+    return parseSerially(scanner, error_limit);
+  }
+  starts.push_back(eof);
+
+  size_t region_count = starts.size() - 1;
+  std::vector<Ast> parts(region_count);
+  std::atomic<bool> failed = false;
+  std::atomic<size_t> next_region = 0;
+  auto worker = [&] {
+    for (size_t region = next_region++; region < region_count;
+         region = next_region++) {
+      Parser parser(scanner, starts[region], starts[region + 1]);
+      parser.setErrorLimit(1); // Any error means a serial re-parse
+      parts[region] = parser.parseProgram();
+      if (parser.hadError()) {
+        failed = true;
+      }
+    }
+  };
+  {
+    std::vector<std::jthread> workers;
+    unsigned helpers = static_cast<unsigned>(
+        std::min<size_t>(threads, region_count) - 1);
+    for (unsigned i = 0; i < helpers; ++i) {
+      workers.emplace_back(worker);
+    }
+    worker();
+  } // Joins
+
+  if (failed) {
+    return parseSerially(scanner, error_limit);
+  }
+
+  ParseResult result;
+  Ast &ast = result.ast;
+  size_t nodes = 1;
+  for (const Ast &part : parts) {
+    nodes += part.nodeCount() - 1;
+  }
+  ast.reserve(nodes);
+  NodeIndex root = ast.addNode(NodeKind::Program, 0);
+  std::vector<NodeIndex> top_level;
+  for (const Ast &part : parts) {
+    ast.appendProgram(part, top_level);
+  }
+  ast.setData(root, NodeData{ast.addList(top_level), 0});
+  return result;
+}
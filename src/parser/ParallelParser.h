@@ -0,0 +1,27 @@
+#ifndef PARALLEL_PARSER_H
+#define PARALLEL_PARSER_H
+
+#include <vector>
+
+#include "parser/Ast.h"
+#include "parser/Parser.h"
+#include "scanner/Scanner.h"
+
+struct ParseResult {
+  Ast ast;
+  std::vector<ParseDiagnostic> diagnostics;
+  bool stopped_at_error_limit = false;
+};
+
+// Parses the whole token buffer, splitting large files across threads: a
+// brace-matching pre-pass finds the top-level `fun`/`class`/`var`
+// declarations that start right after a complete statement, runs of them
+// are parsed as independent regions on up to `threads` workers (0 = hardware
+// threads), and the region trees are stitched into one Ast in source order.
+// The result is identical to Parser::parseProgram(); small files, and files
+// with syntax errors (so the report, including error recovery and the
+// error_limit cap, matches a serial parse), are parsed on the calling thread.
+ParseResult parseProgramParallel(Scanner &scanner, unsigned threads = 0,
+                                 size_t error_limit = 0);
+
+#endif // PARALLEL_PARSER_H
@@ -0,0 +1,439 @@
+#include "Parser.h"
+
+#include <format>
+
+Parser::Parser(Scanner &scanner)
+    : Parser(scanner, 0,
+             static_cast<uint32_t>(scanner.scanTokens().size() - 1)) {}
+
+Parser::Parser(Scanner &scanner, uint32_t first_token, uint32_t end_token)
+    : scanner_(scanner), tokens_(scanner.scanTokens()), current_(first_token),
+      previous_(first_token), end_(end_token) {}
+
+const std::array<Parser::ParseRule, static_cast<size_t>(TokenType::COUNT)>
+    Parser::kRules = [] {
+      std::array<ParseRule, static_cast<size_t>(TokenType::COUNT)> rules{};
+      auto set = [&rules](TokenType type, PrefixFn prefix, InfixFn infix,
+                          Precedence precedence) {
+        rules[static_cast<size_t>(type)] = ParseRule{prefix, infix, precedence};
+      };
+      using P = Precedence;
+      set(TokenType::LEFT_PAREN, &Parser::grouping, &Parser::call, P::Call);
+      set(TokenType::DOT, nullptr, &Parser::dot, P::Call);
+      set(TokenType::MINUS, &Parser::unary, &Parser::binary, P::Term);
+      set(TokenType::PLUS, nullptr, &Parser::binary, P::Term);
+      set(TokenType::SLASH, nullptr, &Parser::binary, P::Factor);
+      set(TokenType::STAR, nullptr, &Parser::binary, P::Factor);
+      set(TokenType::BANG, &Parser::unary, nullptr, P::None);
+      set(TokenType::BANG_EQUAL, nullptr, &Parser::binary, P::Equality);
+      set(TokenType::EQUAL_EQUAL, nullptr, &Parser::binary, P::Equality);
+      set(TokenType::GREATER, nullptr, &Parser::binary, P::Comparison);
+      set(TokenType::GREATER_EQUAL, nullptr, &Parser::binary, P::Comparison);
+      set(TokenType::LESS, nullptr, &Parser::binary, P::Comparison);
+      set(TokenType::LESS_EQUAL, nullptr, &Parser::binary, P::Comparison);
+      set(TokenType::IDENTIFIER, &Parser::variable, nullptr, P::None);
+      set(TokenType::STRING, &Parser::literal, nullptr, P::None);
+      set(TokenType::NUMBER, &Parser::literal, nullptr, P::None);
+      set(TokenType::AND, nullptr, &Parser::logical, P::And);
+      set(TokenType::OR, nullptr, &Parser::logical, P::Or);
+      set(TokenType::FALSE, &Parser::literal, nullptr, P::None);
+      set(TokenType::TRUE, &Parser::literal, nullptr, P::None);
+      set(TokenType::NIL, &Parser::literal, nullptr, P::None);
+      set(TokenType::THIS, &Parser::thisExpr, nullptr, P::None);
+      set(TokenType::SUPER, &Parser::superExpr, nullptr, P::None);
+      return rules;
+    }();
+
+Ast Parser::parseProgram() {
+  // Roughly one node per two tokens in typical code.
+  ast_.reserve((end_ - current_) / 2 + 1);
+  NodeIndex root = ast_.addNode(NodeKind::Program, 0);
+  size_t from = scratch_.size();
+  while (!isAtEnd() && !stopped()) {
+    scratch_.push_back(declaration());
+  }
+  ast_.setData(root, NodeData{addList(from), 0});
+  return std::move(ast_);
+}
+
+// --- Declarations and statements ---
+
+NodeIndex Parser::declaration() {
+  NodeIndex node;
+  if (match(TokenType::CLASS)) {
+    node = classDeclaration();
+  } else if (match(TokenType::FUN)) {
+    node = function();
+  } else if (match(TokenType::VAR)) {
+    node = varDeclaration();
+  } else {
+    node = statement();
+  }
+  if (panic_mode_) {
+    synchronize();
+  }
+  return node;
+}
+
+NodeIndex Parser::classDeclaration() {
+  uint32_t name = consume(TokenType::IDENTIFIER, "Expect class name.");
+  uint32_t superclass = 0;
+  if (match(TokenType::LESS)) {
+    superclass = consume(TokenType::IDENTIFIER, "Expect superclass name.");
+  }
+  consume(TokenType::LEFT_BRACE, "Expect '{' before class body.");
+
+  size_t from = scratch_.size();
+  while (!check(TokenType::RIGHT_BRACE) && !isAtEnd() && !stopped()) {
+    scratch_.push_back(function());
+  }
+  consume(TokenType::RIGHT_BRACE, "Expect '}' after class body.");
+  return ast_.addNode(NodeKind::Class, name, superclass, addList(from));
+}
+
+// Parses a function's name, parameters and body; `fun` (if any) has already
+// been consumed. Methods share this.
+NodeIndex Parser::function() {
+  uint32_t name = consume(TokenType::IDENTIFIER, "Expect function name.");
+  consume(TokenType::LEFT_PAREN, "Expect '(' after function name.");
+  size_t params_from = scratch_.size();
+  if (!check(TokenType::RIGHT_PAREN)) {
+    do {
+      if (scratch_.size() - params_from >= 255) {
+        errorAt(current_, "Can't have more than 255 parameters.");
+      }
+      scratch_.push_back(
+          consume(TokenType::IDENTIFIER, "Expect parameter name."));
+    } while (match(TokenType::COMMA));
+  }
+  consume(TokenType::RIGHT_PAREN, "Expect ')' after parameters.");
+  uint32_t params = addList(params_from);
+
+  consume(TokenType::LEFT_BRACE, "Expect '{' before function body.");
+  ++block_depth_;
+  size_t body_from = scratch_.size();
+  while (!check(TokenType::RIGHT_BRACE) && !isAtEnd() && !stopped()) {
+    scratch_.push_back(declaration());
+  }
+  consume(TokenType::RIGHT_BRACE, "Expect '}' after block.");
+  --block_depth_;
+  return ast_.addNode(NodeKind::Function, name, params, addList(body_from));
+}
+
+NodeIndex Parser::varDeclaration() {
+  uint32_t name = consume(TokenType::IDENTIFIER, "Expect variable name.");
+  NodeIndex initializer = kNoNode;
+  if (match(TokenType::EQUAL)) {
+    initializer = expression();
+  }
+  consume(TokenType::SEMICOLON, "Expect ';' after variable declaration.");
+  return ast_.addNode(NodeKind::Var, name, initializer);
+}
+
+NodeIndex Parser::statement() {
+  switch (peekType()) {
+  case TokenType::PRINT:
+    return printStatement();
+  case TokenType::RETURN:
+    return returnStatement();
+  case TokenType::IF:
+    return ifStatement();
+  case TokenType::WHILE:
+    return whileStatement();
+  case TokenType::FOR:
+    return forStatement();
+  case TokenType::LEFT_BRACE:
+    return block();
+  default:
+    return expressionStatement();
+  }
+}
+
+NodeIndex Parser::printStatement() {
+  uint32_t keyword = advance();
+  NodeIndex value = expression();
+  consume(TokenType::SEMICOLON, "Expect ';' after value.");
+  return ast_.addNode(NodeKind::Print, keyword, value);
+}
+
+NodeIndex Parser::returnStatement() {
+  uint32_t keyword = advance();
+  NodeIndex value = kNoNode;
+  if (!check(TokenType::SEMICOLON)) {
+    value = expression();
+  }
+  consume(TokenType::SEMICOLON, "Expect ';' after return value.");
+  return ast_.addNode(NodeKind::Return, keyword, value);
+}
+
+NodeIndex Parser::ifStatement() {
+  uint32_t keyword = advance();
+  consume(TokenType::LEFT_PAREN, "Expect '(' after 'if'.");
+  NodeIndex condition = expression();
+  consume(TokenType::RIGHT_PAREN, "Expect ')' after if condition.");
+  ++block_depth_;
+  NodeIndex then_branch = statement();
+  NodeIndex else_branch = kNoNode;
+  if (match(TokenType::ELSE)) {
+    else_branch = statement();
+  }
+  --block_depth_;
+  uint32_t branches[] = {then_branch, else_branch};
+  return ast_.addNode(NodeKind::If, keyword, condition,
+                      ast_.addExtra(branches));
+}
+
+NodeIndex Parser::whileStatement() {
+  uint32_t keyword = advance();
+  consume(TokenType::LEFT_PAREN, "Expect '(' after 'while'.");
+  NodeIndex condition = expression();
+  consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
+  ++block_depth_;
+  NodeIndex body = statement();
+  --block_depth_;
+  return ast_.addNode(NodeKind::While, keyword, condition, body);
+}
+
+NodeIndex Parser::forStatement() {
+  uint32_t keyword = advance();
+  consume(TokenType::LEFT_PAREN, "Expect '(' after 'for'.");
+  ++block_depth_;
+  NodeIndex initializer = kNoNode;
+  if (match(TokenType::SEMICOLON)) {
+    // No initializer
+  } else if (match(TokenType::VAR)) {
+    initializer = varDeclaration();
+  } else {
+    initializer = expressionStatement();
+  }
+
+  NodeIndex condition = kNoNode;
+  if (!check(TokenType::SEMICOLON)) {
+    condition = expression();
+  }
+  consume(TokenType::SEMICOLON, "Expect ';' after loop condition.");
+
+  NodeIndex increment = kNoNode;
+  if (!check(TokenType::RIGHT_PAREN)) {
+    increment = expression();
+  }
+  consume(TokenType::RIGHT_PAREN, "Expect ')' after for clauses.");
+
+  NodeIndex body = statement();
+  --block_depth_;
+  uint32_t clauses[] = {initializer, condition, increment};
+  return ast_.addNode(NodeKind::For, keyword, ast_.addExtra(clauses), body);
+}
+
+NodeIndex Parser::block() {
+  uint32_t brace = advance();
+  ++block_depth_;
+  size_t from = scratch_.size();
+  while (!check(TokenType::RIGHT_BRACE) && !isAtEnd() && !stopped()) {
+    scratch_.push_back(declaration());
+  }
+  consume(TokenType::RIGHT_BRACE, "Expect '}' after block.");
+  --block_depth_;
+  return ast_.addNode(NodeKind::Block, brace, addList(from));
+}
+
+NodeIndex Parser::expressionStatement() {
+  uint32_t first = current_;
+  NodeIndex value = expression();
+  // A lone expression at the end of the file needs no ';', so `parse` and
+  // `evaluate` accept a bare expression as the whole program.
+  bool bare = block_depth_ == 0 &&
+              tokens_[current_].type == TokenType::END_OF_FILE && !panic_mode_;
+  if (!bare) {
+    consume(TokenType::SEMICOLON, "Expect ';' after expression.");
+  }
+  return ast_.addNode(NodeKind::Expression, first, value, bare ? 1 : 0);
+}
+
+// --- Expressions ---
+
+NodeIndex Parser::expression() {
+  return parsePrecedence(Precedence::Assignment);
+}
+
+NodeIndex Parser::parsePrecedence(Precedence precedence) {
+  if (stopped()) {
+    return kNoNode;
+  }
+  PrefixFn prefix = ruleFor(peekType()).prefix;
+  if (prefix == nullptr) {
+    errorAt(current_, "Expect expression.");
+    advance(); // Skip it, so every declaration consumes at least one token
+    return kNoNode;
+  }
+  advance();
+  // Only the loosest binding context may treat a following '=' as
+  // assignment; `a + b = c` must not parse as `a + (b = c)`.
+  bool can_assign = precedence <= Precedence::Assignment;
+  NodeIndex left = (this->*prefix)(can_assign);
+
+  while (precedence <= ruleFor(peekType()).precedence) {
+    InfixFn infix = ruleFor(peekType()).infix;
+    advance();
+    left = (this->*infix)(left, can_assign);
+  }
+
+  if (can_assign && check(TokenType::EQUAL)) {
+    errorAt(current_, "Invalid assignment target.");
+  }
+  return left;
+}
+
+NodeIndex Parser::literal(bool) {
+  return ast_.addNode(NodeKind::Literal, previous_);
+}
+
+NodeIndex Parser::grouping(bool) {
+  uint32_t paren = previous_;
+  NodeIndex inner = expression();
+  consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
+  return ast_.addNode(NodeKind::Grouping, paren, inner);
+}
+
+NodeIndex Parser::unary(bool) {
+  uint32_t op = previous_;
+  NodeIndex right = parsePrecedence(Precedence::Unary);
+  return ast_.addNode(NodeKind::Unary, op, right);
+}
+
+NodeIndex Parser::variable(bool can_assign) {
+  uint32_t name = previous_;
+  if (can_assign && match(TokenType::EQUAL)) {
+    NodeIndex value = expression();
+    return ast_.addNode(NodeKind::Assign, name, value);
+  }
+  return ast_.addNode(NodeKind::Variable, name);
+}
+
+NodeIndex Parser::thisExpr(bool) {
+  return ast_.addNode(NodeKind::This, previous_);
+}
+
+NodeIndex Parser::superExpr(bool) {
+  uint32_t keyword = previous_;
+  consume(TokenType::DOT, "Expect '.' after 'super'.");
+  uint32_t method =
+      consume(TokenType::IDENTIFIER, "Expect superclass method name.");
+  return ast_.addNode(NodeKind::Super, keyword, method);
+}
+
+NodeIndex Parser::binary(NodeIndex left, bool) {
+  uint32_t op = previous_;
+  // Left-associative: the right operand binds one level tighter.
+  auto next = static_cast<Precedence>(
+      static_cast<uint8_t>(ruleFor(tokens_[op].type).precedence) + 1);
+  NodeIndex right = parsePrecedence(next);
+  return ast_.addNode(NodeKind::Binary, op, left, right);
+}
+
+NodeIndex Parser::logical(NodeIndex left, bool) {
+  uint32_t op = previous_;
+  Precedence next = tokens_[op].type == TokenType::OR ? Precedence::And
+                                                      : Precedence::Equality;
+  NodeIndex right = parsePrecedence(next);
+  return ast_.addNode(NodeKind::Logical, op, left, right);
+}
+
+NodeIndex Parser::call(NodeIndex callee, bool) {
+  size_t from = scratch_.size();
+  if (!check(TokenType::RIGHT_PAREN)) {
+    do {
+      if (scratch_.size() - from >= 255) {
+        errorAt(current_, "Can't have more than 255 arguments.");
+      }
+      scratch_.push_back(expression());
+    } while (match(TokenType::COMMA));
+  }
+  uint32_t paren =
+      consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
+  return ast_.addNode(NodeKind::Call, paren, callee, addList(from));
+}
+
+NodeIndex Parser::dot(NodeIndex object, bool can_assign) {
+  uint32_t name =
+      consume(TokenType::IDENTIFIER, "Expect property name after '.'.");
+  if (can_assign && match(TokenType::EQUAL)) {
+    NodeIndex value = expression();
+    return ast_.addNode(NodeKind::Set, name, object, value);
+  }
+  return ast_.addNode(NodeKind::Get, name, object);
+}
+
+// --- Token cursor ---
+
+uint32_t Parser::advance() {
+  previous_ = current_;
+  if (!isAtEnd()) {
+    ++current_;
+  }
+  return previous_;
+}
+
+bool Parser::match(TokenType type) {
+  if (!check(type)) {
+    return false;
+  }
+  advance();
+  return true;
+}
+
+uint32_t Parser::consume(TokenType type, const char *message) {
+  if (check(type)) {
+    return advance();
+  }
+  errorAt(current_, message);
+  return current_;
+}
+
+void Parser::errorAt(uint32_t token_index, std::string message) {
+  // Until the next statement boundary, errors are cascades of this one.
+  if (panic_mode_ || stopped()) {
+    return;
+  }
+  panic_mode_ = true;
+  const Token &token = tokens_[token_index];
+  std::string location =
+      token_index == end_ || token.type == TokenType::END_OF_FILE
+          ? std::string(" at end")
+          : std::format(" at '{}'", scanner_.lexeme(token));
+  diagnostics_.push_back(
+      ParseDiagnostic{token.line, std::move(location), std::move(message)});
+}
+
+// Skips to the start of the next statement: just past a ';', or at a keyword
+// that begins a declaration or statement. It only moves forward, so an error
+// costs time proportional to the tokens it skips; the declaration that
+// failed has consumed at least one token, so recovery always makes progress.
+void Parser::synchronize() {
+  panic_mode_ = false;
+  while (!isAtEnd()) {
+    if (tokens_[previous_].type == TokenType::SEMICOLON) {
+      return;
+    }
+    switch (peekType()) {
+    case TokenType::CLASS:
+    case TokenType::FUN:
+    case TokenType::VAR:
+    case TokenType::FOR:
+    case TokenType::IF:
+    case TokenType::WHILE:
+    case TokenType::PRINT:
+    case TokenType::RETURN:
+      return;
+    default:
+      advance();
+    }
+  }
+}
+
+uint32_t Parser::addList(size_t from) {
+  uint32_t list = ast_.addList(
+      std::span<const uint32_t>(scratch_.data() + from, scratch_.size() - from));
+  scratch_.resize(from);
+  return list;
+}
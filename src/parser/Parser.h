@@ -0,0 +1,143 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "parser/Ast.h"
+#include "scanner/Scanner.h"
+
+// A syntax error. location is " at 'lexeme'" or " at end", so the report
+// reads "[line N] Error at 'x': message".
+struct ParseDiagnostic {
+  int line;
+  std::string location;
+  std::string message;
+};
+
+// Parses the Scanner's token buffer directly into a flat Ast: statements by
+// recursive descent, expressions with a table-driven Pratt parser (one
+// ParseRule per TokenType, as in clox).
+class Parser {
+public:
+  // The scanner must outlive the parser; its tokens are scanned on demand.
+  explicit Parser(Scanner &scanner);
+  // Parses only the declarations in tokens [first_token, end_token), which
+  // must start and end at top-level declaration boundaries. The token at
+  // end_token is treated as the end of the file.
+  Parser(Scanner &scanner, uint32_t first_token, uint32_t end_token);
+
+  // Parses declarations up to the end of the file (or range). After a syntax
+  // error the parser resynchronizes at the next statement boundary (panic
+  // mode) and keeps going, so one pass reports every independent error, up
+  // to the error limit. The tree is only meaningful if there were none.
+  Ast parseProgram();
+
+  // Stop parsing once this many errors have been reported; 0 = no limit.
+  void setErrorLimit(size_t limit) { error_limit_ = limit; }
+
+  const std::vector<ParseDiagnostic> &diagnostics() const {
+    return diagnostics_;
+  }
+  bool hadError() const { return !diagnostics_.empty(); }
+  // True if parsing stopped early at the error limit.
+  bool stopped() const {
+    return error_limit_ != 0 && diagnostics_.size() >= error_limit_;
+  }
+
+private:
+  enum class Precedence : uint8_t {
+    None,
+    Assignment, // =
+    Or,         // or
+    And,        // and
+    Equality,   // == !=
+    Comparison, // < > <= >=
+    Term,       // + -
+    Factor,     // * /
+    Unary,      // ! -
+    Call,       // . ()
+    Primary
+  };
+
+  using PrefixFn = NodeIndex (Parser::*)(bool can_assign);
+  using InfixFn = NodeIndex (Parser::*)(NodeIndex left, bool can_assign);
+
+  struct ParseRule {
+    PrefixFn prefix = nullptr;
+    InfixFn infix = nullptr;
+    Precedence precedence = Precedence::None;
+  };
+
+  static const std::array<ParseRule, static_cast<size_t>(TokenType::COUNT)>
+      kRules;
+  static const ParseRule &ruleFor(TokenType type) {
+    return kRules[static_cast<size_t>(type)];
+  }
+
+  // Declarations and statements
+  NodeIndex declaration();
+  NodeIndex classDeclaration();
+  NodeIndex function();
+  NodeIndex varDeclaration();
+  NodeIndex statement();
+  NodeIndex printStatement();
+  NodeIndex returnStatement();
+  NodeIndex ifStatement();
+  NodeIndex whileStatement();
+  NodeIndex forStatement();
+  NodeIndex block();
+  NodeIndex expressionStatement();
+
+  // Expressions
+  NodeIndex expression();
+  NodeIndex parsePrecedence(Precedence precedence);
+  NodeIndex literal(bool can_assign);
+  NodeIndex grouping(bool can_assign);
+  NodeIndex unary(bool can_assign);
+  NodeIndex variable(bool can_assign);
+  NodeIndex thisExpr(bool can_assign);
+  NodeIndex superExpr(bool can_assign);
+  NodeIndex binary(NodeIndex left, bool can_assign);
+  NodeIndex logical(NodeIndex left, bool can_assign);
+  NodeIndex call(NodeIndex left, bool can_assign);
+  NodeIndex dot(NodeIndex left, bool can_assign);
+
+  // Token cursor
+  TokenType peekType() const {
+    return current_ == end_ ? TokenType::END_OF_FILE : tokens_[current_].type;
+  }
+  bool check(TokenType type) const { return peekType() == type; }
+  bool isAtEnd() const { return check(TokenType::END_OF_FILE); }
+  uint32_t advance();
+  bool match(TokenType type);
+  // Consumes a token of the given type, or reports message at the current
+  // token. Returns the consumed token's index (meaningless after an error).
+  uint32_t consume(TokenType type, const char *message);
+
+  void errorAt(uint32_t token_index, std::string message);
+  void synchronize();
+
+  // Moves scratch_[from..] into a counted list in the extra array.
+  uint32_t addList(size_t from);
+
+  Scanner &scanner_;
+  Ast ast_;
+  const std::vector<Token> &tokens_;
+  uint32_t current_ = 0;
+  uint32_t previous_ = 0;
+  uint32_t end_; // Index of the token parsed as the end of the file
+  int block_depth_ = 0; // Enclosing blocks, bodies and branches
+  bool panic_mode_ = false; // Suppresses cascading errors until synchronized
+  size_t error_limit_ = 0;
+  std::vector<ParseDiagnostic> diagnostics_;
+
+  // Scratch stack for variable-length child lists; a list is built on top
+  // of the stack, copied into the extra array and popped, so nested lists
+  // share one allocation.
+  std::vector<uint32_t> scratch_;
+};
+
+#endif // PARSER_H
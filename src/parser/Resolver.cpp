@@ -0,0 +1,224 @@
+#include "Resolver.h"
+
+#include <format>
+#include <string_view>
+#include <unordered_map>
+#include <utility> // For std::move
+
+namespace {
+
+class Resolver {
+public:
+  Resolver(const Ast &ast, Scanner &scanner)
+      : ast_(ast), scanner_(scanner) {
+    resolution_.bindings.resize(ast.nodeCount());
+  }
+
+  Resolution run() {
+    node(ast_.root());
+    resolution_.global_count = static_cast<uint32_t>(globals_.size());
+    return std::move(resolution_);
+  }
+
+private:
+  std::string_view text(uint32_t token) {
+    return scanner_.lexeme(scanner_.tokens()[token]);
+  }
+  void node(NodeIndex index);
+  void nodes(std::span<const uint32_t> list) {
+    for (NodeIndex index : list) {
+      node(index);
+    }
+  }
+  // As the compiler resynchronizes after each declaration, at most one error
+  // is reported per statement of a list.
+  void statements(std::span<const uint32_t> list) {
+    for (NodeIndex index : list) {
+      node(index);
+      panic_mode_ = false;
+    }
+  }
+  void function(NodeIndex index);
+  Binding declare(uint32_t token);
+  // Makes the newest local readable once its initializer is resolved.
+  void markInitialized() {
+    if (block_depth_ > 0) {
+      locals_.back().depth = block_depth_;
+    }
+  }
+  void bind(NodeIndex index);
+  void error(uint32_t token, const char *message);
+  // A global's slot is assigned the first time its name is seen.
+  uint32_t globalSlot(std::string_view name) {
+    return globals_
+        .try_emplace(name, static_cast<uint32_t>(globals_.size()))
+        .first->second;
+  }
+
+  const Ast &ast_;
+  Scanner &scanner_;
+  Resolution resolution_;
+  struct Local {
+    std::string_view name;
+    int depth; // -1 while its initializer is resolved
+  };
+  // The locals in scope, innermost last; a local's slot is its index here.
+  std::vector<Local> locals_;
+  int block_depth_ = 0;
+  bool panic_mode_ = false;
+  std::unordered_map<std::string_view, uint32_t> globals_;
+};
+
+void Resolver::node(NodeIndex index) {
+  auto [lhs, rhs] = ast_.data(index);
+  switch (ast_.kind(index)) {
+  case NodeKind::Program:
+    statements(ast_.list(lhs));
+    break;
+  case NodeKind::Grouping:
+  case NodeKind::Unary:
+  case NodeKind::Get:
+  case NodeKind::Expression:
+  case NodeKind::Print:
+    node(lhs);
+    break;
+  case NodeKind::Binary:
+  case NodeKind::Logical:
+  case NodeKind::Set:
+  case NodeKind::While:
+    node(lhs);
+    node(rhs);
+    break;
+  case NodeKind::Call:
+    node(lhs);
+    nodes(ast_.list(rhs));
+    break;
+  case NodeKind::Variable:
+    bind(index);
+    break;
+  case NodeKind::Assign:
+    bind(index);
+    node(lhs);
+    break;
+  case NodeKind::Var:
+    // Declared first, as the compiler does, so the initializer can't read it.
+    resolution_.bindings[index] = declare(ast_.token(index));
+    if (lhs != kNoNode) {
+      node(lhs);
+    }
+    markInitialized();
+    break;
+  case NodeKind::Function:
+    declare(ast_.token(index));
+    markInitialized(); // A function may refer to itself
+    function(index);
+    break;
+  case NodeKind::Class:
+    declare(ast_.token(index));
+    markInitialized();
+    for (NodeIndex method : ast_.list(rhs)) {
+      function(method);
+    }
+    break;
+  case NodeKind::Block: {
+    size_t scope = locals_.size();
+    ++block_depth_;
+    statements(ast_.list(lhs));
+    --block_depth_;
+    locals_.resize(scope);
+    break;
+  }
+  case NodeKind::If:
+    node(lhs);
+    node(ast_.extra(rhs));
+    if (NodeIndex else_branch = ast_.extra(rhs + 1); else_branch != kNoNode) {
+      node(else_branch);
+    }
+    break;
+  case NodeKind::For: {
+    // The initializer's variable is scoped to the loop.
+    size_t scope = locals_.size();
+    ++block_depth_;
+    for (uint32_t i = 0; i < 3; ++i) {
+      if (NodeIndex part = ast_.extra(lhs + i); part != kNoNode) {
+        node(part);
+      }
+    }
+    node(rhs);
+    --block_depth_;
+    locals_.resize(scope);
+    break;
+  }
+  default:
+    break; // Literals, and what the evaluator refuses to run
+  }
+}
+
+void Resolver::function(NodeIndex index) {
+  // Parameters and body share the function's scope. It is deeper than any
+  // enclosing one, so the function's names never clash with those.
+  auto [parameters, body] = ast_.data(index);
+  size_t scope = locals_.size();
+  ++block_depth_;
+  for (uint32_t parameter : ast_.list(parameters)) {
+    declare(parameter);
+    markInitialized();
+  }
+  statements(ast_.list(body));
+  --block_depth_;
+  locals_.resize(scope);
+}
+
+Binding Resolver::declare(uint32_t token) {
+  std::string_view name = text(token);
+  if (block_depth_ == 0) {
+    return Binding{Binding::Scope::Global, globalSlot(name)};
+  }
+  for (auto it = locals_.rbegin(); it != locals_.rend(); ++it) {
+    if (it->depth != -1 && it->depth < block_depth_) {
+      break;
+    }
+    if (it->name == name) {
+      error(token, "Already a variable with this name in this scope.");
+    }
+  }
+  locals_.push_back(Local{name, -1});
+  return Binding{Binding::Scope::Local,
+                 static_cast<uint32_t>(locals_.size() - 1)};
+}
+
+void Resolver::bind(NodeIndex index) {
+  std::string_view name = text(ast_.token(index));
+  Binding &binding = resolution_.bindings[index];
+  for (size_t slot = locals_.size(); slot-- > 0;) {
+    if (locals_[slot].name == name) {
+      if (locals_[slot].depth == -1) {
+        // The compiler reports an assignment at its '=', the next token.
+        uint32_t at = ast_.token(index);
+        if (ast_.kind(index) == NodeKind::Assign) {
+          ++at;
+        }
+        error(at, "Can't read local variable in its own initializer.");
+      }
+      binding = Binding{Binding::Scope::Local, static_cast<uint32_t>(slot)};
+      return;
+    }
+  }
+  binding = Binding{Binding::Scope::Global, globalSlot(name)};
+}
+
+void Resolver::error(uint32_t token, const char *message) {
+  if (panic_mode_) {
+    return;
+  }
+  panic_mode_ = true;
+  resolution_.diagnostics.push_back(
+      ParseDiagnostic{scanner_.tokens()[token].line,
+                      std::format(" at '{}'", text(token)), message});
+}
+
+} // namespace
+
+Resolution resolveVariables(const Ast &ast, Scanner &scanner) {
+  return Resolver(ast, scanner).run();
+}
@@ -0,0 +1,39 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "parser/Ast.h"
+#include "parser/Parser.h" // For ParseDiagnostic
+#include "scanner/Scanner.h"
+
+// Where a variable lives, as bound by resolveVariables. The tree-walking
+// evaluator runs the program in one frame, since it leaves functions to the
+// VM: a local's slot is its index in that frame's stack of block-scoped
+// variables, and a global's is its index in a dense array with a slot for
+// every global name the program mentions.
+struct Binding {
+  enum class Scope : uint8_t { Global, Local };
+  Scope scope = Scope::Global;
+  uint32_t slot = 0;
+};
+
+struct Resolution {
+  // Parallel to the nodes; meaningful for Var, Variable and Assign nodes.
+  std::vector<Binding> bindings;
+  uint32_t global_count = 0;
+  // Scoping errors; the program must not be run if there are any.
+  std::vector<ParseDiagnostic> diagnostics;
+};
+
+// Binds every variable declaration, reference and assignment in the program
+// to a slot, following the evaluator's scoping: a reference is to the
+// innermost local of that name declared before it in an enclosing block, or
+// else to the global. Reports the scoping errors the compiler does, with the
+// same messages: a local read in its own initializer (`{ var a = a; }`), and
+// a local declared twice in one scope. Function and class bodies are only
+// checked for those errors; the evaluator does not run them.
+Resolution resolveVariables(const Ast &ast, Scanner &scanner);
+
+#endif // RESOLVER_H
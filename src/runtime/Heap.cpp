@@ -0,0 +1,862 @@
+#include "Heap.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace {
+
+// After a major collection the next one is due when the old generation has
+// grown by this factor over what survived.
+constexpr size_t kHeapGrowFactor = 2;
+constexpr size_t kMinMajorThreshold = 1024 * 1024;
+// Below this, starting the marking threads costs more than they save.
+constexpr size_t kParallelMarkMinBytes = 4 * 1024 * 1024;
+// A marking thread keeps this many gray objects to itself before it lets
+// the others steal some.
+constexpr size_t kMarkStealThreshold = 64;
+
+constexpr size_t roundUp(size_t size, size_t multiple) {
+  return (size + multiple - 1) / multiple * multiple;
+}
+
+// The bytes an object takes in its page.
+size_t objectSize(const Obj *object) {
+  size_t size = 0;
+  switch (object->type) {
+  case ObjType::String:
+    size = sizeof(ObjString) + static_cast<const ObjString *>(object)->length;
+    break;
+  case ObjType::Function:
+    size = sizeof(ObjFunction);
+    break;
+  case ObjType::Native:
+    size = sizeof(ObjNative);
+    break;
+  case ObjType::Closure:
+    size = sizeof(ObjClosure);
+    break;
+  case ObjType::Upvalue:
+    size = sizeof(ObjUpvalue);
+    break;
+  case ObjType::Class:
+    size = sizeof(ObjClass);
+    break;
+  case ObjType::Instance:
+    size = sizeof(ObjInstance);
+    break;
+  case ObjType::BoundMethod:
+    size = sizeof(ObjBoundMethod);
+    break;
+  }
+  return roundUp(size, 16);
+}
+
+// Old-generation cells come in multiples of 16 bytes up to 256, then powers
+// of two up to 8K.
+size_t sizeClass(size_t size) {
+  if (size <= 256) {
+    return size / 16 - 1;
+  }
+  return 16 + std::bit_width(size - 1) - 9;
+}
+
+size_t classSize(size_t size_class) {
+  return size_class < 16 ? (size_class + 1) * 16 : size_t{512}
+                                                       << (size_class - 16);
+}
+
+// Passes every reference the object holds to visit(target), which returns
+// where the target is now, and updates the reference if it moved. Scavenges,
+// marking slices and marking threads all trace objects through this.
+template <typename Visit> void traceReferences(Obj *object, Visit &&visit) {
+  auto object_ref = [&visit]<typename T>(T *&target) {
+    if (target != nullptr) {
+      if (Obj *moved = visit(target); moved != target) {
+        target = static_cast<T *>(moved);
+      }
+    }
+  };
+  auto value_ref = [&visit](Value &value) {
+    if (value.isObject()) {
+      if (Obj *moved = visit(value.asObject()); moved != value.asObject()) {
+        value = Value::object(moved);
+      }
+    }
+  };
+  switch (object->type) {
+  case ObjType::String:
+  case ObjType::Native:
+    break;
+  case ObjType::Function: {
+    auto *function = static_cast<ObjFunction *>(object);
+    object_ref(function->name);
+    for (Value &constant : function->chunk.constants) {
+      value_ref(constant);
+    }
+    // A cached shape is only valid while its class (which owns it) lives.
+    for (PropertyCache &cache : function->chunk.property_caches) {
+      for (PropertyCache::Entry &entry : cache.entries) {
+        if (entry.shape != nullptr) {
+          ObjClass *klass = entry.shape->klass(); // Moving it updates shape
+          object_ref(klass);
+          object_ref(entry.method);
+        }
+      }
+    }
+    break;
+  }
+  case ObjType::Closure: {
+    auto *closure = static_cast<ObjClosure *>(object);
+    object_ref(closure->function);
+    for (ObjUpvalue *&upvalue : closure->upvalues) {
+      object_ref(upvalue);
+    }
+    break;
+  }
+  case ObjType::Upvalue:
+    value_ref(static_cast<ObjUpvalue *>(object)->closed);
+    break;
+  case ObjType::Class: {
+    auto *klass = static_cast<ObjClass *>(object);
+    object_ref(klass->name);
+    for (Table::Entry &entry : klass->methods.entries()) {
+      if (entry.key != nullptr) {
+        object_ref(entry.key);
+        value_ref(entry.value);
+      }
+    }
+    klass->root_shape->visitNames(object_ref);
+    break;
+  }
+  case ObjType::Instance: {
+    auto *instance = static_cast<ObjInstance *>(object);
+    object_ref(instance->klass);
+    for (Value &field : instance->fields) {
+      value_ref(field);
+    }
+    break;
+  }
+  case ObjType::BoundMethod: {
+    auto *bound = static_cast<ObjBoundMethod *>(object);
+    value_ref(bound->receiver);
+    object_ref(bound->method);
+    break;
+  }
+  }
+}
+
+// The old-generation bytes an object keeps alive.
+size_t footprint(Obj *object) {
+  Page *page = Page::of(object);
+  return page->kind == Page::Kind::Large ? page->size : page->cell_size;
+}
+
+// While sweeping, an unswept object that wasn't marked is dead, and may
+// point at objects already swept.
+bool isUnsweptGarbage(const Page *page, const Obj *object) {
+  return page->needs_sweep && object->color == GcColor::White;
+}
+
+// One marking thread's gray objects: a private stack, and a deque the other
+// threads steal the oldest from once the private stack has plenty.
+struct MarkWorker {
+  std::vector<Obj *> local;
+  std::mutex mutex;
+  std::deque<Obj *> shared;
+  std::atomic<size_t> shared_size = 0;
+  size_t live_bytes = 0;
+};
+
+// Moves up to half of victim's shared objects to thief's private stack.
+bool steal(MarkWorker &thief, MarkWorker &victim) {
+  if (victim.shared_size.load(std::memory_order_relaxed) == 0) {
+    return false;
+  }
+  std::scoped_lock lock(victim.mutex);
+  size_t count = (victim.shared.size() + 1) / 2;
+  thief.local.insert(thief.local.end(), victim.shared.begin(),
+                     victim.shared.begin() + count);
+  victim.shared.erase(victim.shared.begin(), victim.shared.begin() + count);
+  victim.shared_size.store(victim.shared.size(), std::memory_order_relaxed);
+  return count != 0;
+}
+
+// Body of a marking thread. An object belongs to whichever thread turns it
+// from white to gray, so each is traced once. A thread out of work counts
+// itself idle and waits for work to steal; once every thread is idle there
+// is none left anywhere, since only a busy thread shares any.
+void mark(std::vector<MarkWorker> &workers, unsigned self,
+          std::atomic<unsigned> &idle) {
+  MarkWorker &worker = workers[self];
+  auto claim = [&worker](Obj *object) {
+    if (Page::of(object)->kind != Page::Kind::Nursery) {
+      std::atomic_ref<GcColor> color(object->color);
+      GcColor white = GcColor::White;
+      if (color.load(std::memory_order_relaxed) == white &&
+          color.compare_exchange_strong(white, GcColor::Gray,
+                                        std::memory_order_relaxed)) {
+        worker.local.push_back(object);
+      }
+    }
+    return object;
+  };
+  for (;;) {
+    while (!worker.local.empty()) {
+      Obj *object = worker.local.back();
+      worker.local.pop_back();
+      std::atomic_ref<GcColor>(object->color)
+          .store(GcColor::Black, std::memory_order_relaxed);
+      worker.live_bytes += footprint(object);
+      traceReferences(object, claim);
+      if (worker.local.size() > kMarkStealThreshold &&
+          worker.shared_size.load(std::memory_order_relaxed) == 0) {
+        std::scoped_lock lock(worker.mutex);
+        auto half = worker.local.begin() + worker.local.size() / 2;
+        worker.shared.assign(worker.local.begin(), half);
+        worker.local.erase(worker.local.begin(), half);
+        worker.shared_size.store(worker.shared.size(),
+                                 std::memory_order_relaxed);
+      }
+    }
+    bool stole = false;
+    for (size_t i = 0; i < workers.size() && !stole; ++i) {
+      stole = steal(worker, workers[(self + i) % workers.size()]);
+    }
+    if (stole) {
+      continue;
+    }
+    idle.fetch_add(1);
+    for (;;) {
+      if (idle.load() == workers.size()) {
+        return;
+      }
+      if (std::ranges::any_of(workers, [](const MarkWorker &other) {
+            return other.shared_size.load(std::memory_order_relaxed) != 0;
+          })) {
+        idle.fetch_sub(1);
+        break;
+      }
+      std::this_thread::yield();
+    }
+  }
+}
+
+Page *newPage(Page::Kind kind, size_t size) {
+  void *memory = std::aligned_alloc(Page::kSize, size);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return new (memory) Page(kind, size);
+}
+
+void freePage(Page *page) {
+  std::destroy_at(page);
+  std::free(page);
+}
+
+} // namespace
+
+Heap::Heap() {
+  setMarkThreads(0);
+  for (size_t i = 0; i < kNurseryPages; ++i) {
+    nursery_.push_back(newPage(Page::Kind::Nursery, Page::kSize));
+  }
+  top_ = nursery_[0]->begin();
+  end_ = nursery_[0]->end();
+}
+
+Heap::~Heap() {
+  resetNursery();
+  for (Page *page : nursery_) {
+    freePage(page);
+  }
+  for (Page *page : old_pages_) {
+    for (size_t i = 0; i < page->cell_count; ++i) {
+      if (page->allocated[i]) {
+        destroy(reinterpret_cast<Obj *>(page->cell(i)));
+      }
+    }
+    freePage(page);
+  }
+  for (Page *page : large_pages_) {
+    destroy(reinterpret_cast<Obj *>(page->begin()));
+    freePage(page);
+  }
+}
+
+void Heap::setMarkThreads(unsigned threads) {
+  mark_threads_ = threads != 0
+                      ? threads
+                      : std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::byte *Heap::allocateYoung(size_t size) {
+  if (size > kMaxCellSize) {
+    return allocateLarge(size);
+  }
+  if (static_cast<size_t>(end_ - top_) < size) {
+    nextNurseryPage();
+  }
+  std::byte *memory = top_;
+  top_ += size;
+  stats_.bytes_allocated += size;
+  return memory;
+}
+
+// A full nursery takes another page; the next safepoint collects it.
+void Heap::nextNurseryPage() {
+  nursery_[nursery_index_]->top = top_;
+  if (++nursery_index_ == nursery_.size()) {
+    nursery_.push_back(newPage(Page::Kind::Nursery, Page::kSize));
+  }
+  top_ = nursery_[nursery_index_]->begin();
+  end_ = nursery_[nursery_index_]->end();
+}
+
+// Takes a cell from the size class's current page. When that one is full it
+// moves on to a page with free cells left by a sweep, or else sweeps one more
+// page of the class and tries that, or else takes a new page. Sweeping at
+// most one page per page filled keeps the cost in proportion to allocation,
+// even when the pages are nearly all live. An incremental collector leaves
+// sweeping to its slices, which keep to the pause budget.
+std::byte *Heap::allocateOld(size_t size) {
+  size_t size_class = sizeClass(size);
+  Page *&page = current_pages_[size_class];
+  bool swept = incremental();
+  while (page == nullptr || page->free_list == nullptr) {
+    std::vector<Page *> &available = available_pages_[size_class];
+    std::vector<Page *> &unswept = unswept_pages_[size_class];
+    if (!available.empty()) {
+      page = available.back();
+      available.pop_back();
+      page->available = false;
+    } else if (!unswept.empty() && !swept) {
+      page = unswept.back();
+      unswept.pop_back();
+      sweepPage(page);
+      swept = true;
+    } else {
+      page = newPage(Page::Kind::Old, Page::kSize);
+      page->cell_size = static_cast<uint32_t>(classSize(size_class));
+      page->cell_count = static_cast<uint32_t>(
+          (Page::kSize - kPageHeaderSize) / page->cell_size);
+      page->free_count = page->cell_count;
+      for (size_t i = page->cell_count; i-- > 0;) {
+        auto *cell = reinterpret_cast<Page::FreeCell *>(page->cell(i));
+        cell->next = page->free_list;
+        page->free_list = cell;
+      }
+      old_pages_.push_back(page);
+    }
+  }
+  Page::FreeCell *cell = page->free_list;
+  page->free_list = cell->next;
+  --page->free_count;
+  page->allocated.set((reinterpret_cast<std::byte *>(cell) - page->begin()) /
+                      page->cell_size);
+  old_bytes_ += page->cell_size;
+  return reinterpret_cast<std::byte *>(cell);
+}
+
+std::byte *Heap::allocateLarge(size_t size) {
+  Page *page = newPage(Page::Kind::Large,
+                       roundUp(kPageHeaderSize + size, Page::kSize));
+  large_pages_.push_back(page);
+  old_bytes_ += page->size;
+  return page->begin();
+}
+
+template <typename T> T *Heap::construct(ObjType type) {
+  auto *object = new (allocateYoung(roundUp(sizeof(T), kAlignment))) T{};
+  object->type = type;
+  object->color = GcColor::White;
+  object->forwarding = nullptr;
+  return object;
+}
+
+ObjString *Heap::allocateString(uint32_t length) {
+  auto *string = reinterpret_cast<ObjString *>(
+      allocateYoung(roundUp(sizeof(ObjString) + length, kAlignment)));
+  string->type = ObjType::String;
+  string->color = GcColor::White;
+  string->forwarding = nullptr;
+  string->length = length;
+  return string;
+}
+
+// Returns the interned copy of a freshly built string, freeing the new one
+// if an equal string already exists. It was the last allocation, so freeing
+// it is just moving the nursery's top back.
+ObjString *Heap::intern(ObjString *string) {
+  if (ObjString *existing =
+          strings_.findString(string->view(), string->hash)) {
+    Page *page = Page::of(string);
+    if (page->kind == Page::Kind::Large) {
+      large_pages_.pop_back();
+      old_bytes_ -= page->size;
+      freePage(page);
+    } else {
+      size_t size = objectSize(string);
+      top_ -= size;
+      stats_.bytes_allocated -= size;
+    }
+    return existing;
+  }
+  addString(string);
+  return string;
+}
+
+void Heap::addString(ObjString *string) {
+  strings_.set(string, Value());
+  if (Page::of(string)->kind == Page::Kind::Nursery) {
+    young_strings_.push_back(string);
+  }
+}
+
+ObjString *Heap::makeString(std::string_view chars) {
+  uint32_t hash = hashString(chars);
+  if (ObjString *existing = strings_.findString(chars, hash)) {
+    return existing;
+  }
+  ObjString *string = allocateString(static_cast<uint32_t>(chars.size()));
+  std::memcpy(string->chars, chars.data(), chars.size());
+  string->hash = hash;
+  addString(string);
+  return string;
+}
+
+ObjString *Heap::concatenate(const ObjString *a, const ObjString *b) {
+  ObjString *string = allocateString(a->length + b->length);
+  std::memcpy(string->chars, a->chars, a->length);
+  std::memcpy(string->chars + a->length, b->chars, b->length);
+  string->hash = hashString(string->view());
+  return intern(string);
+}
+
+ObjFunction *Heap::newFunction() {
+  return construct<ObjFunction>(ObjType::Function);
+}
+
+ObjNative *Heap::newNative(NativeFn function) {
+  auto *native = construct<ObjNative>(ObjType::Native);
+  native->function = function;
+  return native;
+}
+
+ObjClosure *Heap::newClosure(ObjFunction *function) {
+  auto *closure = construct<ObjClosure>(ObjType::Closure);
+  closure->function = function;
+  closure->upvalues.assign(function->captures.size(), nullptr);
+  return closure;
+}
+
+ObjUpvalue *Heap::newUpvalue(Value *slot) {
+  auto *upvalue = construct<ObjUpvalue>(ObjType::Upvalue);
+  upvalue->location = slot;
+  return upvalue;
+}
+
+ObjClass *Heap::newClass(ObjString *name) {
+  auto *klass = construct<ObjClass>(ObjType::Class);
+  klass->name = name;
+  klass->root_shape = std::make_unique<Shape>(klass);
+  return klass;
+}
+
+ObjInstance *Heap::newInstance(ObjClass *klass) {
+  auto *instance = construct<ObjInstance>(ObjType::Instance);
+  instance->klass = klass;
+  instance->shape = klass->root_shape.get();
+  instance->fields.reserve(klass->slot_capacity);
+  return instance;
+}
+
+ObjBoundMethod *Heap::newBoundMethod(Value receiver, ObjClosure *method) {
+  auto *bound = construct<ObjBoundMethod>(ObjType::BoundMethod);
+  bound->receiver = receiver;
+  bound->method = method;
+  return bound;
+}
+
+// Returns where the object is after this reference to it has been seen.
+Obj *Heap::visit(Obj *object) {
+  if (phase_ == Phase::Scavenge) {
+    if (Page::of(object)->kind != Page::Kind::Nursery) {
+      return object;
+    }
+    return object->forwarding != nullptr ? object->forwarding
+                                         : evacuate(object);
+  }
+  // Nursery objects are left to the scavenge that ends marking, which
+  // promotes the live ones gray.
+  if (object->color == GcColor::White &&
+      Page::of(object)->kind != Page::Kind::Nursery) {
+    object->color = GcColor::Gray;
+    mark_stack_.push_back(object);
+  }
+  return object;
+}
+
+void Heap::markTable(Table &table) {
+  for (Table::Entry &entry : table.entries()) {
+    if (entry.key != nullptr) {
+      markObject(entry.key);
+      markValue(entry.value);
+    }
+  }
+}
+
+// Moves a surviving nursery object into the old generation and leaves the
+// copy's address behind for the other references to it.
+Obj *Heap::evacuate(Obj *object) {
+  size_t size = objectSize(object);
+  std::byte *memory = allocateOld(size);
+  Obj *copy = nullptr;
+  switch (object->type) {
+  case ObjType::String:
+    copy = reinterpret_cast<Obj *>(std::memcpy(memory, object, size));
+    break;
+  case ObjType::Function:
+    copy = new (memory)
+        ObjFunction(std::move(*static_cast<ObjFunction *>(object)));
+    break;
+  case ObjType::Native:
+    copy = new (memory) ObjNative(*static_cast<ObjNative *>(object));
+    break;
+  case ObjType::Closure:
+    copy = new (memory)
+        ObjClosure(std::move(*static_cast<ObjClosure *>(object)));
+    break;
+  case ObjType::Upvalue: {
+    auto *upvalue = static_cast<ObjUpvalue *>(object);
+    auto *moved = new (memory) ObjUpvalue(*upvalue);
+    if (upvalue->location == &upvalue->closed) {
+      moved->location = &moved->closed;
+    }
+    copy = moved;
+    break;
+  }
+  case ObjType::Class: {
+    auto *moved =
+        new (memory) ObjClass(std::move(*static_cast<ObjClass *>(object)));
+    moved->root_shape->setClass(moved);
+    copy = moved;
+    break;
+  }
+  case ObjType::Instance:
+    copy = new (memory)
+        ObjInstance(std::move(*static_cast<ObjInstance *>(object)));
+    break;
+  case ObjType::BoundMethod:
+    copy =
+        new (memory) ObjBoundMethod(*static_cast<ObjBoundMethod *>(object));
+    break;
+  }
+  copy->forwarding = nullptr;
+  object->forwarding = copy;
+  stats_.bytes_promoted += size;
+  if (copy->type != ObjType::String) {
+    gray_stack_.push_back(copy);
+  }
+  // A major collection in progress must not miss the copy: while marking, it
+  // joins the gray objects; while sweeping, it survives an unswept page.
+  if (state_ == State::Marking) {
+    copy->color = GcColor::Gray;
+    mark_stack_.push_back(copy);
+  } else if (state_ == State::Sweeping && Page::of(copy)->needs_sweep) {
+    copy->color = GcColor::Black;
+  }
+  return copy;
+}
+
+void Heap::blacken(Obj *object) {
+  traceReferences(object, [this](Obj *target) { return visit(target); });
+}
+
+void Heap::drainGrayStack() {
+  while (!gray_stack_.empty()) {
+    Obj *object = gray_stack_.back();
+    gray_stack_.pop_back();
+    blacken(object);
+  }
+}
+
+// The remembered set of a minor collection: old objects stored into since the
+// last one may point into the nursery, so the objects starting on each dirty
+// card are traced like roots. Afterwards nothing old points into the
+// nursery, so every card is clean again.
+void Heap::scanDirtyCards() {
+  // Indexed: evacuating may add pages, whose cards are all clean.
+  for (size_t index = 0; index < old_pages_.size(); ++index) {
+    Page *page = old_pages_[index];
+    for (size_t card = 0; card < Page::kCards; ++card) {
+      if (page->cards[card] == 0) {
+        continue;
+      }
+      page->cards[card] = 0;
+      size_t card_start = card * Page::kCardSize;
+      size_t card_end = card_start + Page::kCardSize;
+      if (card_end <= kPageHeaderSize) {
+        continue;
+      }
+      size_t first = card_start <= kPageHeaderSize
+                         ? 0
+                         : roundUp(card_start - kPageHeaderSize,
+                                   page->cell_size) /
+                               page->cell_size;
+      size_t last = std::min<size_t>(
+          page->cell_count,
+          roundUp(card_end - kPageHeaderSize, page->cell_size) /
+              page->cell_size);
+      for (size_t i = first; i < last; ++i) {
+        auto *object = reinterpret_cast<Obj *>(page->cell(i));
+        if (page->allocated[i] && !isUnsweptGarbage(page, object)) {
+          blacken(object);
+        }
+      }
+    }
+  }
+  for (Page *page : large_pages_) {
+    uint8_t &card = page->cards[page->cardOf(page->begin())];
+    auto *object = reinterpret_cast<Obj *>(page->begin());
+    if (card != 0) {
+      card = 0;
+      if (!isUnsweptGarbage(page, object)) {
+        blacken(object);
+      }
+    }
+  }
+}
+
+void Heap::finishScavenge() {
+  drainGrayStack();
+  // Interned strings that died young leave the table; the others are keyed
+  // by their copies.
+  for (ObjString *string : young_strings_) {
+    strings_.remove(string);
+    if (string->forwarding != nullptr) {
+      strings_.set(static_cast<ObjString *>(string->forwarding), Value());
+    }
+  }
+  young_strings_.clear();
+  resetNursery();
+  ++stats_.minor_collections;
+}
+
+// Runs the destructors of the nursery's objects, live ones having been moved
+// from, and empties it.
+void Heap::resetNursery() {
+  nursery_[nursery_index_]->top = top_;
+  for (size_t i = 0; i <= nursery_index_; ++i) {
+    Page *page = nursery_[i];
+    for (std::byte *next = page->begin(); next < page->top;) {
+      auto *object = reinterpret_cast<Obj *>(next);
+      next += objectSize(object);
+      destroy(object);
+    }
+    page->top = nullptr;
+  }
+  while (nursery_.size() > kNurseryPages) {
+    freePage(nursery_.back());
+    nursery_.pop_back();
+  }
+  nursery_index_ = 0;
+  top_ = nursery_[0]->begin();
+  end_ = nursery_[0]->end();
+}
+
+// Traces gray objects until none are left, returning true, or the deadline
+// passes.
+bool Heap::markSlice(std::chrono::steady_clock::time_point deadline) {
+  phase_ = Phase::Mark;
+  if (deadline == std::chrono::steady_clock::time_point::max() &&
+      mark_threads_ > 1 && old_bytes_ >= kParallelMarkMinBytes) {
+    markInParallel();
+    return true;
+  }
+  size_t traced = 0;
+  while (!mark_stack_.empty()) {
+    Obj *object = mark_stack_.back();
+    mark_stack_.pop_back();
+    object->color = GcColor::Black;
+    live_bytes_ += footprint(object);
+    blacken(object);
+    // Reading the clock costs more than tracing a small object.
+    if (++traced % 256 == 0 && std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Drains the mark stack on mark_threads_ threads, this one included. The
+// mutator is stopped, so nothing moves and the only shared state is the
+// objects' colors.
+void Heap::markInParallel() {
+  std::vector<MarkWorker> workers(mark_threads_);
+  for (size_t i = 0; i < mark_stack_.size(); ++i) {
+    workers[i % workers.size()].local.push_back(mark_stack_[i]);
+  }
+  mark_stack_.clear();
+  std::atomic<unsigned> idle = 0;
+  {
+    std::vector<std::jthread> helpers;
+    for (unsigned i = 1; i < workers.size(); ++i) {
+      helpers.emplace_back([&workers, &idle, i] { mark(workers, i, idle); });
+    }
+    mark(workers, 0, idle);
+  }
+  for (const MarkWorker &worker : workers) {
+    live_bytes_ += worker.live_bytes;
+  }
+}
+
+void Heap::finishMarking() {
+  // Interned strings nothing else references are about to be freed.
+  for (Table::Entry &entry : strings_.entries()) {
+    if (entry.key != nullptr && entry.key->color == GcColor::White) {
+      strings_.remove(entry.key);
+    }
+  }
+  for (Page *page : old_pages_) {
+    page->needs_sweep = true;
+    unswept_pages_[sizeClass(page->cell_size)].push_back(page);
+  }
+  for (Page *page : large_pages_) {
+    page->needs_sweep = true;
+  }
+  // What wasn't marked is as good as freed, swept or not.
+  old_bytes_ = live_bytes_;
+  next_major_ = std::max(old_bytes_ * kHeapGrowFactor, kMinMajorThreshold);
+  state_ = State::Sweeping;
+  ++stats_.major_collections;
+}
+
+// Sweeps the pages allocation hasn't got to until none are left or the
+// deadline passes.
+void Heap::sweepSlice(std::chrono::steady_clock::time_point deadline) {
+  for (std::vector<Page *> &unswept : unswept_pages_) {
+    while (!unswept.empty()) {
+      Page *page = unswept.back();
+      unswept.pop_back();
+      sweepPage(page);
+      if (std::chrono::steady_clock::now() >= deadline) {
+        return;
+      }
+    }
+  }
+  finishSweeping();
+}
+
+// Frees the page's white objects and whitens its black ones, making it
+// available to allocation if that left free cells.
+void Heap::sweepPage(Page *page) {
+  page->needs_sweep = false;
+  for (size_t i = 0; i < page->cell_count; ++i) {
+    if (!page->allocated[i]) {
+      continue;
+    }
+    auto *object = reinterpret_cast<Obj *>(page->cell(i));
+    if (object->color == GcColor::Black) {
+      object->color = GcColor::White;
+      continue;
+    }
+    destroy(object);
+    page->allocated.reset(i);
+    auto *cell = reinterpret_cast<Page::FreeCell *>(object);
+    cell->next = page->free_list;
+    page->free_list = cell;
+    ++page->free_count;
+  }
+  size_t size_class = sizeClass(page->cell_size);
+  if (page->free_count != 0 && !page->available &&
+      page != current_pages_[size_class]) {
+    page->available = true;
+    available_pages_[size_class].push_back(page);
+  }
+}
+
+// Sweeps the large objects and releases the old pages left empty.
+void Heap::finishSweeping() {
+  std::erase_if(large_pages_, [this](Page *page) {
+    if (!page->needs_sweep) {
+      return false;
+    }
+    page->needs_sweep = false;
+    auto *object = reinterpret_cast<Obj *>(page->begin());
+    if (object->color == GcColor::Black) {
+      object->color = GcColor::White;
+      return false;
+    }
+    destroy(object);
+    freePage(page);
+    return true;
+  });
+  auto releasable = [this](Page *page) {
+    return page->free_count == page->cell_count &&
+           page != current_pages_[sizeClass(page->cell_size)];
+  };
+  for (std::vector<Page *> &available : available_pages_) {
+    std::erase_if(available, releasable);
+  }
+  std::erase_if(old_pages_, [&](Page *page) {
+    if (!releasable(page)) {
+      return false;
+    }
+    freePage(page);
+    return true;
+  });
+  state_ = State::Idle;
+}
+
+void Heap::destroy(Obj *object) {
+  switch (object->type) {
+  case ObjType::String:
+    break; // Nothing outside the page
+  case ObjType::Function:
+    std::destroy_at(static_cast<ObjFunction *>(object));
+    break;
+  case ObjType::Native:
+    std::destroy_at(static_cast<ObjNative *>(object));
+    break;
+  case ObjType::Closure:
+    std::destroy_at(static_cast<ObjClosure *>(object));
+    break;
+  case ObjType::Upvalue:
+    std::destroy_at(static_cast<ObjUpvalue *>(object));
+    break;
+  case ObjType::Class:
+    std::destroy_at(static_cast<ObjClass *>(object));
+    break;
+  case ObjType::Instance:
+    std::destroy_at(static_cast<ObjInstance *>(object));
+    break;
+  case ObjType::BoundMethod:
+    std::destroy_at(static_cast<ObjBoundMethod *>(object));
+    break;
+  }
+}
+
+void Heap::recordPause(std::chrono::steady_clock::duration pause) {
+  double ms = std::chrono::duration<double, std::milli>(pause).count();
+  ++stats_.pauses;
+  stats_.total_pause_ms += ms;
+  stats_.max_pause_ms = std::max(stats_.max_pause_ms, ms);
+}
+
+uint32_t hashString(std::string_view chars) {
+  uint32_t hash = 2166136261u;
+  for (char c : chars) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 16777619;
+  }
+  return hash;
+}
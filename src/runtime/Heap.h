@@ -0,0 +1,232 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "runtime/Object.h"
+#include "runtime/Page.h"
+#include "runtime/Table.h"
+
+// Counters for `run --stats`.
+struct GcStats {
+  uint64_t minor_collections = 0;
+  uint64_t major_collections = 0;
+  uint64_t pauses = 0; // Each collect() call
+  double total_pause_ms = 0;
+  double max_pause_ms = 0;
+  uint64_t bytes_allocated = 0; // In the nursery
+  uint64_t bytes_promoted = 0;
+};
+
+// Allocates and garbage-collects Lox objects in two generations.
+//
+// New objects are bump-allocated in the nursery. A minor collection copies
+// the nursery objects reachable from the roots, or from old objects through a
+// dirty card (see Page.h), into the old generation and empties the nursery, so
+// its cost is proportional to what survives rather than to what was
+// allocated. Every survivor is promoted, so old objects only point into the
+// nursery through stores made since the last collection, which the owner
+// reports with writeBarrier(). The old generation is divided into pages of
+// size-classed cells and collected by mark-sweep once it has doubled since
+// the last major collection.
+//
+// By default a major collection marks the whole old generation in one
+// pause, with several threads once it is big enough: each traces from its
+// own mark stack, claims objects by atomically turning them gray, and steals
+// from the others when it runs out. With a pause budget set, marking is
+// incremental instead: the mark stack is drained in slices that stop when
+// the budget runs out, one per safepoint after each nursery page the mutator
+// fills. Between slices the write barrier keeps the tri-color invariant by
+// turning a black object that is stored into gray again, and the roots are
+// marked again before marking ends. Should the old generation double again
+// before a cycle finishes, the rest of it runs in one pause.
+//
+// Sweeping is lazy and per page: allocation sweeps a page of the size class
+// it needs when it runs out of free cells, and the pages left over are swept
+// in slices if there is a pause budget, or else before the next major
+// collection starts.
+//
+// Allocation never collects, and the nursery overflows into extra pages
+// rather than collecting: the owner calls collect() at a safepoint, where
+// every live value is reachable from the roots it visits, after checking
+// shouldCollect(). Objects move, so the roots are visited by reference and
+// updated. Strings are interned; the intern table holds them weakly.
+class Heap {
+public:
+  Heap();
+  ~Heap();
+
+  Heap(const Heap &) = delete;
+  Heap &operator=(const Heap &) = delete;
+
+  ObjString *makeString(std::string_view chars);
+  ObjString *concatenate(const ObjString *a, const ObjString *b);
+  ObjFunction *newFunction();
+  ObjNative *newNative(NativeFn function);
+  ObjClosure *newClosure(ObjFunction *function);
+  ObjUpvalue *newUpvalue(Value *slot);
+  ObjClass *newClass(ObjString *name);
+  ObjInstance *newInstance(ObjClass *klass);
+  ObjBoundMethod *newBoundMethod(Value receiver, ObjClosure *method);
+
+  // Zero, the default, collects the old generation in one pause.
+  void setPauseBudget(std::chrono::steady_clock::duration budget) {
+    pause_budget_ = budget;
+  }
+  // Threads that mark a big old generation in a single pause; 0 = hardware
+  // threads, the default.
+  void setMarkThreads(unsigned threads);
+
+  // Must follow every store of a reference into an existing object's fields,
+  // so the next minor collection finds it if the object is old, and an
+  // incremental major collection traces the object again if it already has.
+  void writeBarrier(Obj *object) {
+    Page::of(object)->dirtyCard(object);
+    if (state_ == State::Marking && object->color == GcColor::Black) {
+      object->color = GcColor::Gray;
+      mark_stack_.push_back(object);
+    }
+  }
+
+  bool shouldCollect() const {
+    if (state_ == State::Marking ||
+        (state_ == State::Sweeping && incremental())) {
+      return nursery_index_ > slice_index_;
+    }
+    return nursery_index_ >= kNurseryPages || old_bytes_ > next_major_;
+  }
+
+  // Runs a minor collection if the nursery is full, then starts or continues
+  // a major one if one is due. visit_roots(heap) must pass every root to
+  // markValue/markObject/markTable, which may update it; it may be called
+  // more than once.
+  template <typename VisitRoots> void collect(VisitRoots &&visit_roots) {
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    if (incremental() && old_bytes_ <= 2 * next_major_) {
+      deadline = start + pause_budget_;
+    }
+    if (nursery_index_ >= kNurseryPages) {
+      scavenge(visit_roots);
+    }
+    if (state_ == State::Sweeping &&
+        (incremental() || old_bytes_ > next_major_)) {
+      sweepSlice(deadline);
+    }
+    if (state_ == State::Idle && old_bytes_ > next_major_) {
+      live_bytes_ = 0;
+      phase_ = Phase::Mark;
+      visit_roots(*this);
+      state_ = State::Marking;
+    }
+    if (state_ == State::Marking && markSlice(deadline)) {
+      // The roots may hold objects the mutator has since moved out of
+      // marked ones, and the nursery objects that were skipped.
+      scavenge(visit_roots);
+      phase_ = Phase::Mark;
+      visit_roots(*this);
+      markSlice(std::chrono::steady_clock::time_point::max());
+      finishMarking();
+    }
+    slice_index_ = nursery_index_;
+    recordPause(std::chrono::steady_clock::now() - start);
+  }
+
+  void markValue(Value &value) {
+    if (value.isObject()) {
+      value = Value::object(visit(value.asObject()));
+    }
+  }
+  template <typename T> void markObject(T *&object) {
+    if (object != nullptr) {
+      object = static_cast<T *>(visit(object));
+    }
+  }
+  void markTable(Table &table);
+
+  const GcStats &stats() const { return stats_; }
+
+private:
+  // Every allocation is a multiple of this, which keeps objects aligned.
+  static constexpr size_t kAlignment = 16;
+  static constexpr size_t kNurseryPages = 4;
+  // Bigger objects get a page of their own in the old generation.
+  static constexpr size_t kMaxCellSize = 8 * 1024;
+  static constexpr size_t kSizeClasses = 16 + 5; // 16..256 by 16, 512..8K
+
+  // What a reference passed to visit() is being seen for.
+  enum class Phase : uint8_t { Scavenge, Mark };
+  // Where the major collector is between pauses.
+  enum class State : uint8_t { Idle, Marking, Sweeping };
+
+  bool incremental() const {
+    return pause_budget_ != std::chrono::steady_clock::duration::zero();
+  }
+
+  template <typename T> T *construct(ObjType type);
+  std::byte *allocateYoung(size_t size);
+  std::byte *allocateOld(size_t size);
+  std::byte *allocateLarge(size_t size);
+  void nextNurseryPage();
+  ObjString *allocateString(uint32_t length);
+  ObjString *intern(ObjString *string);
+  void addString(ObjString *string);
+
+  Obj *visit(Obj *object);
+  Obj *evacuate(Obj *object);
+  void blacken(Obj *object);
+  void drainGrayStack();
+  void scanDirtyCards();
+  template <typename VisitRoots> void scavenge(VisitRoots &visit_roots) {
+    phase_ = Phase::Scavenge;
+    scanDirtyCards();
+    visit_roots(*this);
+    finishScavenge();
+  }
+  void finishScavenge();
+  bool markSlice(std::chrono::steady_clock::time_point deadline);
+  void markInParallel();
+  void finishMarking();
+  void sweepSlice(std::chrono::steady_clock::time_point deadline);
+  void sweepPage(Page *page);
+  void finishSweeping();
+  void resetNursery();
+  void destroy(Obj *object);
+  void recordPause(std::chrono::steady_clock::duration pause);
+
+  Phase phase_ = Phase::Scavenge;
+  State state_ = State::Idle;
+  std::chrono::steady_clock::duration pause_budget_{};
+  unsigned mark_threads_;
+  size_t slice_index_ = 0; // Nursery page at the end of the last pause
+  std::vector<Page *> nursery_; // The first kNurseryPages are kept
+  size_t nursery_index_ = 0;    // The page being bump-allocated
+  std::byte *top_;              // Its next free byte
+  std::byte *end_;
+  std::vector<ObjString *> young_strings_; // Interned nursery strings
+
+  std::vector<Page *> old_pages_;
+  std::vector<Page *> large_pages_;
+  // Per size class: the page cells are taken from, and others with free ones.
+  std::array<Page *, kSizeClasses> current_pages_{};
+  std::array<std::vector<Page *>, kSizeClasses> available_pages_;
+  std::array<std::vector<Page *>, kSizeClasses> unswept_pages_;
+  size_t old_bytes_ = 0;  // Marked in the last cycle, or allocated since
+  size_t live_bytes_ = 0; // Marked so far in this cycle
+  size_t next_major_ = 1024 * 1024;
+
+  Table strings_; // Weak: dead strings are removed before they are freed
+  std::vector<Obj *> gray_stack_; // Promoted objects to scan
+  std::vector<Obj *> mark_stack_; // Gray objects
+  GcStats stats_;
+};
+
+// FNV-1a, as in clox.
+uint32_t hashString(std::string_view chars);
+
+#endif // HEAP_H
@@ -0,0 +1,127 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "runtime/Shape.h"
+#include "runtime/Table.h"
+#include "runtime/Value.h"
+#include "vm/Chunk.h"
+
+enum class ObjType : uint8_t {
+  String,
+  Function,
+  Native,
+  Closure,
+  Upvalue,
+  Class,
+  Instance,
+  BoundMethod,
+};
+
+// Tri-color marking state of an old object: white until the major collector
+// reaches it, gray while its references are waiting to be traced, black once
+// they have been.
+enum class GcColor : uint8_t { White, Gray, Black };
+
+// Header shared by every heap object. When a minor collection copies a
+// nursery object into the old generation, the original's `forwarding` points
+// at the copy.
+struct Obj {
+  ObjType type;
+  GcColor color;
+  Obj *forwarding;
+};
+
+// Immutable, interned string; the characters follow the struct in the same
+// allocation. Interning makes equal strings the same object, so string
+// equality and table lookups compare pointers.
+struct ObjString : Obj {
+  uint32_t length;
+  uint32_t hash;
+  char chars[]; // Not NUL-terminated
+
+  std::string_view view() const { return {chars, length}; }
+};
+
+// Where a closure finds each variable it captures when it is created: a
+// register of the enclosing frame, or one of the enclosing closure's own
+// upvalues.
+struct UpvalueCapture {
+  bool is_local;
+  uint8_t index;
+};
+
+struct ObjFunction : Obj {
+  int arity = 0;
+  int max_registers = 1; // Frame size: locals and temporaries, with R[0]
+  std::vector<UpvalueCapture> captures;
+  Chunk chunk;
+  ObjString *name = nullptr; // Null for the top-level script
+};
+
+using NativeFn = Value (*)(int arg_count, Value *args);
+
+struct ObjNative : Obj {
+  NativeFn function;
+};
+
+// A captured variable. While open it points at the variable's stack slot;
+// when the variable goes out of scope the value moves into `closed` and
+// location points there.
+struct ObjUpvalue : Obj {
+  Value *location;
+  Value closed;
+  ObjUpvalue *next_open = nullptr; // Open upvalues, sorted by stack slot
+};
+
+struct ObjClosure : Obj {
+  ObjFunction *function;
+  std::vector<ObjUpvalue *> upvalues;
+};
+
+struct ObjClass : Obj {
+  ObjString *name;
+  Table methods;
+  std::unique_ptr<Shape> root_shape; // New instances' shape: no fields
+  // The most fields any instance has had, reserved up front for new ones.
+  uint32_t slot_capacity = 0;
+};
+
+// Field values live in fields, at the slots shape gives their names.
+struct ObjInstance : Obj {
+  ObjClass *klass;
+  Shape *shape;
+  std::vector<Value> fields;
+};
+
+struct ObjBoundMethod : Obj {
+  Value receiver;
+  ObjClosure *method;
+};
+
+inline bool isObjType(Value value, ObjType type) {
+  return value.isObject() && value.asObject()->type == type;
+}
+inline bool isString(Value value) { return isObjType(value, ObjType::String); }
+
+inline ObjString *asString(Value value) {
+  return static_cast<ObjString *>(value.asObject());
+}
+inline ObjFunction *asFunction(Value value) {
+  return static_cast<ObjFunction *>(value.asObject());
+}
+inline ObjClosure *asClosure(Value value) {
+  return static_cast<ObjClosure *>(value.asObject());
+}
+inline ObjClass *asClass(Value value) {
+  return static_cast<ObjClass *>(value.asObject());
+}
+inline ObjInstance *asInstance(Value value) {
+  return static_cast<ObjInstance *>(value.asObject());
+}
+
+#endif // OBJECT_H
@@ -0,0 +1,70 @@
+#ifndef PAGE_H
+#define PAGE_H
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+
+// The heap is made of kSize-aligned pages, so the page holding an object is
+// found by masking its address. A nursery page is bump-allocated; an old page
+// is divided into equal cells of one size class; a large page holds one
+// object too big for any cell, and may span several kSize blocks (its header
+// is still at the start of the first).
+//
+// Every page has a card table for the generational write barrier: a store
+// into an object dirties the card holding the object's start, and a minor
+// collection scans the old objects that start on dirty cards for references
+// into the nursery. Nursery cards are never read.
+struct Page {
+  static constexpr size_t kSize = 256 * 1024;
+  static constexpr size_t kCardSize = 512;
+  static constexpr size_t kCards = kSize / kCardSize;
+  static constexpr size_t kMaxCells = kSize / 16;
+
+  enum class Kind : uint8_t { Nursery, Old, Large };
+
+  // An unallocated cell of an old page, on the page's free list.
+  struct FreeCell {
+    FreeCell *next;
+  };
+
+  Page(Kind kind, size_t size) : kind(kind), size(size) {}
+
+  Kind kind;
+  // Old and large pages: marked in the last major collection and not swept
+  // since, so an object allocated here must start out black.
+  bool needs_sweep = false;
+  bool available = false;  // Old pages: on the heap's list of pages to fill
+  uint32_t cell_size = 0;  // Old pages
+  uint32_t cell_count = 0; // Old pages
+  uint32_t free_count = 0; // Old pages
+  FreeCell *free_list = nullptr; // Old pages
+  size_t size;              // Bytes in the whole allocation
+  std::byte *top = nullptr; // Nursery pages: end of the allocated objects
+  std::array<uint8_t, kCards> cards{};
+  std::bitset<kMaxCells> allocated; // Old pages: the cells holding objects
+
+  static Page *of(const void *address) {
+    return reinterpret_cast<Page *>(reinterpret_cast<uintptr_t>(address) &
+                                    ~(uintptr_t{kSize} - 1));
+  }
+
+  std::byte *begin();
+  std::byte *end() { return reinterpret_cast<std::byte *>(this) + size; }
+  std::byte *cell(size_t index) { return begin() + index * cell_size; }
+
+  size_t cardOf(const void *address) const {
+    return (reinterpret_cast<uintptr_t>(address) & (kSize - 1)) / kCardSize;
+  }
+  void dirtyCard(const void *address) { cards[cardOf(address)] = 1; }
+};
+
+// Objects start after the header, 16-byte aligned.
+inline constexpr size_t kPageHeaderSize = (sizeof(Page) + 15) & ~size_t{15};
+
+inline std::byte *Page::begin() {
+  return reinterpret_cast<std::byte *>(this) + kPageHeaderSize;
+}
+
+#endif // PAGE_H
@@ -0,0 +1,12 @@
+#ifndef RUNTIME_ERROR_H
+#define RUNTIME_ERROR_H
+
+#include <string>
+
+// An error that stops a running program, reported as "message\n[line N]".
+struct RuntimeError {
+  int line;
+  std::string message;
+};
+
+#endif // RUNTIME_ERROR_H
@@ -0,0 +1,19 @@
+#include "Shape.h"
+
+#include <algorithm>
+
+#include "runtime/Object.h"
+
+Shape *Shape::addField(ObjString *name) {
+  for (const Transition &transition : transitions_) {
+    if (transition.name == name) {
+      return transition.shape.get();
+    }
+  }
+  auto shape = std::make_unique<Shape>(klass_);
+  shape->slots_ = slots_;
+  shape->slots_.set(name, Value::number(slot_count_));
+  shape->slot_count_ = slot_count_ + 1;
+  klass_->slot_capacity = std::max(klass_->slot_capacity, shape->slot_count_);
+  return transitions_.emplace_back(name, std::move(shape)).shape.get();
+}
@@ -0,0 +1,75 @@
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "runtime/Table.h"
+
+struct ObjClass;
+struct ObjString;
+
+// A hidden class: the field layout shared by every instance of a class that
+// was given the same fields in the same order. An instance stores its field
+// values in a slot array and points at its shape, which maps each field name
+// to a slot, so instances don't each carry a hash table and a property access
+// site can cache the slot per shape (see PropertyCache in Chunk.h).
+//
+// A class's shapes form a tree rooted at the empty shape: adding a field
+// follows, or creates, the transition for that name. The class owns the
+// tree, so a shape lives as long as its class.
+class Shape {
+public:
+  explicit Shape(ObjClass *klass) : klass_(klass) {}
+
+  Shape(const Shape &) = delete;
+  Shape &operator=(const Shape &) = delete;
+
+  ObjClass *klass() const { return klass_; }
+  uint32_t slotCount() const { return slot_count_; }
+
+  // The slot of the field named name, or -1 if this shape has no such field.
+  int slotOf(const ObjString *name) const {
+    Value slot;
+    return slots_.get(name, slot) ? static_cast<int>(slot.asNumber()) : -1;
+  }
+
+  // The shape with name added as the next slot after this one's.
+  Shape *addField(ObjString *name);
+
+  // Calls visit(name) with a reference to every field name held in the tree
+  // rooted here, for the garbage collector, which may move the name.
+  template <typename Visit> void visitNames(Visit &&visit) {
+    for (Table::Entry &entry : slots_.entries()) {
+      if (entry.key != nullptr) {
+        visit(entry.key);
+      }
+    }
+    for (Transition &transition : transitions_) {
+      visit(transition.name);
+      transition.shape->visitNames(visit);
+    }
+  }
+
+  // Points the tree rooted here at its class's new address.
+  void setClass(ObjClass *klass) {
+    klass_ = klass;
+    for (Transition &transition : transitions_) {
+      transition.shape->setClass(klass);
+    }
+  }
+
+private:
+  struct Transition {
+    ObjString *name;
+    std::unique_ptr<Shape> shape;
+  };
+
+  ObjClass *klass_;
+  Table slots_; // Field name to slot index, as a number
+  uint32_t slot_count_ = 0;
+  std::vector<Transition> transitions_;
+};
+
+#endif // SHAPE_H
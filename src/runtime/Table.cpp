@@ -0,0 +1,199 @@
+#include "Table.h"
+
+#include <bit>
+#include <utility> // For std::as_const
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "runtime/Object.h"
+
+namespace {
+
+// A hash picks its first group with the high bits and is matched within a
+// group by the low 7, so the two are independent.
+size_t groupHash(uint32_t hash) { return hash >> 7; }
+int8_t slotHash(uint32_t hash) { return static_cast<int8_t>(hash & 0x7f); }
+
+// Bit i is set for each control byte i of the group that equals byte.
+uint32_t match(const int8_t *group, int8_t byte) {
+#if defined(__SSE2__)
+  __m128i control =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+  return static_cast<uint32_t>(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8(byte))));
+#else
+  uint32_t mask = 0;
+  for (size_t i = 0; i < Table::kGroupSize; ++i) {
+    mask |= static_cast<uint32_t>(group[i] == byte) << i;
+  }
+  return mask;
+#endif
+}
+
+// Bit i is set for each empty or deleted slot of the group, whose control
+// bytes are the only negative ones.
+uint32_t matchFree(const int8_t *group) {
+#if defined(__SSE2__)
+  return static_cast<uint32_t>(_mm_movemask_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(group))));
+#else
+  uint32_t mask = 0;
+  for (size_t i = 0; i < Table::kGroupSize; ++i) {
+    mask |= static_cast<uint32_t>(group[i] < 0) << i;
+  }
+  return mask;
+#endif
+}
+
+// Slots are filled up to 7/8 of the capacity.
+size_t maxLoad(size_t capacity) { return capacity - capacity / 8; }
+
+} // namespace
+
+// Groups are probed triangularly (+1, +2, +3... groups), which visits every
+// group when there is a power of two of them. A probe stops at the first
+// group with an empty slot: a key is never placed past one.
+const Table::Entry *Table::find(const ObjString *key) const {
+  size_t group_mask = control_.size() / kGroupSize - 1;
+  size_t group = groupHash(key->hash) & group_mask;
+  int8_t h2 = slotHash(key->hash);
+  for (size_t step = 1;; ++step) {
+    const int8_t *control = &control_[group * kGroupSize];
+    for (uint32_t bits = match(control, h2); bits != 0; bits &= bits - 1) {
+      const Entry &entry =
+          entries_[group * kGroupSize + std::countr_zero(bits)];
+      if (entry.key == key) {
+        return &entry;
+      }
+    }
+    if (match(control, kEmpty) != 0) {
+      return nullptr;
+    }
+    group = (group + step) & group_mask;
+  }
+}
+
+Table::Entry *Table::find(const ObjString *key) {
+  return const_cast<Entry *>(std::as_const(*this).find(key));
+}
+
+// The first empty or deleted slot on the probe sequence for hash.
+size_t Table::findFree(uint32_t hash) const {
+  size_t group_mask = control_.size() / kGroupSize - 1;
+  size_t group = groupHash(hash) & group_mask;
+  for (size_t step = 1;; ++step) {
+    if (uint32_t bits = matchFree(&control_[group * kGroupSize]); bits != 0) {
+      return group * kGroupSize + std::countr_zero(bits);
+    }
+    group = (group + step) & group_mask;
+  }
+}
+
+bool Table::get(const ObjString *key, Value &value) const {
+  if (count_ == 0) {
+    return false;
+  }
+  const Entry *entry = find(key);
+  if (entry == nullptr) {
+    return false;
+  }
+  value = entry->value;
+  return true;
+}
+
+bool Table::set(ObjString *key, Value value) {
+  if (control_.empty()) {
+    rehash(kGroupSize);
+  }
+  if (Entry *entry = find(key)) {
+    entry->value = value;
+    return false;
+  }
+  size_t index = findFree(key->hash);
+  if (control_[index] == kEmpty) {
+    if (growth_left_ == 0) {
+      // Rebuild at the same capacity if deleted slots are taking it up.
+      rehash(count_ < maxLoad(control_.size()) / 2 ? control_.size()
+                                                   : control_.size() * 2);
+      index = findFree(key->hash);
+    }
+    if (control_[index] == kEmpty) {
+      --growth_left_;
+    }
+  }
+  control_[index] = slotHash(key->hash);
+  entries_[index] = Entry{key, value};
+  ++count_;
+  return true;
+}
+
+bool Table::remove(const ObjString *key) {
+  if (count_ == 0) {
+    return false;
+  }
+  Entry *entry = find(key);
+  if (entry == nullptr) {
+    return false;
+  }
+  size_t index = entry - entries_.data();
+  // A group that still has an empty slot has never been full, so no probe
+  // has gone past it and the slot can be empty again. Otherwise it must stay
+  // deleted so those probes keep going.
+  const int8_t *group = &control_[index / kGroupSize * kGroupSize];
+  if (match(group, kEmpty) != 0) {
+    control_[index] = kEmpty;
+    ++growth_left_;
+  } else {
+    control_[index] = kDeleted;
+  }
+  entries_[index] = Entry{};
+  --count_;
+  return true;
+}
+
+void Table::addAll(const Table &from) {
+  for (const Entry &entry : from.entries_) {
+    if (entry.key != nullptr) {
+      set(entry.key, entry.value);
+    }
+  }
+}
+
+ObjString *Table::findString(std::string_view chars, uint32_t hash) const {
+  if (count_ == 0) {
+    return nullptr;
+  }
+  size_t group_mask = control_.size() / kGroupSize - 1;
+  size_t group = groupHash(hash) & group_mask;
+  int8_t h2 = slotHash(hash);
+  for (size_t step = 1;; ++step) {
+    const int8_t *control = &control_[group * kGroupSize];
+    for (uint32_t bits = match(control, h2); bits != 0; bits &= bits - 1) {
+      size_t index = group * kGroupSize + std::countr_zero(bits);
+      ObjString *key = entries_[index].key;
+      if (key->hash == hash && key->view() == chars) {
+        return key;
+      }
+    }
+    if (match(control, kEmpty) != 0) {
+      return nullptr;
+    }
+    group = (group + step) & group_mask;
+  }
+}
+
+void Table::rehash(size_t capacity) {
+  std::vector<Entry> old = std::move(entries_);
+  control_.assign(capacity, kEmpty);
+  entries_.assign(capacity, Entry{});
+  growth_left_ = maxLoad(capacity) - count_;
+  for (const Entry &entry : old) {
+    if (entry.key != nullptr) {
+      size_t index = findFree(entry.key->hash);
+      control_[index] = slotHash(entry.key->hash);
+      entries_[index] = entry;
+    }
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "runtime/Value.h"
+
+struct ObjString;
+
+// Hash table keyed by interned strings, laid out like Abseil's SwissTable:
+// open addressing over groups of kGroupSize slots, with a control byte per
+// slot that is either empty, deleted, or the low 7 bits of the key's hash. A
+// probe compares a whole group's control bytes against those 7 bits at once
+// (one SSE2 compare where available) and only looks at the keys that match,
+// so a miss rarely touches an entry at all. Keys are compared by pointer and
+// their precomputed hashes are reused, so a lookup never touches string
+// contents (except findString, which is how strings get interned).
+class Table {
+public:
+  static constexpr size_t kGroupSize = 16;
+
+  struct Entry {
+    ObjString *key = nullptr; // Null in an empty or deleted slot
+    Value value;
+  };
+
+  bool get(const ObjString *key, Value &value) const;
+  // Returns true if the key was not already present.
+  bool set(ObjString *key, Value value);
+  bool remove(const ObjString *key);
+  void addAll(const Table &from);
+  ObjString *findString(std::string_view chars, uint32_t hash) const;
+
+  // Every slot, for the garbage collector, which may move keys in place (a
+  // slot depends only on the key's hash) and remove them while iterating.
+  std::vector<Entry> &entries() { return entries_; }
+  const std::vector<Entry> &entries() const { return entries_; }
+
+private:
+  // A control byte: one of these, or the 7-bit hash of a full slot's key.
+  static constexpr int8_t kEmpty = -128;
+  static constexpr int8_t kDeleted = -2;
+
+  Entry *find(const ObjString *key);
+  const Entry *find(const ObjString *key) const;
+  size_t findFree(uint32_t hash) const;
+  void rehash(size_t capacity);
+
+  std::vector<int8_t> control_; // Capacity is a multiple of kGroupSize
+  std::vector<Entry> entries_;
+  size_t count_ = 0;       // Live entries
+  size_t growth_left_ = 0; // Empty slots that may still be filled
+};
+
+#endif // TABLE_H
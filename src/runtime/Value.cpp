@@ -0,0 +1,85 @@
+#include "Value.h"
+
+#include <cmath>
+#include <format>
+#include <iterator> // For std::back_inserter
+
+#include "runtime/Object.h"
+
+bool valuesEqual(Value a, Value b) {
+  if (a.isNumber() && b.isNumber()) {
+    return a.asNumber() == b.asNumber();
+  }
+  // Strings are interned, so equal strings are the same object.
+  return a.bits() == b.bits();
+}
+
+std::string_view formatNumber(double value, Scanner::NumberTextBuffer &buffer) {
+  if (std::isnan(value)) {
+    return "NaN";
+  }
+  if (std::isinf(value)) {
+    return value > 0 ? "Infinity" : "-Infinity";
+  }
+  std::string_view text = Scanner::formatDoubleForLoxLiteral(value, buffer);
+  if (text.ends_with(".0")) {
+    text.remove_suffix(2);
+  }
+  return text;
+}
+
+namespace {
+
+void writeFunctionName(const ObjFunction *function, std::string &out) {
+  if (function->name == nullptr) {
+    out += "<script>";
+  } else {
+    std::format_to(std::back_inserter(out), "<fn {}>", function->name->view());
+  }
+}
+
+void writeObject(const Obj *object, std::string &out) {
+  switch (object->type) {
+  case ObjType::String:
+    out += static_cast<const ObjString *>(object)->view();
+    break;
+  case ObjType::Function:
+    writeFunctionName(static_cast<const ObjFunction *>(object), out);
+    break;
+  case ObjType::Native:
+    out += "<native fn>";
+    break;
+  case ObjType::Closure:
+    writeFunctionName(static_cast<const ObjClosure *>(object)->function, out);
+    break;
+  case ObjType::Upvalue:
+    out += "upvalue";
+    break;
+  case ObjType::Class:
+    out += static_cast<const ObjClass *>(object)->name->view();
+    break;
+  case ObjType::Instance:
+    std::format_to(std::back_inserter(out), "{} instance",
+                   static_cast<const ObjInstance *>(object)->klass->name->view());
+    break;
+  case ObjType::BoundMethod:
+    writeFunctionName(
+        static_cast<const ObjBoundMethod *>(object)->method->function, out);
+    break;
+  }
+}
+
+} // namespace
+
+void writeValue(Value value, std::string &out) {
+  if (value.isNumber()) {
+    Scanner::NumberTextBuffer buffer;
+    out += formatNumber(value.asNumber(), buffer);
+  } else if (value.isNil()) {
+    out += "nil";
+  } else if (value.isBool()) {
+    out += value.asBool() ? "true" : "false";
+  } else {
+    writeObject(value.asObject(), out);
+  }
+}
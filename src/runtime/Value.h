@@ -0,0 +1,91 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "scanner/Scanner.h" // For Scanner::NumberTextBuffer
+
+struct Obj;
+
+// A Lox value packed into one 64-bit word (NaN boxing). Doubles are stored
+// as themselves. Every other value is a quiet NaN with bits no arithmetic
+// result carries (hardware NaNs never set bit 50): nil, false and true are
+// small tags in the low bits; object pointers set the sign bit and keep the
+// 48-bit address in the low bits. Values are trivially copyable and fit in a
+// register, and type tests are a mask and a compare.
+class Value {
+public:
+  constexpr Value() : bits_(kQuietNan | kTagNil) {}
+
+  static constexpr Value nil() { return Value(); }
+  static constexpr Value boolean(bool b) {
+    return fromBits(kQuietNan | (b ? kTagTrue : kTagFalse));
+  }
+  static Value number(double d) { return fromBits(std::bit_cast<uint64_t>(d)); }
+  static Value object(Obj *obj) {
+    return fromBits(kSignBit | kQuietNan | reinterpret_cast<uintptr_t>(obj));
+  }
+  // Never the value of a Lox expression: marks a global variable's slot
+  // before the variable is defined.
+  static constexpr Value undefined() {
+    return fromBits(kQuietNan | kTagUndefined);
+  }
+
+  bool isNumber() const { return (bits_ & kQuietNan) != kQuietNan; }
+  bool isNil() const { return bits_ == (kQuietNan | kTagNil); }
+  bool isBool() const { return (bits_ | 1) == (kQuietNan | kTagTrue); }
+  bool isUndefined() const { return bits_ == (kQuietNan | kTagUndefined); }
+  bool isObject() const {
+    return (bits_ & (kQuietNan | kSignBit)) == (kQuietNan | kSignBit);
+  }
+
+  double asNumber() const { return std::bit_cast<double>(bits_); }
+  bool asBool() const { return bits_ == (kQuietNan | kTagTrue); }
+  Obj *asObject() const {
+    return reinterpret_cast<Obj *>(
+        static_cast<uintptr_t>(bits_ & ~(kSignBit | kQuietNan)));
+  }
+
+  // nil and false are falsey; everything else is truthy.
+  bool isFalsey() const {
+    return bits_ == (kQuietNan | kTagNil) || bits_ == (kQuietNan | kTagFalse);
+  }
+
+  uint64_t bits() const { return bits_; }
+  static constexpr Value fromBits(uint64_t bits) {
+    Value value;
+    value.bits_ = bits;
+    return value;
+  }
+
+private:
+  static constexpr uint64_t kSignBit = 0x8000000000000000;
+  static constexpr uint64_t kQuietNan = 0x7ffc000000000000;
+  static constexpr uint64_t kTagNil = 1;
+  static constexpr uint64_t kTagFalse = 2;
+  static constexpr uint64_t kTagTrue = 3;
+  static constexpr uint64_t kTagUndefined = 4;
+
+  uint64_t bits_;
+};
+
+static_assert(sizeof(Value) == 8);
+static_assert(std::is_trivially_copyable_v<Value>);
+
+// Lox equality: numbers compare as doubles (so NaN != NaN), everything else
+// by identity (strings are interned, so that covers equal contents).
+bool valuesEqual(Value a, Value b);
+
+// Formats a number the way Lox prints values: as formatDoubleForLoxLiteral
+// does, but without the ".0" on integral values ("3", "2.5"), and with
+// "NaN"/"Infinity"/"-Infinity" for the non-finite values.
+std::string_view formatNumber(double value, Scanner::NumberTextBuffer &buffer);
+
+// Appends the printed form of the value to out.
+void writeValue(Value value, std::string &out);
+
+#endif // VALUE_H
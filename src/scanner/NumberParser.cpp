@@ -0,0 +1,246 @@
+#include "NumberParser.h"
+
+#include <array>
+#include <bit>      // For std::countl_zero, std::endian, std::byteswap
+#include <charconv> // For std::from_chars (exact fallback)
+#include <cstdint>
+#include <cstring> // For std::memcpy
+
+namespace {
+
+// --- SWAR digit parsing ---
+
+uint64_t loadEightBytes(const char *chars) {
+  uint64_t bytes;
+  std::memcpy(&bytes, chars, sizeof(bytes));
+  if constexpr (std::endian::native == std::endian::big) {
+    bytes = std::byteswap(bytes);
+  }
+  return bytes;
+}
+
+// True if all eight bytes are ASCII digits.
+bool isEightDigits(uint64_t bytes) {
+  return ((bytes & 0xF0F0F0F0F0F0F0F0) |
+          (((bytes + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+         0x3333333333333333;
+}
+
+// Value of eight ASCII digits, first digit in the lowest byte.
+uint32_t parseEightDigits(uint64_t bytes) {
+  constexpr uint64_t kMask = 0x000000FF000000FF;
+  constexpr uint64_t kMul1 = 0x000F424000000064; // 100 + (1000000 << 32)
+  constexpr uint64_t kMul2 = 0x0000271000000001; // 1 + (10000 << 32)
+  bytes -= 0x3030303030303030;
+  bytes = (bytes * 10) + (bytes >> 8); // Pairs of digits
+  bytes = (((bytes & kMask) * kMul1) + (((bytes >> 16) & kMask) * kMul2)) >> 32;
+  return static_cast<uint32_t>(bytes);
+}
+
+// Accumulates a run of digits into mantissa (wrapping on overflow; callers
+// reject literals with more than 19 significant digits). Returns the end of
+// the run.
+const char *consumeDigits(const char *p, const char *end, uint64_t &mantissa) {
+  while (end - p >= 8) {
+    uint64_t bytes = loadEightBytes(p);
+    if (!isEightDigits(bytes)) {
+      break;
+    }
+    mantissa = mantissa * 100000000 + parseEightDigits(bytes);
+    p += 8;
+  }
+  while (p != end && static_cast<unsigned char>(*p - '0') <= 9) {
+    mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+    ++p;
+  }
+  return p;
+}
+
+// --- Eisel-Lemire ---
+
+// Lox literals have no exponent, so the decimal exponent is never positive:
+// it is minus the number of fraction digits.
+constexpr int kSmallestPower = -342; // Below this every literal rounds to 0
+constexpr int kMaxFastDigits = 19;   // Digits that always fit in a uint64_t
+
+struct Power128 {
+  uint64_t high;
+  uint64_t low;
+};
+
+// The top 128 bits of 5^-k for k in [0, 342], truncated, normalized so the
+// most significant bit is set. Computed once from floor(2^1023 / 5^k), which
+// repeated exact division by 5 yields without any rounding error.
+const std::array<Power128, -kSmallestPower + 1> &negativePowersOfFive() {
+  static const auto table = [] {
+    std::array<Power128, -kSmallestPower + 1> powers{};
+    constexpr size_t kWords = 16;
+    std::array<uint64_t, kWords> value{}; // Little-endian words
+    value[kWords - 1] = uint64_t{1} << 63;
+
+    auto bits64 = [&value](size_t low_bit) {
+      size_t word = low_bit / 64;
+      unsigned offset = low_bit % 64;
+      uint64_t bits = value[word] >> offset;
+      if (offset != 0 && word + 1 < kWords) {
+        bits |= value[word + 1] << (64 - offset);
+      }
+      return bits;
+    };
+
+    for (size_t k = 0; k < powers.size(); ++k) {
+      if (k != 0) {
+        unsigned __int128 remainder = 0;
+        for (size_t i = kWords; i-- > 0;) {
+          unsigned __int128 current = (remainder << 64) | value[i];
+          value[i] = static_cast<uint64_t>(current / 5);
+          remainder = current % 5;
+        }
+      }
+      size_t top_word = kWords - 1;
+      while (value[top_word] == 0) {
+        --top_word;
+      }
+      size_t top_bit = top_word * 64 + 63 - std::countl_zero(value[top_word]);
+      powers[k] = Power128{bits64(top_bit - 63), bits64(top_bit - 127)};
+    }
+    return powers;
+  }();
+  return table;
+}
+
+struct Product128 {
+  uint64_t high;
+  uint64_t low;
+};
+
+Product128 multiply(uint64_t a, uint64_t b) {
+  unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+  return {static_cast<uint64_t>(product >> 64), static_cast<uint64_t>(product)};
+}
+
+// Computes mantissa * 10^power for power <= 0. Returns false when the
+// truncated 128-bit power of five cannot decide the rounding (or the result
+// is subnormal), in which case the caller must use an exact method.
+bool eiselLemire(uint64_t mantissa, int power, double &value) {
+  const Power128 &factor = negativePowersOfFive()[-power];
+
+  // 217706 / 2^16 approximates log2(10); the sum is the biased exponent of
+  // 10^power plus the 63 bits of the normalized mantissa.
+  int64_t exponent = ((int64_t{217706} * power) >> 16) + 1024 + 63;
+  int leading_zeros = std::countl_zero(mantissa);
+  mantissa <<= leading_zeros;
+
+  Product128 product = multiply(mantissa, factor.high);
+  uint64_t lower = product.low;
+  uint64_t upper = product.high;
+  // The table is truncated, so the true product may exceed ours by up to
+  // `mantissa` units in the low word. Only when that could carry into the
+  // bits we keep do we need the second half of the power.
+  if ((upper & 0x1FF) == 0x1FF && lower + mantissa < lower) {
+    Product128 refined = multiply(mantissa, factor.low);
+    uint64_t middle = lower + refined.high;
+    if (middle < lower) {
+      ++upper;
+    }
+    if (middle + 1 == 0 && (upper & 0x1FF) == 0x1FF &&
+        refined.low + mantissa < refined.low) {
+      return false;
+    }
+    lower = middle;
+  }
+
+  int upper_bit = static_cast<int>(upper >> 63);
+  uint64_t bits = upper >> (upper_bit + 9); // 54 bits: 53 + a rounding bit
+  leading_zeros += 1 ^ upper_bit;
+  int64_t real_exponent = exponent - leading_zeros;
+  if (real_exponent <= 0 || real_exponent >= 2047) {
+    return false; // Subnormal or infinite: leave it to the exact path
+  }
+  // A product exactly halfway between two doubles needs round-to-even, which
+  // the truncated product cannot confirm.
+  if (lower == 0 && (upper & 0x1FF) == 0 && (bits & 3) == 1) {
+    return false;
+  }
+
+  bits += bits & 1; // Round half up; true ties were excluded above
+  bits >>= 1;
+  if (bits >= (uint64_t{1} << 53)) {
+    bits = uint64_t{1} << 52;
+    ++real_exponent;
+  }
+  bits &= ~(uint64_t{1} << 52);
+  if (real_exponent > 2046) {
+    return false;
+  }
+  value = std::bit_cast<double>(bits | (static_cast<uint64_t>(real_exponent)
+                                        << 52));
+  return true;
+}
+
+constexpr std::array<double, 23> kExactPowersOfTen = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+std::errc parseExactly(std::string_view text, double &value) {
+  auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec == std::errc{} && ptr != text.data() + text.size()) {
+    return std::errc::invalid_argument;
+  }
+  return ec;
+}
+
+} // namespace
+
+std::errc parseNumberLiteral(std::string_view text, double &value) {
+  const char *p = text.data();
+  const char *end = p + text.size();
+
+  uint64_t mantissa = 0;
+  const char *integer_end = consumeDigits(p, end, mantissa);
+  if (integer_end == p) {
+    return std::errc::invalid_argument;
+  }
+  size_t digit_count = integer_end - p;
+  int power = 0;
+  p = integer_end;
+  if (p != end && *p == '.') {
+    const char *fraction_end = consumeDigits(p + 1, end, mantissa);
+    size_t fraction_digits = fraction_end - (p + 1);
+    if (fraction_digits == 0) {
+      return std::errc::invalid_argument;
+    }
+    digit_count += fraction_digits;
+    power = -static_cast<int>(fraction_digits);
+    p = fraction_end;
+  }
+  if (p != end) {
+    return std::errc::invalid_argument;
+  }
+
+  if (digit_count > kMaxFastDigits) {
+    // Leading zeros are not significant ("0.000...01").
+    for (const char *c = text.data(); c != end && (*c == '0' || *c == '.');
+         ++c) {
+      digit_count -= (*c == '0');
+    }
+    if (digit_count > kMaxFastDigits) {
+      return parseExactly(text, value);
+    }
+  }
+
+  if (mantissa == 0) {
+    value = 0.0;
+    return std::errc{};
+  }
+  // Clinger: both operands are exact doubles, so one division rounds
+  // correctly.
+  if (power >= -22 && mantissa <= (uint64_t{1} << 53)) {
+    value = static_cast<double>(mantissa) / kExactPowersOfTen[-power];
+    return std::errc{};
+  }
+  if (power >= kSmallestPower && eiselLemire(mantissa, power, value)) {
+    return std::errc{};
+  }
+  return parseExactly(text, value);
+}
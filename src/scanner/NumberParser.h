@@ -0,0 +1,18 @@
+#ifndef NUMBER_PARSER_H
+#define NUMBER_PARSER_H
+
+#include <string_view>
+#include <system_error> // For std::errc
+
+// Converts a Lox number literal (digits with an optional ".digits" fraction)
+// to the nearest double. Returns std::errc{} on success, in the manner of
+// std::from_chars, and std::errc::result_out_of_range if the literal
+// overflows or underflows a double.
+//
+// Digits are consumed eight at a time with SWAR arithmetic, and literals with
+// at most 19 significant digits are converted with Clinger's fast path or the
+// Eisel-Lemire algorithm. Anything those cannot decide exactly falls back to
+// std::from_chars, so results are always correctly rounded.
+std::errc parseNumberLiteral(std::string_view text, double &value);
+
+#endif // NUMBER_PARSER_H
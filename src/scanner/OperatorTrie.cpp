@@ -8,7 +8,7 @@ bool TrieNode::isEndOfToken() const { return token_type.has_value(); }
 // OperatorTrie method implementations
 OperatorTrie::OperatorTrie() : root(std::make_unique<TrieNode>()) {}
 
-void OperatorTrie::insert(std::string_view lexeme, std::string_view tokenType) {
+void OperatorTrie::insert(std::string_view lexeme, TokenType tokenType) {
   TrieNode *current_node = root.get();
   for (char ch : lexeme) {
     if (current_node->children.find(ch) == current_node->children.end()) {
@@ -19,11 +19,11 @@ void OperatorTrie::insert(std::string_view lexeme, std::string_view tokenType) {
   current_node->token_type = tokenType;
 }
 
-std::pair<size_t, std::optional<std::string_view>>
+std::pair<size_t, std::optional<TokenType>>
 OperatorTrie::searchLongestMatch(std::string_view text_view) const {
   TrieNode *current_node = root.get();
   size_t longest_match_length = 0;
-  std::optional<std::string_view> type_of_longest_match;
+  std::optional<TokenType> type_of_longest_match;
 
   for (size_t i = 0; i < text_view.length(); ++i) {
     char ch = text_view[i];
@@ -7,10 +7,12 @@
 #include <unordered_map>
 #include <utility> // For std::pair
 
+#include "Token.h"
+
 // TrieNode structure
 struct TrieNode {
   std::unordered_map<char, std::unique_ptr<TrieNode>> children;
-  std::optional<std::string_view> token_type;
+  std::optional<TokenType> token_type;
 
   TrieNode();                // Constructor declaration
   bool isEndOfToken() const; // Method declaration
@@ -22,9 +24,9 @@ public:
   OperatorTrie(); // Constructor declaration
 
   void insert(std::string_view lexeme,
-              std::string_view tokenType); // Method declaration
+              TokenType tokenType); // Method declaration
 
-  std::pair<size_t, std::optional<std::string_view>>
+  std::pair<size_t, std::optional<TokenType>>
   searchLongestMatch(std::string_view text_view) const; // Method declaration
 
 private:
@@ -3,14 +3,25 @@
 
 #include <cctype> // For std::isspace, std::isdigit, std::isalpha, std::isalnum
 #include <functional> // For std::function
+#include <string>
 #include <string_view>
 #include <unordered_map> // For keywords map in ScanContext
+#include <utility>       // For std::move
 #include <vector> // For std::vector (though MatcherFunction is std::function)
 
+#include "Token.h"
+
 // Forward declaration of OperatorTrie to avoid circular include if OperatorTrie
 // needed ScanContext
 class OperatorTrie;
 
+// A scan error, kept until the token listing is printed so that errors found
+// while materializing literals can be reported in source order.
+struct ScanDiagnostic {
+  int line;
+  std::string message;
+};
+
 // Scanning Context structure
 struct ScanContext {
   const std::string_view &source_view;
@@ -18,19 +29,25 @@ struct ScanContext {
   int &current_line;
   bool &in_error_flag;
   const OperatorTrie &op_trie; // Changed to reference
-  const std::unordered_map<std::string_view, std::string_view>
+  const std::unordered_map<std::string_view, TokenType>
       &keywords; // Changed to reference
+  std::vector<Token> &tokens;
+  std::vector<ScanDiagnostic> &diagnostics;
 
   // Constructor
-  ScanContext(
-      const std::string_view &src_view, size_t &pos, int &line, bool &err_flag,
-      const OperatorTrie &operator_trie,
-      const std::unordered_map<std::string_view, std::string_view> &kws);
+  ScanContext(const std::string_view &src_view, size_t &pos, int &line,
+              bool &err_flag, const OperatorTrie &operator_trie,
+              const std::unordered_map<std::string_view, TokenType> &kws,
+              std::vector<Token> &token_buffer,
+              std::vector<ScanDiagnostic> &diags);
 
   // Helper methods
   std::string_view remaining() const;
   bool isAtEnd() const;
   char currentChar() const;
+  // Records a token spanning [start_pos, current_pos).
+  void addToken(TokenType type, size_t start_pos);
+  void reportError(int line, std::string message);
 };
 
 // Type alias for matcher functions
@@ -50,9 +67,11 @@ inline bool isIdentifierPartChar(char c) {
 inline ScanContext::ScanContext(
     const std::string_view &src_view, size_t &pos, int &line, bool &err_flag,
     const OperatorTrie &operator_trie,
-    const std::unordered_map<std::string_view, std::string_view> &kws)
+    const std::unordered_map<std::string_view, TokenType> &kws,
+    std::vector<Token> &token_buffer, std::vector<ScanDiagnostic> &diags)
     : source_view(src_view), current_pos(pos), current_line(line),
-      in_error_flag(err_flag), op_trie(operator_trie), keywords(kws) {}
+      in_error_flag(err_flag), op_trie(operator_trie), keywords(kws),
+      tokens(token_buffer), diagnostics(diags) {}
 
 inline std::string_view ScanContext::remaining() const {
   if (current_pos >= source_view.length()) {
@@ -70,4 +89,15 @@ inline char ScanContext::currentChar() const {
   return source_view[current_pos];
 }
 
+inline void ScanContext::addToken(TokenType type, size_t start_pos) {
+  tokens.push_back(Token{type, static_cast<uint32_t>(start_pos),
+                         static_cast<uint32_t>(current_pos - start_pos),
+                         current_line});
+}
+
+inline void ScanContext::reportError(int line, std::string message) {
+  diagnostics.push_back(ScanDiagnostic{line, std::move(message)});
+  in_error_flag = true;
+}
+
 #endif // SCAN_CONTEXT_H
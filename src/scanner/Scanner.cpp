@@ -1,10 +1,14 @@
 #include "Scanner.h"
 
 #include <algorithm> // For std::ranges::find_if, std::ranges::distance
-#include <cmath>     // For std::modf
+#include <charconv>  // For std::to_chars
+#include <cmath>     // For std::trunc, std::isnan, std::isinf, std::isfinite
 #include <format>    // C++20/23 for std::format
+#include <iterator>  // For std::back_inserter
+#include <limits>    // For std::numeric_limits
 #include <print>     // C++23 for std::print, std::println
-#include <stdexcept> // For std::out_of_range, std::invalid_argument
+
+#include "NumberParser.h"
 
 // Assuming isIdentifierStartChar and isIdentifierPartChar are accessible from
 // ScanContext.h If they are in an anonymous namespace there, this might require
@@ -16,32 +20,35 @@ Scanner::Scanner(std::string_view source_code)
       in_error_flag_(false) {
 
   // Operator trie and keywords map initialization remains the same
-  operator_trie_.insert("==", "EQUAL_EQUAL");
-  operator_trie_.insert("!=", "BANG_EQUAL");
-  operator_trie_.insert("<=", "LESS_EQUAL");
-  operator_trie_.insert(">=", "GREATER_EQUAL");
-  operator_trie_.insert("(", "LEFT_PAREN");
-  operator_trie_.insert(")", "RIGHT_PAREN");
-  operator_trie_.insert("{", "LEFT_BRACE");
-  operator_trie_.insert("}", "RIGHT_BRACE");
-  operator_trie_.insert(",", "COMMA");
-  operator_trie_.insert(".", "DOT");
-  operator_trie_.insert("-", "MINUS");
-  operator_trie_.insert("+", "PLUS");
-  operator_trie_.insert(";", "SEMICOLON");
-  operator_trie_.insert("*", "STAR");
-  operator_trie_.insert("=", "EQUAL");
-  operator_trie_.insert("!", "BANG");
-  operator_trie_.insert("<", "LESS");
-  operator_trie_.insert(">", "GREATER");
-  operator_trie_.insert("/", "SLASH");
-
-  keywords_map_ = {{"and", "AND"},     {"class", "CLASS"},   {"else", "ELSE"},
-                   {"false", "FALSE"}, {"for", "FOR"},       {"fun", "FUN"},
-                   {"if", "IF"},       {"nil", "NIL"},       {"or", "OR"},
-                   {"print", "PRINT"}, {"return", "RETURN"}, {"super", "SUPER"},
-                   {"this", "THIS"},   {"true", "TRUE"},     {"var", "VAR"},
-                   {"while", "WHILE"}};
+  operator_trie_.insert("==", TokenType::EQUAL_EQUAL);
+  operator_trie_.insert("!=", TokenType::BANG_EQUAL);
+  operator_trie_.insert("<=", TokenType::LESS_EQUAL);
+  operator_trie_.insert(">=", TokenType::GREATER_EQUAL);
+  operator_trie_.insert("(", TokenType::LEFT_PAREN);
+  operator_trie_.insert(")", TokenType::RIGHT_PAREN);
+  operator_trie_.insert("{", TokenType::LEFT_BRACE);
+  operator_trie_.insert("}", TokenType::RIGHT_BRACE);
+  operator_trie_.insert(",", TokenType::COMMA);
+  operator_trie_.insert(".", TokenType::DOT);
+  operator_trie_.insert("-", TokenType::MINUS);
+  operator_trie_.insert("+", TokenType::PLUS);
+  operator_trie_.insert(";", TokenType::SEMICOLON);
+  operator_trie_.insert("*", TokenType::STAR);
+  operator_trie_.insert("=", TokenType::EQUAL);
+  operator_trie_.insert("!", TokenType::BANG);
+  operator_trie_.insert("<", TokenType::LESS);
+  operator_trie_.insert(">", TokenType::GREATER);
+  operator_trie_.insert("/", TokenType::SLASH);
+
+  keywords_map_ = {
+      {"and", TokenType::AND},       {"class", TokenType::CLASS},
+      {"else", TokenType::ELSE},     {"false", TokenType::FALSE},
+      {"for", TokenType::FOR},       {"fun", TokenType::FUN},
+      {"if", TokenType::IF},         {"nil", TokenType::NIL},
+      {"or", TokenType::OR},         {"print", TokenType::PRINT},
+      {"return", TokenType::RETURN}, {"super", TokenType::SUPER},
+      {"this", TokenType::THIS},     {"true", TokenType::TRUE},
+      {"var", TokenType::VAR},       {"while", TokenType::WHILE}};
 
   matchers_ = {
       [this](ScanContext &ctx) { return this->scanNewline(ctx); },
@@ -53,9 +60,12 @@ Scanner::Scanner(std::string_view source_code)
       [this](ScanContext &ctx) { return this->scanOperator(ctx); }};
 }
 
-bool Scanner::scanAndPrintTokens() {
+const std::vector<Token> &Scanner::scanTokens() {
+  if (!tokens_.empty()) {
+    return tokens_; // Already scanned
+  }
   ScanContext ctx(source_view_, current_pos_, current_line_, in_error_flag_,
-                  operator_trie_, keywords_map_);
+                  operator_trie_, keywords_map_, tokens_, diagnostics_);
 
   while (!ctx.isAtEnd()) { // Loop while not at the end of the source
     bool matched_in_iteration = false;
@@ -73,9 +83,8 @@ bool Scanner::scanAndPrintTokens() {
       // This check is important because a matcher might have consumed all
       // remaining input.
       if (!ctx.isAtEnd()) {
-        std::println(stderr, "[line {}] Error: Unexpected character: {}",
-                     ctx.current_line, ctx.currentChar());
-        ctx.in_error_flag = true;
+        ctx.reportError(ctx.current_line, std::format("Unexpected character: {}",
+                                                      ctx.currentChar()));
         ctx.current_pos++; // Advance past the unexpected character
       } else {
         // All input consumed, possibly by the last successful matcher, or we
@@ -86,7 +95,117 @@ bool Scanner::scanAndPrintTokens() {
     // If a matcher succeeded and consumed all input, ctx.isAtEnd() will handle
     // the loop exit.
   }
-  return ctx.in_error_flag;
+  ctx.addToken(TokenType::END_OF_FILE, ctx.current_pos);
+  return tokens_;
+}
+
+bool Scanner::scanAndPrintTokens() {
+  std::string out;
+  std::string err;
+  bool had_error = writeTokenListing(out, err);
+  std::print(stderr, "{}", err);
+  std::print("{}", out);
+  return had_error;
+}
+
+bool Scanner::writeTokenListing(std::string &out, std::string &err) {
+  scanTokens();
+
+  // Literal conversion is only needed for the listing, so it happens here
+  // rather than in scanNumberLiteral.
+  materializeNumbers();
+  writeDiagnostics(err);
+
+  auto out_it = std::back_inserter(out);
+  NumberTextBuffer number_text;
+  for (size_t i = 0; i < tokens_.size(); ++i) {
+    const Token &token = tokens_[i];
+    switch (token.type) {
+    case TokenType::STRING:
+      std::format_to(out_it, "STRING {} {}\n", lexeme(token),
+                     stringValue(token));
+      break;
+    case TokenType::NUMBER:
+      if (auto value = numberValue(i)) {
+        std::format_to(out_it, "NUMBER {} {}\n", lexeme(token),
+                       formatDoubleForLoxLiteral(*value, number_text));
+      }
+      break;
+    default:
+      std::format_to(out_it, "{} {} null\n", tokenTypeName(token.type),
+                     lexeme(token));
+      break;
+    }
+  }
+  return in_error_flag_;
+}
+
+void Scanner::writeDiagnostics(std::string &err) {
+  // Conversion errors are found after the scan; keep the report in line order.
+  std::ranges::stable_sort(diagnostics_, {}, &ScanDiagnostic::line);
+  auto err_it = std::back_inserter(err);
+  for (const ScanDiagnostic &diagnostic : diagnostics_) {
+    std::format_to(err_it, "[line {}] Error: {}\n", diagnostic.line,
+                   diagnostic.message);
+  }
+}
+
+std::string_view Scanner::lexeme(const Token &token) const {
+  return source_view_.substr(token.start, token.length);
+}
+
+std::string_view Scanner::stringValue(const Token &token) const {
+  return source_view_.substr(token.start + 1, token.length - 2);
+}
+
+std::optional<double> Scanner::numberValue(size_t token_index) {
+  if (number_values_.empty()) {
+    number_values_.assign(tokens_.size(),
+                          std::numeric_limits<double>::quiet_NaN());
+  }
+  double &cached = number_values_[token_index];
+  if (std::isnan(cached)) {
+    convertNumber(token_index, cached);
+  }
+  if (std::isinf(cached)) {
+    return std::nullopt;
+  }
+  return cached;
+}
+
+const std::vector<double> &Scanner::materializeNumbers() {
+  if (numbers_materialized_) {
+    return number_values_;
+  }
+  if (number_values_.empty()) {
+    number_values_.assign(tokens_.size(),
+                          std::numeric_limits<double>::quiet_NaN());
+  }
+  // One tight pass over the token buffer; the conversions are independent, so
+  // the SWAR digit loads of consecutive literals overlap in the pipeline.
+  const Token *tokens = tokens_.data();
+  double *values = number_values_.data();
+  for (size_t i = 0, count = tokens_.size(); i < count; ++i) {
+    if (tokens[i].type == TokenType::NUMBER && std::isnan(values[i])) {
+      convertNumber(i, values[i]);
+    }
+  }
+  numbers_materialized_ = true;
+  return number_values_;
+}
+
+void Scanner::convertNumber(size_t token_index, double &value) {
+  const Token &token = tokens_[token_index];
+  std::string_view text = lexeme(token);
+  std::errc ec = parseNumberLiteral(text, value);
+  if (ec != std::errc{}) {
+    diagnostics_.push_back(ScanDiagnostic{
+        token.line, ec == std::errc::result_out_of_range
+                        ? std::format("Number literal out of range: {}", text)
+                        : std::format("Invalid number format: {}", text)});
+    in_error_flag_ = true;
+    value = std::numeric_limits<double>::infinity();
+  }
 }
 
 bool Scanner::scanNewline(ScanContext &ctx) {
@@ -151,7 +270,8 @@ bool Scanner::scanStringLiteral(ScanContext &ctx) {
   int string_start_line = ctx.current_line;
   ctx.current_pos++; // Consume the opening quote
 
-  std::string literal_value;
+  // The literal value is the lexeme minus its quotes, so only the extent (and
+  // any newlines inside it) needs to be found here.
   bool string_terminated = false;
 
   std::string_view remaining_after_quote = ctx.remaining();
@@ -167,7 +287,6 @@ bool Scanner::scanStringLiteral(ScanContext &ctx) {
     if (next_quote_pos == std::string_view::npos &&
         next_newline_pos == std::string_view::npos) {
       // Neither quote nor newline found, consume rest of the view
-      literal_value += remaining_after_quote.substr(current_search_offset);
       ctx.current_pos +=
           (remaining_after_quote.length() - current_search_offset);
       current_search_offset =
@@ -182,8 +301,6 @@ bool Scanner::scanStringLiteral(ScanContext &ctx) {
 
     if (quote_found_first) {
       // Closing quote found
-      literal_value += remaining_after_quote.substr(
-          current_search_offset, next_quote_pos - current_search_offset);
       ctx.current_pos += (next_quote_pos - current_search_offset +
                           1); // +1 for the quote itself
       string_terminated = true;
@@ -192,9 +309,6 @@ bool Scanner::scanStringLiteral(ScanContext &ctx) {
       // Newline found (either before a quote or quote not found at all)
       // next_newline_pos must be valid here if quote_found_first is false and
       // loop continues
-      literal_value += remaining_after_quote.substr(
-          current_search_offset, next_newline_pos - current_search_offset +
-                                     1); // include newline in literal
       ctx.current_pos += (next_newline_pos - current_search_offset + 1);
       ctx.current_line++;
       current_search_offset =
@@ -203,25 +317,27 @@ bool Scanner::scanStringLiteral(ScanContext &ctx) {
   }
 
   if (string_terminated) {
-    std::string_view lexeme = ctx.source_view.substr(
-        string_start_original_pos_in_source,
-        ctx.current_pos - string_start_original_pos_in_source);
-    std::println("STRING {} {}", lexeme, literal_value);
+    ctx.addToken(TokenType::STRING, string_start_original_pos_in_source);
   } else {
-    std::println(stderr, "[line {}] Error: Unterminated string.",
-                 string_start_line);
-    ctx.in_error_flag = true;
+    ctx.reportError(string_start_line, "Unterminated string.");
   }
   return true; // Processed a string opening (or attempt)
 }
 
-std::string Scanner::formatDoubleForLoxLiteral(double val) {
-  double integer_part;
-  if (std::modf(val, &integer_part) == 0.0) {
-    return std::format("{:.1f}", val);
-  } else {
-    return std::format("{:.15g}", val);
+std::string_view Scanner::formatDoubleForLoxLiteral(double val,
+                                                    NumberTextBuffer &buffer) {
+  char *first = buffer.data();
+  char *last = first + buffer.size();
+  // std::to_chars without a precision produces the shortest round-trip
+  // digits (Ryu-based in libstdc++ and libc++) without allocating.
+  if (std::isfinite(val) && std::trunc(val) == val) {
+    char *end = std::to_chars(first, last - 2, val, std::chars_format::fixed).ptr;
+    *end++ = '.';
+    *end++ = '0';
+    return {first, end};
   }
+  char *end = std::to_chars(first, last, val).ptr;
+  return {first, end};
 }
 
 bool Scanner::scanNumberLiteral(ScanContext &ctx) {
@@ -255,38 +371,9 @@ bool Scanner::scanNumberLiteral(ScanContext &ctx) {
     ctx.current_pos += std::ranges::distance(view_frac.begin(), frac_end_it);
   }
 
-  std::string_view lexeme = ctx.source_view.substr(
-      start_pos_in_source, ctx.current_pos - start_pos_in_source);
-
-  if (lexeme.empty() ||
-      (lexeme.length() == 1 &&
-       lexeme[0] == '.')) { // Should not happen if initial check is digit
-    // This case indicates something went wrong, or initial char wasn't a digit.
-    // Revert if no actual number was consumed (e.g. just a '.')
-    // However, the logic ensures we start with a digit.
-    // If lexeme is just ".", it means it was not followed by a digit.
-    // The check for `ctx.source_view[ctx.current_pos + 1]` handles this.
-    // So, lexeme should be a valid number structure at this point.
-  }
-
-  double literal_double_val;
-  try {
-    literal_double_val = std::stod(std::string(lexeme));
-  } catch (const std::out_of_range &) {
-    std::println(stderr, "[line {}] Error: Number literal out of range: {}",
-                 ctx.current_line, lexeme);
-    ctx.in_error_flag = true;
-    return true;
-  } catch (const std::invalid_argument &) {
-    std::println(stderr,
-                 "[line {}] Error: Invalid number format (stod failed): {}",
-                 ctx.current_line, lexeme);
-    ctx.in_error_flag = true;
-    return true;
-  }
-  std::string literal_str_output =
-      formatDoubleForLoxLiteral(literal_double_val);
-  std::println("NUMBER {} {}", lexeme, literal_str_output);
+  // Only the span is recorded; the value is converted by numberValue() when
+  // (and if) a consumer asks for it.
+  ctx.addToken(TokenType::NUMBER, start_pos_in_source);
   return true;
 }
 
@@ -309,14 +396,12 @@ bool Scanner::scanIdentifierOrKeyword(ScanContext &ctx) {
   std::string_view lexeme = ctx.source_view.substr(
       start_pos_in_source, ctx.current_pos - start_pos_in_source);
 
-  std::string_view token_type_str;
+  TokenType token_type = TokenType::IDENTIFIER;
   if (auto it = ctx.keywords.find(lexeme); it != ctx.keywords.end()) {
-    token_type_str = it->second;
-  } else {
-    token_type_str = "IDENTIFIER";
+    token_type = it->second;
   }
 
-  std::println("{} {} null", token_type_str, lexeme);
+  ctx.addToken(token_type, start_pos_in_source);
   return true;
 }
 
@@ -328,12 +413,12 @@ bool Scanner::scanOperator(ScanContext &ctx) {
   // This part is already quite optimized for its specific task.
   auto match_result = ctx.op_trie.searchLongestMatch(ctx.remaining());
   size_t matched_length = match_result.first;
-  std::optional<std::string_view> matched_type_opt = match_result.second;
+  std::optional<TokenType> matched_type_opt = match_result.second;
 
   if (matched_length > 0 && matched_type_opt) {
-    std::string_view lexeme = ctx.remaining().substr(0, matched_length);
-    std::println("{} {} null", *matched_type_opt, lexeme);
+    size_t start_pos_in_source = ctx.current_pos;
     ctx.current_pos += matched_length;
+    ctx.addToken(*matched_type_opt, start_pos_in_source);
     return true;
   }
   return false;
@@ -1,6 +1,8 @@
 #ifndef SCANNER_H
 #define SCANNER_H
 
+#include <array>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -8,12 +10,56 @@
 
 #include "OperatorTrie.h"
 #include "ScanContext.h" // Includes MatcherFunction type alias
+#include "Token.h"
 
 class Scanner {
 public:
+  // Fits any double in the literal format, including the 309 integer digits
+  // of DBL_MAX printed in fixed notation.
+  using NumberTextBuffer = std::array<char, 320>;
+
   Scanner(std::string_view source_code);
 
+  // Scans the whole source into the token buffer, terminated by an
+  // END_OF_FILE token. Tokens only carry their span: NUMBER values are parsed
+  // on first access through numberValue(), and nothing is formatted until the
+  // listing is printed, so boundary-only consumers pay for neither.
+  const std::vector<Token> &scanTokens();
+
+  // Scans and prints the token listing (including the trailing EOF line).
+  // Returns true if any scan error was reported.
   bool scanAndPrintTokens();
+  // Appends the token listing to out and the scan errors to err instead of
+  // printing them. Returns true if any scan error was reported.
+  bool writeTokenListing(std::string &out, std::string &err);
+
+  // Appends "[line N] Error: ..." for every scan error recorded so far, in
+  // line order.
+  void writeDiagnostics(std::string &err);
+
+  const std::vector<Token> &tokens() const { return tokens_; }
+  const std::vector<ScanDiagnostic> &diagnostics() const {
+    return diagnostics_;
+  }
+  bool hadError() const { return in_error_flag_; }
+
+  std::string_view lexeme(const Token &token) const;
+  // The literal value of a STRING token: its lexeme without the quotes.
+  std::string_view stringValue(const Token &token) const;
+  // The literal value of the NUMBER token at token_index, converted on first
+  // access and cached. Returns std::nullopt (and records a diagnostic the
+  // first time) if the literal is out of range for a double.
+  std::optional<double> numberValue(size_t token_index);
+  // Converts every NUMBER token in one batch pass and returns the value array,
+  // which is parallel to tokens(): entry i holds the value of token i if it is
+  // a NUMBER (infinity if it failed to convert) and NaN otherwise.
+  const std::vector<double> &materializeNumbers();
+
+  // Formats val the way Lox prints number literals: integral values in fixed
+  // notation with a ".0" suffix, everything else as the shortest text that
+  // round-trips. Writes into buffer and returns a view of it.
+  static std::string_view formatDoubleForLoxLiteral(double val,
+                                                    NumberTextBuffer &buffer);
 
 private:
   std::string_view source_view_;
@@ -22,17 +68,25 @@ private:
   bool in_error_flag_;
 
   OperatorTrie operator_trie_;
-  std::unordered_map<std::string_view, std::string_view> keywords_map_;
+  std::unordered_map<std::string_view, TokenType> keywords_map_;
 
   std::vector<MatcherFunction> matchers_;
 
+  std::vector<Token> tokens_;
+  std::vector<ScanDiagnostic> diagnostics_;
+  // Parallel to tokens_, allocated on first use by numberValue() or
+  // materializeNumbers(). Entries are NaN until materialized (literals can
+  // never be NaN) and infinity for literals that failed to convert.
+  std::vector<double> number_values_;
+  bool numbers_materialized_ = false;
+
   // Matcher methods
   bool scanNewline(ScanContext &ctx);
   bool scanWhitespace(ScanContext &ctx);
   bool scanComment(ScanContext &ctx);
   bool scanStringLiteral(ScanContext &ctx);
 
-  std::string formatDoubleForLoxLiteral(double val);
+  void convertNumber(size_t token_index, double &value);
 
   bool scanNumberLiteral(ScanContext &ctx);
   bool scanIdentifierOrKeyword(ScanContext &ctx);
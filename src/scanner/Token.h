@@ -0,0 +1,89 @@
+#ifndef TOKEN_H
+#define TOKEN_H
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// Token kinds, named after the token names printed by `tokenize`.
+enum class TokenType : uint8_t {
+  // Single-character tokens
+  LEFT_PAREN,
+  RIGHT_PAREN,
+  LEFT_BRACE,
+  RIGHT_BRACE,
+  COMMA,
+  DOT,
+  MINUS,
+  PLUS,
+  SEMICOLON,
+  SLASH,
+  STAR,
+
+  // One or two character tokens
+  BANG,
+  BANG_EQUAL,
+  EQUAL,
+  EQUAL_EQUAL,
+  GREATER,
+  GREATER_EQUAL,
+  LESS,
+  LESS_EQUAL,
+
+  // Literals
+  IDENTIFIER,
+  STRING,
+  NUMBER,
+
+  // Keywords
+  AND,
+  CLASS,
+  ELSE,
+  FALSE,
+  FUN,
+  FOR,
+  IF,
+  NIL,
+  OR,
+  PRINT,
+  RETURN,
+  SUPER,
+  THIS,
+  TRUE,
+  VAR,
+  WHILE,
+
+  END_OF_FILE, // Printed as "EOF"; `EOF` itself is a <cstdio> macro.
+
+  COUNT
+};
+
+inline constexpr std::array<std::string_view,
+                            static_cast<size_t>(TokenType::COUNT)>
+    kTokenTypeNames = {
+        "LEFT_PAREN",    "RIGHT_PAREN", "LEFT_BRACE", "RIGHT_BRACE",
+        "COMMA",         "DOT",         "MINUS",      "PLUS",
+        "SEMICOLON",     "SLASH",       "STAR",       "BANG",
+        "BANG_EQUAL",    "EQUAL",       "EQUAL_EQUAL", "GREATER",
+        "GREATER_EQUAL", "LESS",        "LESS_EQUAL", "IDENTIFIER",
+        "STRING",        "NUMBER",      "AND",        "CLASS",
+        "ELSE",          "FALSE",       "FUN",        "FOR",
+        "IF",            "NIL",         "OR",         "PRINT",
+        "RETURN",        "SUPER",       "THIS",       "TRUE",
+        "VAR",           "WHILE",       "EOF"};
+
+inline std::string_view tokenTypeName(TokenType type) {
+  return kTokenTypeNames[static_cast<size_t>(type)];
+}
+
+// A scanned token. Tokens only record where they are in the source; the
+// lexeme and any literal value are recovered from the span on demand (see
+// Scanner::lexeme, Scanner::numberValue).
+struct Token {
+  TokenType type;
+  uint32_t start;  // Byte offset of the lexeme in the source
+  uint32_t length; // Lexeme length in bytes
+  int line;
+};
+
+#endif // TOKEN_H
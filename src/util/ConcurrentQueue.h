@@ -0,0 +1,51 @@
+#ifndef CONCURRENT_QUEUE_H
+#define CONCURRENT_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Unbounded multi-producer/multi-consumer FIFO, consumed in batches.
+// Consumers block until an item arrives or the queue is closed; once closed
+// and drained, pops fail.
+template <typename T> class ConcurrentQueue {
+public:
+  void push(T item) {
+    {
+      std::lock_guard lock(mutex_);
+      items_.push_back(std::move(item));
+    }
+    available_.notify_one();
+  }
+
+  // Moves up to max_items into out (after clearing it), blocking until at
+  // least one is available. Returns false once the queue is closed and empty.
+  bool popBatch(std::vector<T> &out, size_t max_items) {
+    out.clear();
+    std::unique_lock lock(mutex_);
+    available_.wait(lock, [this] { return closed_ || !items_.empty(); });
+    while (!items_.empty() && out.size() < max_items) {
+      out.push_back(std::move(items_.front()));
+      items_.pop_front();
+    }
+    return !out.empty();
+  }
+
+  // No more pushes will follow; wakes every waiting consumer.
+  void close() {
+    {
+      std::lock_guard lock(mutex_);
+      closed_ = true;
+    }
+    available_.notify_all();
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable available_;
+  std::deque<T> items_;
+  bool closed_ = false;
+};
+
+#endif // CONCURRENT_QUEUE_H
@@ -0,0 +1,128 @@
+#include "CpuTopology.h"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#if defined(__linux__)
+#include <sched.h>       // For sched_getaffinity, sched_setaffinity
+#include <sys/syscall.h> // For __NR_set_mempolicy
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Parses a sysfs CPU list such as "0-3,8-11".
+std::vector<int> parseCpuList(std::string_view list) {
+  std::vector<int> cpus;
+  while (!list.empty()) {
+    size_t comma = list.find(',');
+    std::string_view range = list.substr(0, comma);
+    list = comma == std::string_view::npos ? std::string_view{}
+                                           : list.substr(comma + 1);
+    int first = 0;
+    int last = 0;
+    auto [dash, ec] =
+        std::from_chars(range.data(), range.data() + range.size(), first);
+    if (ec != std::errc{}) {
+      continue;
+    }
+    last = first;
+    if (dash != range.data() + range.size() && *dash == '-') {
+      std::from_chars(dash + 1, range.data() + range.size(), last);
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+bool allowed(int cpu) {
+#if defined(__linux__)
+  static const cpu_set_t mask = [] {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (::sched_getaffinity(0, sizeof(set), &set) != 0) {
+      for (int i = 0; i < CPU_SETSIZE; ++i) {
+        CPU_SET(i, &set);
+      }
+    }
+    return set;
+  }();
+  return cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &mask);
+#else
+  (void)cpu;
+  return true;
+#endif
+}
+
+} // namespace
+
+CpuTopology CpuTopology::detect() {
+  CpuTopology topology;
+  for (int node = 0;; ++node) {
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) +
+                       "/cpulist");
+    if (!file) {
+      break;
+    }
+    std::string list;
+    std::getline(file, list);
+    std::vector<int> cpus;
+    for (int cpu : parseCpuList(list)) {
+      if (allowed(cpu)) {
+        cpus.push_back(cpu);
+      }
+    }
+    if (!cpus.empty()) {
+      topology.node_cpus.push_back(std::move(cpus));
+    }
+  }
+  if (topology.node_cpus.empty()) {
+    std::vector<int> cpus;
+    unsigned count = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned cpu = 0; cpu < count; ++cpu) {
+      if (allowed(static_cast<int>(cpu))) {
+        cpus.push_back(static_cast<int>(cpu));
+      }
+    }
+    if (cpus.empty()) {
+      cpus.push_back(0);
+    }
+    topology.node_cpus.push_back(std::move(cpus));
+  }
+  return topology;
+}
+
+unsigned CpuTopology::nodeForWorker(unsigned worker) const {
+  return worker % node_cpus.size();
+}
+
+int CpuTopology::cpuForWorker(unsigned worker) const {
+  const std::vector<int> &cpus = node_cpus[nodeForWorker(worker)];
+  return cpus[(worker / node_cpus.size()) % cpus.size()];
+}
+
+bool pinCurrentThread(int cpu) {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (::sched_setaffinity(0, sizeof(set), &set) != 0) {
+    return false;
+  }
+  // MPOL_LOCAL (4): allocate on the node of the CPU doing the allocation.
+  // Raw syscall so libnuma is not required; a kernel without it keeps the
+  // default policy, which is first-touch local anyway.
+  constexpr int kMpolLocal = 4;
+  ::syscall(__NR_set_mempolicy, kMpolLocal, nullptr, 0);
+  return true;
+#else
+  (void)cpu;
+  return false;
+#endif
+}
@@ -0,0 +1,27 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <vector>
+
+// The CPUs this process may run on, grouped by NUMA node (read from
+// /sys/devices/system/node, so no libnuma is needed). On systems without
+// that information everything is one node.
+struct CpuTopology {
+  std::vector<std::vector<int>> node_cpus; // Never empty after detect()
+
+  static CpuTopology detect();
+
+  // CPU for the i-th worker: workers are dealt round-robin across nodes, so
+  // any number of them is spread evenly over the sockets.
+  int cpuForWorker(unsigned worker) const;
+  // Node that cpuForWorker(worker) belongs to.
+  unsigned nodeForWorker(unsigned worker) const;
+};
+
+// Restricts the calling thread to one CPU and makes its future allocations
+// come from that CPU's node (MPOL_LOCAL), so buffers a pinned worker
+// allocates and first touches stay node-local. Returns false if the
+// platform refused; the thread then simply runs unpinned.
+bool pinCurrentThread(int cpu);
+
+#endif // CPU_TOPOLOGY_H
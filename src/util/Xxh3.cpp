@@ -0,0 +1,227 @@
+#include "Xxh3.h"
+
+#include <bit> // For std::rotl, std::byteswap, std::endian
+#include <cstring>
+
+namespace {
+
+constexpr uint64_t kPrime32_1 = 0x9E3779B1U;
+constexpr uint64_t kPrime32_2 = 0x85EBCA77U;
+constexpr uint64_t kPrime32_3 = 0xC2B2AE3DU;
+constexpr uint64_t kPrime64_1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime64_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime64_3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime64_4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime64_5 = 0x27D4EB2F165667C5ULL;
+constexpr uint64_t kPrimeMx1 = 0x165667919E3779F9ULL;
+constexpr uint64_t kPrimeMx2 = 0x9FB21C651E98DF25ULL;
+
+constexpr size_t kStripeLength = 64;
+constexpr size_t kSecretConsumeRate = 8;
+constexpr size_t kAccumulators = 8;
+constexpr size_t kMidsizeMax = 240;
+constexpr size_t kSecretSizeMin = 136;
+
+alignas(64) constexpr unsigned char kSecret[192] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c,
+    0xf7, 0x21, 0xad, 0x1c, 0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb,
+    0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f, 0xcb, 0x79, 0xe6, 0x4e,
+    0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6,
+    0x81, 0x3a, 0x26, 0x4c, 0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb,
+    0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3, 0x71, 0x64, 0x48, 0x97,
+    0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7,
+    0xc7, 0x0b, 0x4f, 0x1d, 0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31,
+    0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64, 0xea, 0xc5, 0xac, 0x83,
+    0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26,
+    0x29, 0xd4, 0x68, 0x9e, 0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+    0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce, 0x45, 0xcb, 0x3a, 0x8f,
+    0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+template <typename T> T readLittleEndian(const unsigned char *p) {
+  T value;
+  std::memcpy(&value, p, sizeof(value));
+  if constexpr (std::endian::native == std::endian::big) {
+    value = std::byteswap(value);
+  }
+  return value;
+}
+
+uint64_t read64(const unsigned char *p) {
+  return readLittleEndian<uint64_t>(p);
+}
+uint32_t read32(const unsigned char *p) {
+  return readLittleEndian<uint32_t>(p);
+}
+
+uint64_t mulFold64(uint64_t lhs, uint64_t rhs) {
+  unsigned __int128 product = static_cast<unsigned __int128>(lhs) * rhs;
+  return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+uint64_t xxh64Avalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= kPrime64_2;
+  h ^= h >> 29;
+  h *= kPrime64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t avalanche(uint64_t h) {
+  h ^= h >> 37;
+  h *= kPrimeMx1;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t rrmxmx(uint64_t h, uint64_t length) {
+  h ^= std::rotl(h, 49) ^ std::rotl(h, 24);
+  h *= kPrimeMx2;
+  h ^= (h >> 35) + length;
+  h *= kPrimeMx2;
+  return h ^ (h >> 28);
+}
+
+uint64_t mix16(const unsigned char *input, const unsigned char *secret) {
+  return mulFold64(read64(input) ^ read64(secret),
+                   read64(input + 8) ^ read64(secret + 8));
+}
+
+uint64_t hashUpTo16(const unsigned char *input, size_t length) {
+  if (length > 8) {
+    uint64_t low = read64(input) ^ (read64(kSecret + 24) ^ read64(kSecret + 32));
+    uint64_t high =
+        read64(input + length - 8) ^ (read64(kSecret + 40) ^ read64(kSecret + 48));
+    return avalanche(length + std::byteswap(low) + high + mulFold64(low, high));
+  }
+  if (length >= 4) {
+    uint64_t combined = read32(input + length - 4) +
+                        (static_cast<uint64_t>(read32(input)) << 32);
+    return rrmxmx(combined ^ (read64(kSecret + 8) ^ read64(kSecret + 16)),
+                  length);
+  }
+  if (length > 0) {
+    uint32_t combined = (static_cast<uint32_t>(input[0]) << 16) |
+                        (static_cast<uint32_t>(input[length >> 1]) << 24) |
+                        static_cast<uint32_t>(input[length - 1]) |
+                        (static_cast<uint32_t>(length) << 8);
+    return xxh64Avalanche(combined ^ (read32(kSecret) ^ read32(kSecret + 4)));
+  }
+  return xxh64Avalanche(read64(kSecret + 56) ^ read64(kSecret + 64));
+}
+
+uint64_t hash17To128(const unsigned char *input, size_t length) {
+  uint64_t acc = length * kPrime64_1;
+  if (length > 32) {
+    if (length > 64) {
+      if (length > 96) {
+        acc += mix16(input + 48, kSecret + 96);
+        acc += mix16(input + length - 64, kSecret + 112);
+      }
+      acc += mix16(input + 32, kSecret + 64);
+      acc += mix16(input + length - 48, kSecret + 80);
+    }
+    acc += mix16(input + 16, kSecret + 32);
+    acc += mix16(input + length - 32, kSecret + 48);
+  }
+  acc += mix16(input, kSecret);
+  acc += mix16(input + length - 16, kSecret + 16);
+  return avalanche(acc);
+}
+
+uint64_t hash129To240(const unsigned char *input, size_t length) {
+  constexpr size_t kStartOffset = 3;
+  constexpr size_t kLastOffset = 17;
+  uint64_t acc = length * kPrime64_1;
+  for (size_t i = 0; i < 8; ++i) {
+    acc += mix16(input + 16 * i, kSecret + 16 * i);
+  }
+  acc = avalanche(acc);
+  uint64_t acc_end =
+      mix16(input + length - 16, kSecret + kSecretSizeMin - kLastOffset);
+  for (size_t i = 8; i < length / 16; ++i) {
+    acc_end += mix16(input + 16 * i, kSecret + 16 * (i - 8) + kStartOffset);
+  }
+  return avalanche(acc + acc_end);
+}
+
+void accumulateStripe(uint64_t *acc, const unsigned char *input,
+                      const unsigned char *secret) {
+  for (size_t lane = 0; lane < kAccumulators; ++lane) {
+    uint64_t data = read64(input + lane * 8);
+    uint64_t key = data ^ read64(secret + lane * 8);
+    acc[lane ^ 1] += data; // Swap adjacent lanes
+    acc[lane] += (key & 0xFFFFFFFF) * (key >> 32);
+  }
+}
+
+void scramble(uint64_t *acc, const unsigned char *secret) {
+  for (size_t lane = 0; lane < kAccumulators; ++lane) {
+    uint64_t value = acc[lane];
+    value ^= value >> 47;
+    value ^= read64(secret + lane * 8);
+    value *= kPrime32_1;
+    acc[lane] = value;
+  }
+}
+
+uint64_t hashLong(const unsigned char *input, size_t length) {
+  uint64_t acc[kAccumulators] = {kPrime32_3, kPrime64_1, kPrime64_2,
+                                 kPrime64_3, kPrime64_4, kPrime32_2,
+                                 kPrime64_5, kPrime32_1};
+  constexpr size_t kSecretSize = sizeof(kSecret);
+  constexpr size_t kStripesPerBlock =
+      (kSecretSize - kStripeLength) / kSecretConsumeRate;
+  constexpr size_t kBlockLength = kStripeLength * kStripesPerBlock;
+
+  size_t blocks = (length - 1) / kBlockLength;
+  for (size_t n = 0; n < blocks; ++n) {
+    const unsigned char *block = input + n * kBlockLength;
+    for (size_t s = 0; s < kStripesPerBlock; ++s) {
+      accumulateStripe(acc, block + s * kStripeLength,
+                       kSecret + s * kSecretConsumeRate);
+    }
+    scramble(acc, kSecret + kSecretSize - kStripeLength);
+  }
+
+  // Last partial block, then the final (possibly overlapping) stripe.
+  const unsigned char *block = input + blocks * kBlockLength;
+  size_t stripes = ((length - 1) - blocks * kBlockLength) / kStripeLength;
+  for (size_t s = 0; s < stripes; ++s) {
+    accumulateStripe(acc, block + s * kStripeLength,
+                     kSecret + s * kSecretConsumeRate);
+  }
+  constexpr size_t kLastAccStart = 7;
+  accumulateStripe(acc, input + length - kStripeLength,
+                   kSecret + kSecretSize - kStripeLength - kLastAccStart);
+
+  constexpr size_t kMergeAccsStart = 11;
+  uint64_t result = length * kPrime64_1;
+  for (size_t i = 0; i < 4; ++i) {
+    const unsigned char *secret = kSecret + kMergeAccsStart + 16 * i;
+    result += mulFold64(acc[2 * i] ^ read64(secret),
+                        acc[2 * i + 1] ^ read64(secret + 8));
+  }
+  return avalanche(result);
+}
+
+} // namespace
+
+uint64_t xxh3Hash64(std::string_view data) {
+  const auto *input = reinterpret_cast<const unsigned char *>(data.data());
+  size_t length = data.size();
+  if (length <= 16) {
+    return hashUpTo16(input, length);
+  }
+  if (length <= 128) {
+    return hash17To128(input, length);
+  }
+  if (length <= kMidsizeMax) {
+    return hash129To240(input, length);
+  }
+  return hashLong(input, length);
+}
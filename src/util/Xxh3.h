@@ -0,0 +1,13 @@
+#ifndef XXH3_H
+#define XXH3_H
+
+#include <cstdint>
+#include <string_view>
+
+// XXH3-64 with seed 0 and the default secret; the result matches
+// XXH3_64bits() from the reference xxHash library. Scalar implementation,
+// written for the batch tokenizer's content fingerprints so the build does
+// not need an extra dependency.
+uint64_t xxh3Hash64(std::string_view data);
+
+#endif // XXH3_H
@@ -0,0 +1,276 @@
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "runtime/Value.h"
+#include "vm/Superinstructions.h"
+
+// Instructions are 32-bit words in the style of Lua 5: an 8-bit opcode and
+// three 8-bit operands A, B and C, or A and a 16-bit Bx (sBx when signed).
+// Operands name frame registers R[x], where a function's locals live at fixed
+// registers from R[0] (the callee, or `this` in methods) and temporaries sit
+// above them, or constants K[x] from the chunk's pool.
+using Instruction = uint32_t;
+
+// Every opcode, in encoding order.
+#define LOX_OPCODES(X)                                                         \
+  X(MOVE)           /* A B    R[A] = R[B] */                                   \
+  X(LOADK)          /* A Bx   R[A] = K[Bx] */                                  \
+  X(LOADNIL)        /* A      R[A] = nil */                                    \
+  X(LOADTRUE)       /* A      R[A] = true */                                   \
+  X(LOADFALSE)      /* A      R[A] = false */                                  \
+  X(GET_GLOBAL)     /* A Bx   R[A] = globals[Bx] */                            \
+  X(DEFINE_GLOBAL)  /* A Bx   globals[Bx] = R[A], declaring it */              \
+  X(SET_GLOBAL)     /* A Bx   globals[Bx] = R[A] */                            \
+  X(GET_UPVALUE)    /* A B    R[A] = Upvalue[B] */                             \
+  X(SET_UPVALUE)    /* A B    Upvalue[B] = R[A] */                             \
+  X(GET_PROPERTY)   /* A B C  R[A] = R[B].K[C]; cache index follows */         \
+  X(SET_PROPERTY)   /* A B C  R[A].K[B] = R[C]; cache index follows */         \
+  X(GET_SUPER)      /* A B    R[A] = superclass R[A+1]'s K[B] bound to R[A] */ \
+  X(EQUAL)          /* A B C  R[A] = R[B] == R[C] */                           \
+  X(NOT_EQUAL)      /* A B C  R[A] = R[B] != R[C] */                           \
+  X(GREATER)        /* A B C  R[A] = R[B] > R[C] */                            \
+  X(GREATER_EQUAL)  /* A B C  R[A] = R[B] >= R[C] */                           \
+  X(LESS)           /* A B C  R[A] = R[B] < R[C] */                            \
+  X(LESS_EQUAL)     /* A B C  R[A] = R[B] <= R[C] */                           \
+  X(ADD)            /* A B C  R[A] = R[B] + R[C] */                            \
+  X(SUBTRACT)       /* A B C  R[A] = R[B] - R[C] */                            \
+  X(MULTIPLY)       /* A B C  R[A] = R[B] * R[C] */                            \
+  X(DIVIDE)         /* A B C  R[A] = R[B] / R[C] */                            \
+  X(EQUAL_K)        /* A B C  R[A] = R[B] == K[C] */                           \
+  X(NOT_EQUAL_K)    /* A B C  R[A] = R[B] != K[C] */                           \
+  X(GREATER_K)      /* A B C  R[A] = R[B] > K[C] */                            \
+  X(GREATER_EQUAL_K)/* A B C  R[A] = R[B] >= K[C] */                           \
+  X(LESS_K)         /* A B C  R[A] = R[B] < K[C] */                            \
+  X(LESS_EQUAL_K)   /* A B C  R[A] = R[B] <= K[C] */                           \
+  X(ADD_K)          /* A B C  R[A] = R[B] + K[C] */                            \
+  X(SUBTRACT_K)     /* A B C  R[A] = R[B] - K[C] */                            \
+  X(MULTIPLY_K)     /* A B C  R[A] = R[B] * K[C] */                            \
+  X(DIVIDE_K)       /* A B C  R[A] = R[B] / K[C] */                            \
+  X(NOT)            /* A B    R[A] = !R[B] */                                  \
+  X(NEGATE)         /* A B    R[A] = -R[B] */                                  \
+  X(PRINT)          /* A      print R[A] */                                    \
+  X(JUMP)           /* sBx    pc += sBx */                                     \
+  X(JUMP_IF_FALSE)  /* A sBx  if R[A] is falsey, pc += sBx */                  \
+  X(JUMP_IF_TRUE)   /* A sBx  if R[A] is truthy, pc += sBx */                  \
+  X(JUMP_IF_FUNCTION)/* A B C  if R[A] is a closure of K[B], pc += C */        \
+  X(CALL)           /* A B    R[A] = R[A](R[A+1], ..., R[A+B]) */              \
+  X(INVOKE)         /* A B C  R[A] = R[A].K[B](R[A+1], ..., R[A+C]); cache */  \
+  X(SUPER_INVOKE)   /* A B C  as INVOKE, on superclass R[A+C+1]'s method */    \
+  X(CLOSURE)        /* A Bx   R[A] = closure of function K[Bx] */              \
+  X(CLOSE_UPVALUES) /* A      close upvalues of R[A] and above */              \
+  X(RETURN)         /* A      return R[A] */                                   \
+  X(RETURN_NIL)     /*        return nil */                                    \
+  X(CLASS)          /* A Bx   R[A] = new class named K[Bx] */                  \
+  X(INHERIT)        /* A B    copy superclass R[B]'s methods into R[A] */      \
+  X(METHOD)         /* A B C  R[A].methods[K[B]] = R[C] */
+
+// Type-specialized forms the VM rewrites a generic instruction to in place
+// (quickening) after seeing its operand types the first time it runs; the
+// compiler never emits them. Each guards its operand types and, when they
+// change, rewrites the instruction to the generic opcode's _ANY form, which
+// does the generic work without ever quickening again. Comparisons and the
+// other arithmetic opcodes only accept numbers, so they have nothing to
+// specialize on.
+#define LOX_QUICKENED_OPCODES(X)                                               \
+  X(ADD_NUM_NUM, ADD)                 /* R[B], R[C] numbers */                 \
+  X(ADD_STR_STR, ADD)                 /* R[B], R[C] strings */                 \
+  X(ADD_ANY, ADD)                                                              \
+  X(ADD_K_NUM_NUM, ADD_K)             /* R[B], K[C] numbers */                 \
+  X(ADD_K_STR_STR, ADD_K)             /* R[B], K[C] strings */                 \
+  X(ADD_K_ANY, ADD_K)                                                          \
+  X(EQUAL_NUM_NUM, EQUAL)             /* R[B], R[C] numbers */                 \
+  X(EQUAL_ANY, EQUAL)                                                          \
+  X(NOT_EQUAL_NUM_NUM, NOT_EQUAL)     /* R[B], R[C] numbers */                 \
+  X(NOT_EQUAL_ANY, NOT_EQUAL)                                                  \
+  X(EQUAL_K_NUM_NUM, EQUAL_K)         /* R[B], K[C] numbers */                 \
+  X(EQUAL_K_ANY, EQUAL_K)                                                      \
+  X(NOT_EQUAL_K_NUM_NUM, NOT_EQUAL_K) /* R[B], K[C] numbers */                 \
+  X(NOT_EQUAL_K_ANY, NOT_EQUAL_K)
+
+// Superinstructions do the work of two adjacent instructions in one
+// dispatch; the hottest pairs in the benchmark profiles are listed in the
+// generated Superinstructions.h. A fused opcode replaces the first
+// instruction's and the second stays in place, read as the fused one's
+// operand word, so a jump that lands on it still runs it alone.
+enum class OpCode : uint8_t {
+#define LOX_OPCODE_ENUM(name) name,
+#define LOX_QUICKENED_OPCODE_ENUM(name, generic) name,
+#define LOX_FUSED_OPCODE_ENUM(first, second) first##_THEN_##second,
+  LOX_OPCODES(LOX_OPCODE_ENUM)
+  LOX_QUICKENED_OPCODES(LOX_QUICKENED_OPCODE_ENUM)
+  LOX_SUPERINSTRUCTIONS(LOX_FUSED_OPCODE_ENUM)
+#undef LOX_OPCODE_ENUM
+#undef LOX_QUICKENED_OPCODE_ENUM
+#undef LOX_FUSED_OPCODE_ENUM
+      COUNT
+};
+
+inline constexpr size_t kOpCodeCount = static_cast<size_t>(OpCode::COUNT);
+
+inline constexpr std::array<std::string_view, kOpCodeCount> kOpCodeNames = {
+#define LOX_OPCODE_NAME(name) #name,
+#define LOX_QUICKENED_OPCODE_NAME(name, generic) #name,
+#define LOX_FUSED_OPCODE_NAME(first, second) #first "+" #second,
+    LOX_OPCODES(LOX_OPCODE_NAME)
+    LOX_QUICKENED_OPCODES(LOX_QUICKENED_OPCODE_NAME)
+    LOX_SUPERINSTRUCTIONS(LOX_FUSED_OPCODE_NAME)
+#undef LOX_OPCODE_NAME
+#undef LOX_QUICKENED_OPCODE_NAME
+#undef LOX_FUSED_OPCODE_NAME
+};
+
+// The opcode the compiler emitted for an instruction now running as op: the
+// generic form of a quickened opcode, and op itself otherwise.
+constexpr OpCode emittedOpCode(OpCode op) {
+#define LOX_QUICKENED_OPCODE_MATCH(name, generic)                              \
+  if (op == OpCode::name) {                                                    \
+    return OpCode::generic;                                                    \
+  }
+  LOX_QUICKENED_OPCODES(LOX_QUICKENED_OPCODE_MATCH)
+#undef LOX_QUICKENED_OPCODE_MATCH
+  return op;
+}
+
+// Whether the VM may quicken an instruction with opcode op.
+constexpr bool quickens(OpCode op) {
+#define LOX_QUICKENED_OPCODE_MATCH(name, generic)                              \
+  if (op == OpCode::generic) {                                                 \
+    return true;                                                               \
+  }
+  LOX_QUICKENED_OPCODES(LOX_QUICKENED_OPCODE_MATCH)
+#undef LOX_QUICKENED_OPCODE_MATCH
+  return false;
+}
+
+// The superinstruction for first followed by second, or COUNT if there is
+// none.
+constexpr OpCode fusedOpCode([[maybe_unused]] OpCode first,
+                            [[maybe_unused]] OpCode second) {
+#define LOX_FUSED_OPCODE_MATCH(a, b)                                           \
+  if (first == OpCode::a && second == OpCode::b) {                             \
+    return OpCode::a##_THEN_##b;                                               \
+  }
+  LOX_SUPERINSTRUCTIONS(LOX_FUSED_OPCODE_MATCH)
+#undef LOX_FUSED_OPCODE_MATCH
+  return OpCode::COUNT;
+}
+
+// The first instruction of a superinstruction, which its handler runs before
+// the second; op itself if it is not one.
+constexpr OpCode unfusedOpCode(OpCode op) {
+#define LOX_FUSED_OPCODE_MATCH(a, b)                                           \
+  if (op == OpCode::a##_THEN_##b) {                                            \
+    return OpCode::a;                                                          \
+  }
+  LOX_SUPERINSTRUCTIONS(LOX_FUSED_OPCODE_MATCH)
+#undef LOX_FUSED_OPCODE_MATCH
+  return op;
+}
+
+constexpr Instruction encodeABC(OpCode op, uint8_t a, uint8_t b, uint8_t c) {
+  return static_cast<Instruction>(op) | static_cast<Instruction>(a) << 8 |
+         static_cast<Instruction>(b) << 16 | static_cast<Instruction>(c) << 24;
+}
+constexpr Instruction encodeABx(OpCode op, uint8_t a, uint16_t bx) {
+  return static_cast<Instruction>(op) | static_cast<Instruction>(a) << 8 |
+         static_cast<Instruction>(bx) << 16;
+}
+constexpr Instruction encodeAsBx(OpCode op, uint8_t a, int16_t sbx) {
+  return encodeABx(op, a, static_cast<uint16_t>(sbx));
+}
+
+constexpr OpCode opOf(Instruction i) { return static_cast<OpCode>(i & 0xff); }
+constexpr uint8_t argA(Instruction i) { return (i >> 8) & 0xff; }
+constexpr uint8_t argB(Instruction i) { return (i >> 16) & 0xff; }
+constexpr uint8_t argC(Instruction i) { return i >> 24; }
+constexpr uint16_t argBx(Instruction i) { return i >> 16; }
+constexpr int16_t argSBx(Instruction i) {
+  return static_cast<int16_t>(argBx(i));
+}
+
+constexpr Instruction withOp(Instruction i, OpCode op) {
+  return (i & ~Instruction{0xff}) | static_cast<Instruction>(op);
+}
+constexpr Instruction withArgA(Instruction i, uint8_t a) {
+  return (i & ~Instruction{0xff00}) | static_cast<Instruction>(a) << 8;
+}
+constexpr Instruction withArgSBx(Instruction i, int16_t sbx) {
+  return (i & 0xffff) | static_cast<Instruction>(static_cast<uint16_t>(sbx))
+                            << 16;
+}
+
+// Words an instruction takes: the property instructions are followed by the
+// index of their PropertyCache.
+constexpr size_t instructionLength(OpCode op) {
+  return op == OpCode::GET_PROPERTY || op == OpCode::SET_PROPERTY ||
+                 op == OpCode::INVOKE
+             ? 2
+             : 1;
+}
+
+class Shape;
+struct ObjClosure;
+
+// Inline cache of a GET_PROPERTY, SET_PROPERTY or INVOKE site: what its
+// name resolved to on instances of up to kWays shapes. A monomorphic site
+// only ever fills the first entry; once all are in use, misses replace them
+// in turn.
+struct PropertyCache {
+  static constexpr size_t kWays = 4;
+
+  struct Entry {
+    const Shape *shape = nullptr;
+    // The class's method, or nullptr if the name is the field at slot.
+    ObjClosure *method = nullptr;
+    // For a SET_PROPERTY that adds the field: the instance's new shape.
+    Shape *transition = nullptr;
+    uint32_t slot = 0;
+  };
+
+  const Entry *find(const Shape *shape) const {
+    for (const Entry &entry : entries) {
+      if (entry.shape == shape) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+  const Entry &add(const Entry &entry) {
+    Entry &replaced = entries[next];
+    next = (next + 1) % kWays;
+    return replaced = entry;
+  }
+
+  std::array<Entry, kWays> entries;
+  uint32_t next = 0;
+};
+
+// A function's bytecode. lines is parallel to code and holds the source line
+// each instruction was compiled from, for runtime error reports.
+struct Chunk {
+  std::vector<Instruction> code;
+  std::vector<int> lines;
+  std::vector<Value> constants;
+  std::vector<PropertyCache> property_caches;
+
+  size_t write(Instruction instruction, int line) {
+    code.push_back(instruction);
+    lines.push_back(line);
+    return code.size() - 1;
+  }
+  uint32_t addPropertyCache() {
+    property_caches.emplace_back();
+    return static_cast<uint32_t>(property_caches.size() - 1);
+  }
+  size_t addConstant(Value value) {
+    constants.push_back(value);
+    return constants.size() - 1;
+  }
+};
+
+#endif // CHUNK_H
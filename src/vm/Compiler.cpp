@@ -0,0 +1,1869 @@
+#include "Compiler.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <format>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+
+// Operands are 8 bits, which limits locals, registers, upvalues and constants
+// per function to 256.
+constexpr size_t kMaxLocals = 256;
+constexpr int kMaxRegisters = 256;
+constexpr size_t kMaxUpvalues = 256;
+constexpr size_t kMaxConstants = 256;
+// Calls are inlined only to functions of up to this many words of code.
+constexpr size_t kMaxInlineSize = 16;
+
+enum class FunctionType : uint8_t { Function, Initializer, Method, Script };
+
+// A local's register is its index in FunctionState::locals.
+struct Local {
+  std::string_view name;
+  int depth; // -1 while its initializer is being compiled
+  bool is_captured;
+};
+
+// Compilation state of one function; nested functions push another.
+struct FunctionState {
+  FunctionState *enclosing;
+  ObjFunction *function;
+  FunctionType type;
+  std::vector<Local> locals;
+  int scope_depth = 0;
+  // Temporaries are allocated upward from the locals like a stack. Between
+  // statements this equals locals.size().
+  int free_register = 0;
+  // Constant pool index of each value already added, by NaN-boxed bits, so
+  // repeated names and literals share one slot of the 256.
+  std::unordered_map<uint64_t, uint8_t> constant_indices;
+};
+
+struct ClassState {
+  ClassState *enclosing;
+  bool has_superclass;
+};
+
+// Where the value of a compiled expression is, as in Lua's code generator.
+// Constants and locals are used in place, so `i < 10` reads i's register and
+// the constant pool directly, and an instruction computing a value leaves its
+// destination open until the consumer picks one, so `x = a + b` is one ADD
+// into x's register.
+struct ExprDesc {
+  enum class Kind : uint8_t {
+    Nil,
+    True,
+    False,
+    Constant, // value: the constant
+    Local,    // info: a register the expression does not own
+    Temp,     // info: the topmost temporary register, which holds it
+    Reloc,    // info: pc of the instruction computing it, A still unset
+  };
+  Kind kind = Kind::Nil;
+  uint32_t info = 0;
+  // A constant joins the constant pool only when an instruction needs its
+  // index, so literals that are folded away never take one of the 256.
+  Value value = Value();
+
+  bool isConstant() const {
+    return kind == Kind::Nil || kind == Kind::True || kind == Kind::False ||
+           kind == Kind::Constant;
+  }
+};
+
+// The operator that gives the same result as op with its operands swapped,
+// if there is one. Addition isn't: it also concatenates strings.
+std::optional<TokenType> mirroredOperator(TokenType op) {
+  switch (op) {
+  case TokenType::BANG_EQUAL:
+  case TokenType::EQUAL_EQUAL:
+  case TokenType::STAR:
+    return op;
+  case TokenType::GREATER:
+    return TokenType::LESS;
+  case TokenType::GREATER_EQUAL:
+    return TokenType::LESS_EQUAL;
+  case TokenType::LESS:
+    return TokenType::GREATER;
+  case TokenType::LESS_EQUAL:
+    return TokenType::GREATER_EQUAL;
+  default:
+    return std::nullopt;
+  }
+}
+
+// The value of op applied to two constants, as the VM would compute it, or
+// nothing if the VM would report an error instead.
+std::optional<Value> foldBinary(TokenType op, Value a, Value b, Heap &heap) {
+  switch (op) {
+  case TokenType::EQUAL_EQUAL:
+    return Value::boolean(valuesEqual(a, b));
+  case TokenType::BANG_EQUAL:
+    return Value::boolean(!valuesEqual(a, b));
+  case TokenType::PLUS:
+    if (isString(a) && isString(b)) {
+      return Value::object(heap.concatenate(asString(a), asString(b)));
+    }
+    break;
+  default:
+    break;
+  }
+  if (!a.isNumber() || !b.isNumber()) {
+    return std::nullopt;
+  }
+  double x = a.asNumber();
+  double y = b.asNumber();
+  switch (op) {
+  case TokenType::GREATER:
+    return Value::boolean(x > y);
+  case TokenType::GREATER_EQUAL:
+    return Value::boolean(x >= y);
+  case TokenType::LESS:
+    return Value::boolean(x < y);
+  case TokenType::LESS_EQUAL:
+    return Value::boolean(x <= y);
+  case TokenType::PLUS:
+    return Value::number(x + y);
+  case TokenType::MINUS:
+    return Value::number(x - y);
+  case TokenType::STAR:
+    return Value::number(x * y);
+  default:
+    return Value::number(x / y);
+  }
+}
+
+// Rewrites each instruction that starts a superinstruction pair to the fused
+// opcode, left to right, once the function's jumps are all patched. The
+// second instruction is left in place, so jump offsets are unchanged.
+void fuseSuperinstructions(Chunk &chunk) {
+  std::vector<Instruction> &code = chunk.code;
+  size_t pc = 0;
+  while (pc < code.size()) {
+    OpCode first = opOf(code[pc]);
+    size_t second_pc = pc + instructionLength(first);
+    if (second_pc >= code.size()) {
+      break;
+    }
+    OpCode second = opOf(code[second_pc]);
+    OpCode fused = fusedOpCode(first, second);
+    if (fused != OpCode::COUNT) {
+      code[pc] = withOp(code[pc], fused);
+      // The second instruction is already part of the superinstruction.
+      second_pc += instructionLength(second);
+    }
+    pc = second_pc;
+  }
+}
+
+bool isJump(OpCode op) {
+  return op == OpCode::JUMP || op == OpCode::JUMP_IF_FALSE ||
+         op == OpCode::JUMP_IF_TRUE;
+}
+
+// Jumps, and the guard of an inlined call, whose offset is C instead.
+bool branches(OpCode op) {
+  return isJump(op) || op == OpCode::JUMP_IF_FUNCTION;
+}
+
+size_t jumpTarget(const std::vector<Instruction> &code, size_t pc) {
+  if (opOf(code[pc]) == OpCode::JUMP_IF_FUNCTION) {
+    return pc + 1 + argC(code[pc]);
+  }
+  return static_cast<size_t>(static_cast<ptrdiff_t>(pc) + 1 +
+                             argSBx(code[pc]));
+}
+
+// Moves the target of a branch, which stays in range: code only shrinks.
+Instruction withJumpOffset(Instruction instruction, ptrdiff_t offset) {
+  if (opOf(instruction) == OpCode::JUMP_IF_FUNCTION) {
+    return (instruction & 0xffffff) | static_cast<Instruction>(offset) << 24;
+  }
+  return withArgSBx(instruction, static_cast<int16_t>(offset));
+}
+
+// Peephole pass over a function's finished code, before superinstructions
+// are fused:
+//
+// - A jump to a JUMP goes straight to its target, and a conditional jump to
+//   another on the same register straight to where that one goes (the test
+//   has the same outcome). A JUMP to a return becomes the return.
+// - Code no path from the entry reaches is removed, as the return after an
+//   explicit one at the end of a function usually is, and so are jumps to
+//   the next remaining instruction.
+//
+// The lines of the remaining instructions move with them, so runtime errors
+// are reported as before.
+void optimizeJumps(Chunk &chunk) {
+  std::vector<Instruction> &code = chunk.code;
+  constexpr int kMaxHops = 16; // Bounds `while (true) {}`, a jump to itself
+
+  for (size_t pc = 0; pc < code.size();
+       pc += instructionLength(opOf(code[pc]))) {
+    OpCode op = opOf(code[pc]);
+    if (!isJump(op)) {
+      continue;
+    }
+    size_t target = jumpTarget(code, pc);
+    for (int hops = 0; hops < kMaxHops; ++hops) {
+      Instruction next = code[target];
+      if (opOf(next) == OpCode::JUMP) {
+        target = jumpTarget(code, target);
+      } else if (op != OpCode::JUMP && isJump(opOf(next)) &&
+                 argA(next) == argA(code[pc])) {
+        target = opOf(next) == op ? jumpTarget(code, target) : target + 1;
+      } else {
+        break;
+      }
+    }
+    OpCode at_target = opOf(code[target]);
+    if (op == OpCode::JUMP &&
+        (at_target == OpCode::RETURN || at_target == OpCode::RETURN_NIL)) {
+      code[pc] = code[target];
+      continue;
+    }
+    ptrdiff_t offset =
+        static_cast<ptrdiff_t>(target) - static_cast<ptrdiff_t>(pc) - 1;
+    if (offset >= INT16_MIN && offset <= INT16_MAX) {
+      code[pc] = withArgSBx(code[pc], static_cast<int16_t>(offset));
+    }
+  }
+
+  // Which words start an instruction, rather than holding a cache index.
+  std::vector<bool> starts(code.size(), false);
+  for (size_t pc = 0; pc < code.size();
+       pc += instructionLength(opOf(code[pc]))) {
+    starts[pc] = true;
+  }
+
+  std::vector<bool> keep(code.size(), false);
+  std::vector<size_t> pending{0};
+  while (!pending.empty()) {
+    size_t pc = pending.back();
+    pending.pop_back();
+    if (keep[pc]) {
+      continue;
+    }
+    OpCode op = opOf(code[pc]);
+    keep[pc] = true;
+    if (instructionLength(op) == 2) {
+      keep[pc + 1] = true;
+    }
+    if (branches(op)) {
+      pending.push_back(jumpTarget(code, pc));
+    }
+    if (op != OpCode::JUMP && op != OpCode::RETURN &&
+        op != OpCode::RETURN_NIL) {
+      pending.push_back(pc + instructionLength(op));
+    }
+  }
+  // Backward, so a jump over one that is removed is seen after it.
+  for (size_t pc = code.size(); pc-- > 0;) {
+    if (!keep[pc] || !starts[pc] || !branches(opOf(code[pc])) ||
+        jumpTarget(code, pc) <= pc) {
+      continue;
+    }
+    auto target = keep.begin() + static_cast<ptrdiff_t>(jumpTarget(code, pc));
+    if (std::find(keep.begin() + static_cast<ptrdiff_t>(pc) + 1, target,
+                  true) == target) {
+      keep[pc] = false;
+    }
+  }
+
+  // new_pc[pc]: where pc, or the first kept word after it, ends up.
+  std::vector<size_t> new_pc(code.size());
+  size_t out = 0;
+  for (size_t pc = 0; pc < code.size(); ++pc) {
+    new_pc[pc] = out;
+    out += keep[pc];
+  }
+  out = 0;
+  for (size_t pc = 0; pc < code.size(); ++pc) {
+    if (!keep[pc]) {
+      continue;
+    }
+    Instruction instruction = code[pc];
+    if (starts[pc] && branches(opOf(instruction))) {
+      auto offset = static_cast<ptrdiff_t>(new_pc[jumpTarget(code, pc)]) -
+                    static_cast<ptrdiff_t>(out) - 1;
+      instruction = withJumpOffset(instruction, offset);
+    }
+    code[out] = instruction;
+    chunk.lines[out] = chunk.lines[pc];
+    ++out;
+  }
+  code.resize(out);
+  chunk.lines.resize(out);
+}
+
+// Whether an instruction can be copied into another function's code by
+// inlineCall(), with its registers shifted to the call's: it refers to nothing
+// else of its frame (upvalues, the enclosing class) and declares nothing.
+bool inlinable(OpCode op) {
+  switch (op) {
+  case OpCode::MOVE:
+  case OpCode::LOADK:
+  case OpCode::LOADNIL:
+  case OpCode::LOADTRUE:
+  case OpCode::LOADFALSE:
+  case OpCode::GET_GLOBAL:
+  case OpCode::SET_GLOBAL:
+  case OpCode::GET_PROPERTY:
+  case OpCode::SET_PROPERTY:
+  case OpCode::EQUAL:
+  case OpCode::NOT_EQUAL:
+  case OpCode::GREATER:
+  case OpCode::GREATER_EQUAL:
+  case OpCode::LESS:
+  case OpCode::LESS_EQUAL:
+  case OpCode::ADD:
+  case OpCode::SUBTRACT:
+  case OpCode::MULTIPLY:
+  case OpCode::DIVIDE:
+  case OpCode::EQUAL_K:
+  case OpCode::NOT_EQUAL_K:
+  case OpCode::GREATER_K:
+  case OpCode::GREATER_EQUAL_K:
+  case OpCode::LESS_K:
+  case OpCode::LESS_EQUAL_K:
+  case OpCode::ADD_K:
+  case OpCode::SUBTRACT_K:
+  case OpCode::MULTIPLY_K:
+  case OpCode::DIVIDE_K:
+  case OpCode::NOT:
+  case OpCode::NEGATE:
+  case OpCode::PRINT:
+  case OpCode::JUMP:
+  case OpCode::JUMP_IF_FALSE:
+  case OpCode::JUMP_IF_TRUE:
+  case OpCode::JUMP_IF_FUNCTION:
+  case OpCode::CALL:
+  case OpCode::INVOKE:
+  case OpCode::RETURN:
+  case OpCode::RETURN_NIL:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Whether an instruction's only effect on the registers is to set R[A] from
+// its other operands, so it can compute its result somewhere else instead.
+bool setsOnlyA(OpCode op) {
+  return inlinable(op) && op != OpCode::SET_GLOBAL &&
+         op != OpCode::SET_PROPERTY && op != OpCode::PRINT &&
+         !branches(op) && op != OpCode::CALL && op != OpCode::INVOKE &&
+         op != OpCode::RETURN && op != OpCode::RETURN_NIL;
+}
+
+class Compiler {
+public:
+  Compiler(Scanner &scanner, Heap &heap, Globals &globals,
+           std::vector<ParseDiagnostic> &diagnostics,
+           const CompileOptions &options)
+      : scanner_(scanner), heap_(heap), globals_(globals),
+        diagnostics_(diagnostics), options_(options),
+        tokens_(scanner.scanTokens()) {}
+
+  ObjFunction *compileScript();
+
+private:
+  enum class Precedence : uint8_t {
+    None,
+    Assignment, // =
+    Or,         // or
+    And,        // and
+    Equality,   // == !=
+    Comparison, // < > <= >=
+    Term,       // + -
+    Factor,     // * /
+    Unary,      // ! -
+    Call,       // . ()
+    Primary
+  };
+
+  using ParseFn = void (Compiler::*)(ExprDesc &e, bool can_assign);
+
+  struct ParseRule {
+    ParseFn prefix = nullptr;
+    ParseFn infix = nullptr;
+    Precedence precedence = Precedence::None;
+  };
+
+  static const std::array<ParseRule, static_cast<size_t>(TokenType::COUNT)>
+      kRules;
+  static const ParseRule &ruleFor(TokenType type) {
+    return kRules[static_cast<size_t>(type)];
+  }
+
+  // A left operand that is a local is read from its register when the
+  // instruction using it runs, after the operands to its right. If those
+  // may have reassigned it, it is copied first; see protectOperand().
+  struct OperandGuard {
+    size_t pc;
+    uint32_t side_effects;
+    uint8_t reserved; // Where the copy goes
+  };
+
+  // How far the chunk had grown when some code started, so that code can be
+  // dropped along with the constants and property caches it added.
+  struct CodeMark {
+    size_t code;
+    size_t constants;
+    size_t property_caches;
+  };
+  CodeMark mark() {
+    return CodeMark{chunk().code.size(), chunk().constants.size(),
+                    chunk().property_caches.size()};
+  }
+
+  // Token cursor
+  TokenType peekType() const { return tokens_[current_].type; }
+  TokenType previousType() const { return tokens_[previous_].type; }
+  std::string_view lexeme(uint32_t token) const {
+    return scanner_.lexeme(tokens_[token]);
+  }
+  bool check(TokenType type) const { return peekType() == type; }
+  void advance() {
+    previous_ = current_;
+    if (!check(TokenType::END_OF_FILE)) {
+      ++current_;
+    }
+  }
+  bool match(TokenType type) {
+    if (!check(type)) {
+      return false;
+    }
+    advance();
+    return true;
+  }
+  void consume(TokenType type, const char *message) {
+    if (check(type)) {
+      advance();
+    } else {
+      errorAt(current_, message);
+    }
+  }
+  void error(const char *message) { errorAt(previous_, message); }
+  void errorAt(uint32_t token, const char *message);
+  void synchronize();
+
+  // Emitting
+  Chunk &chunk() { return state_->function->chunk; }
+  size_t emit(Instruction instruction) {
+    return chunk().write(instruction, tokens_[previous_].line);
+  }
+  // Emits a property instruction and its inline cache's index.
+  size_t emitCached(Instruction instruction) {
+    size_t pc = emit(instruction);
+    emit(chunk().addPropertyCache());
+    return pc;
+  }
+  size_t emitJump(OpCode op, uint8_t a = 0) {
+    return emit(encodeAsBx(op, a, 0));
+  }
+  size_t emitJumpIfFalse(ExprDesc &condition);
+  void patchJump(size_t pc);
+  void emitLoop(size_t loop_start);
+  void emitReturn();
+  uint8_t makeConstant(Value value);
+
+  // Registers and expression results
+  uint8_t allocRegister();
+  void resetRegisters() {
+    state_->free_register = static_cast<int>(state_->locals.size());
+    state_->function->max_registers =
+        std::max(state_->function->max_registers, state_->free_register);
+  }
+  void dischargeTo(ExprDesc &e, uint8_t reg);
+  uint8_t toNextRegister(ExprDesc &e);
+  uint8_t toAnyRegister(ExprDesc &e);
+  std::optional<uint8_t> constantOperand(const ExprDesc &e);
+  Value constantValue(const ExprDesc &e);
+  void setConstant(ExprDesc &e, Value value);
+  void dropCode(const CodeMark &start);
+  void discard(ExprDesc &e);
+  OperandGuard guardOperand(const ExprDesc &e);
+  void protectOperand(ExprDesc &e, const OperandGuard &guard);
+
+  // Functions and scopes
+  void beginFunction(FunctionState &state, FunctionType type);
+  ObjFunction *endFunction();
+  void beginScope() { ++state_->scope_depth; }
+  void endScope();
+
+  // Variables
+  uint8_t nameConstant(std::string_view name) {
+    return makeConstant(Value::object(heap_.makeString(name)));
+  }
+  uint16_t globalSlot(std::string_view name);
+  int resolveLocal(FunctionState &state, std::string_view name);
+  int addUpvalue(FunctionState &state, uint8_t index, bool is_local);
+  int resolveUpvalue(FunctionState &state, std::string_view name);
+  void addLocal(std::string_view name);
+  void declareVariable();
+  uint16_t parseVariable(const char *message);
+  void markInitialized();
+  void namedVariable(ExprDesc &e, std::string_view name, bool can_assign);
+  uint8_t argumentList();
+
+  // Declarations and statements
+  void declaration();
+  void classDeclaration();
+  void method(uint8_t class_register);
+  void funDeclaration();
+  uint8_t function(FunctionType type);
+  void varDeclaration();
+  void statement();
+  void printStatement();
+  void returnStatement();
+  void ifStatement();
+  void whileStatement();
+  void forStatement();
+  void block();
+  void expressionStatement();
+
+  // Expressions
+  void expression(ExprDesc &e) { parsePrecedence(Precedence::Assignment, e); }
+  void parsePrecedence(Precedence precedence, ExprDesc &e);
+  void number(ExprDesc &e, bool can_assign);
+  void string(ExprDesc &e, bool can_assign);
+  void literal(ExprDesc &e, bool can_assign);
+  void grouping(ExprDesc &e, bool can_assign);
+  void unary(ExprDesc &e, bool can_assign);
+  void binary(ExprDesc &e, bool can_assign);
+  void andExpr(ExprDesc &e, bool can_assign);
+  void orExpr(ExprDesc &e, bool can_assign);
+  void shortCircuitConstant(ExprDesc &e, Precedence precedence,
+                            bool short_circuits);
+  void variable(ExprDesc &e, bool can_assign);
+  void thisExpr(ExprDesc &e, bool can_assign);
+  void superExpr(ExprDesc &e, bool can_assign);
+  void call(ExprDesc &e, bool can_assign);
+  bool inlineCall(uint16_t global, uint8_t base, uint8_t arg_count);
+  void dot(ExprDesc &e, bool can_assign);
+
+  Scanner &scanner_;
+  Heap &heap_;
+  Globals &globals_;
+  std::vector<ParseDiagnostic> &diagnostics_;
+  CompileOptions options_;
+  const std::vector<Token> &tokens_;
+  uint32_t current_ = 0;
+  uint32_t previous_ = 0;
+  bool panic_mode_ = false;
+  FunctionState *state_ = nullptr;
+  ClassState *class_ = nullptr;
+  // Counts emitted calls and local assignments: anything that can change a
+  // local's register while an expression is being evaluated.
+  uint32_t side_effects_ = 0;
+  // By global slot, the function a top-level `fun` last declared it as,
+  // unless a later declaration or assignment of the global was compiled.
+  std::unordered_map<uint16_t, ObjFunction *> global_functions_;
+};
+
+const std::array<Compiler::ParseRule, static_cast<size_t>(TokenType::COUNT)>
+    Compiler::kRules = [] {
+      std::array<ParseRule, static_cast<size_t>(TokenType::COUNT)> rules{};
+      auto set = [&rules](TokenType type, ParseFn prefix, ParseFn infix,
+                          Precedence precedence) {
+        rules[static_cast<size_t>(type)] = ParseRule{prefix, infix, precedence};
+      };
+      using P = Precedence;
+      set(TokenType::LEFT_PAREN, &Compiler::grouping, &Compiler::call, P::Call);
+      set(TokenType::DOT, nullptr, &Compiler::dot, P::Call);
+      set(TokenType::MINUS, &Compiler::unary, &Compiler::binary, P::Term);
+      set(TokenType::PLUS, nullptr, &Compiler::binary, P::Term);
+      set(TokenType::SLASH, nullptr, &Compiler::binary, P::Factor);
+      set(TokenType::STAR, nullptr, &Compiler::binary, P::Factor);
+      set(TokenType::BANG, &Compiler::unary, nullptr, P::None);
+      set(TokenType::BANG_EQUAL, nullptr, &Compiler::binary, P::Equality);
+      set(TokenType::EQUAL_EQUAL, nullptr, &Compiler::binary, P::Equality);
+      set(TokenType::GREATER, nullptr, &Compiler::binary, P::Comparison);
+      set(TokenType::GREATER_EQUAL, nullptr, &Compiler::binary, P::Comparison);
+      set(TokenType::LESS, nullptr, &Compiler::binary, P::Comparison);
+      set(TokenType::LESS_EQUAL, nullptr, &Compiler::binary, P::Comparison);
+      set(TokenType::IDENTIFIER, &Compiler::variable, nullptr, P::None);
+      set(TokenType::STRING, &Compiler::string, nullptr, P::None);
+      set(TokenType::NUMBER, &Compiler::number, nullptr, P::None);
+      set(TokenType::AND, nullptr, &Compiler::andExpr, P::And);
+      set(TokenType::OR, nullptr, &Compiler::orExpr, P::Or);
+      set(TokenType::FALSE, &Compiler::literal, nullptr, P::None);
+      set(TokenType::TRUE, &Compiler::literal, nullptr, P::None);
+      set(TokenType::NIL, &Compiler::literal, nullptr, P::None);
+      set(TokenType::THIS, &Compiler::thisExpr, nullptr, P::None);
+      set(TokenType::SUPER, &Compiler::superExpr, nullptr, P::None);
+      return rules;
+    }();
+
+ObjFunction *Compiler::compileScript() {
+  size_t errors_before = diagnostics_.size();
+  FunctionState script;
+  beginFunction(script, FunctionType::Script);
+  while (!match(TokenType::END_OF_FILE)) {
+    declaration();
+  }
+  ObjFunction *function = endFunction();
+  return diagnostics_.size() == errors_before ? function : nullptr;
+}
+
+// --- Errors ---
+
+void Compiler::errorAt(uint32_t token, const char *message) {
+  // Until the next statement boundary, errors are cascades of this one.
+  if (panic_mode_) {
+    return;
+  }
+  panic_mode_ = true;
+  const Token &at = tokens_[token];
+  std::string location = at.type == TokenType::END_OF_FILE
+                             ? std::string(" at end")
+                             : std::format(" at '{}'", lexeme(token));
+  diagnostics_.push_back(
+      ParseDiagnostic{at.line, std::move(location), message});
+}
+
+void Compiler::synchronize() {
+  panic_mode_ = false;
+  while (!check(TokenType::END_OF_FILE)) {
+    if (previousType() == TokenType::SEMICOLON) {
+      return;
+    }
+    switch (peekType()) {
+    case TokenType::CLASS:
+    case TokenType::FUN:
+    case TokenType::VAR:
+    case TokenType::FOR:
+    case TokenType::IF:
+    case TokenType::WHILE:
+    case TokenType::PRINT:
+    case TokenType::RETURN:
+      return;
+    default:
+      advance();
+    }
+  }
+}
+
+// --- Emitting ---
+
+// Emits the jump a statement takes when its condition is falsey. A condition
+// just computed by NOT is only needed for the jump, so the NOT is dropped and
+// the jump tests its operand the other way.
+size_t Compiler::emitJumpIfFalse(ExprDesc &condition) {
+  std::vector<Instruction> &code = chunk().code;
+  if (condition.kind == ExprDesc::Kind::Reloc &&
+      condition.info == code.size() - 1 &&
+      opOf(code.back()) == OpCode::NOT) {
+    uint8_t operand = argB(code.back());
+    code.pop_back();
+    chunk().lines.pop_back();
+    return emitJump(OpCode::JUMP_IF_TRUE, operand);
+  }
+  return emitJump(OpCode::JUMP_IF_FALSE, toAnyRegister(condition));
+}
+
+void Compiler::patchJump(size_t pc) {
+  // Offsets are relative to the instruction after the jump.
+  size_t jump = chunk().code.size() - pc - 1;
+  if (jump > INT16_MAX) {
+    error("Too much code to jump over.");
+  }
+  chunk().code[pc] =
+      withArgSBx(chunk().code[pc], static_cast<int16_t>(jump));
+}
+
+void Compiler::emitLoop(size_t loop_start) {
+  size_t pc = emitJump(OpCode::JUMP);
+  auto offset = static_cast<ptrdiff_t>(loop_start) -
+                static_cast<ptrdiff_t>(pc + 1);
+  if (offset < INT16_MIN) {
+    error("Loop body too large.");
+  }
+  chunk().code[pc] =
+      withArgSBx(chunk().code[pc], static_cast<int16_t>(offset));
+}
+
+void Compiler::emitReturn() {
+  if (state_->type == FunctionType::Initializer) {
+    emit(encodeABC(OpCode::RETURN, 0, 0, 0)); // init() returns `this`
+  } else {
+    emit(encodeABC(OpCode::RETURN_NIL, 0, 0, 0));
+  }
+}
+
+uint8_t Compiler::makeConstant(Value value) {
+  auto [it, inserted] = state_->constant_indices.try_emplace(
+      value.bits(), static_cast<uint8_t>(chunk().constants.size()));
+  if (!inserted) {
+    return it->second;
+  }
+  if (chunk().constants.size() == kMaxConstants) {
+    error("Too many constants in one chunk.");
+    return 0;
+  }
+  chunk().addConstant(value);
+  return it->second;
+}
+
+// --- Registers and expression results ---
+
+uint8_t Compiler::allocRegister() {
+  int reg = state_->free_register++;
+  if (reg == kMaxRegisters) {
+    error("Function needs too many registers.");
+  }
+  state_->function->max_registers =
+      std::max(state_->function->max_registers, state_->free_register);
+  return static_cast<uint8_t>(reg);
+}
+
+// Emits whatever puts e's value in reg.
+void Compiler::dischargeTo(ExprDesc &e, uint8_t reg) {
+  switch (e.kind) {
+  case ExprDesc::Kind::Nil:
+    emit(encodeABC(OpCode::LOADNIL, reg, 0, 0));
+    break;
+  case ExprDesc::Kind::True:
+    emit(encodeABC(OpCode::LOADTRUE, reg, 0, 0));
+    break;
+  case ExprDesc::Kind::False:
+    emit(encodeABC(OpCode::LOADFALSE, reg, 0, 0));
+    break;
+  case ExprDesc::Kind::Constant:
+    emit(encodeABx(OpCode::LOADK, reg, makeConstant(e.value)));
+    break;
+  case ExprDesc::Kind::Local:
+  case ExprDesc::Kind::Temp:
+    if (e.info != reg) {
+      emit(encodeABC(OpCode::MOVE, reg, static_cast<uint8_t>(e.info), 0));
+    }
+    break;
+  case ExprDesc::Kind::Reloc:
+    chunk().code[e.info] = withArgA(chunk().code[e.info], reg);
+    break;
+  }
+}
+
+// Puts e in a temporary at the top of the register stack.
+uint8_t Compiler::toNextRegister(ExprDesc &e) {
+  if (e.kind == ExprDesc::Kind::Temp) {
+    return static_cast<uint8_t>(e.info);
+  }
+  uint8_t reg = allocRegister();
+  dischargeTo(e, reg);
+  e = ExprDesc{ExprDesc::Kind::Temp, reg};
+  return reg;
+}
+
+uint8_t Compiler::toAnyRegister(ExprDesc &e) {
+  if (e.kind == ExprDesc::Kind::Local) {
+    return static_cast<uint8_t>(e.info);
+  }
+  return toNextRegister(e);
+}
+
+// The constant index of e if it can be a K operand without being loaded.
+std::optional<uint8_t> Compiler::constantOperand(const ExprDesc &e) {
+  switch (e.kind) {
+  case ExprDesc::Kind::Constant:
+    return makeConstant(e.value);
+  case ExprDesc::Kind::Nil:
+    return makeConstant(Value());
+  case ExprDesc::Kind::True:
+    return makeConstant(Value::boolean(true));
+  case ExprDesc::Kind::False:
+    return makeConstant(Value::boolean(false));
+  default:
+    return std::nullopt;
+  }
+}
+
+// The value of an e that isConstant().
+Value Compiler::constantValue(const ExprDesc &e) {
+  switch (e.kind) {
+  case ExprDesc::Kind::True:
+    return Value::boolean(true);
+  case ExprDesc::Kind::False:
+    return Value::boolean(false);
+  case ExprDesc::Kind::Constant:
+    return e.value;
+  default:
+    return Value();
+  }
+}
+
+void Compiler::setConstant(ExprDesc &e, Value value) {
+  if (value.isNil()) {
+    e = ExprDesc{ExprDesc::Kind::Nil};
+  } else if (value.isBool()) {
+    e = ExprDesc{value.asBool() ? ExprDesc::Kind::True
+                                : ExprDesc::Kind::False};
+  } else {
+    e = ExprDesc{ExprDesc::Kind::Constant, 0, value};
+  }
+}
+
+// Removes the code from start on: a branch or operand that can never run. It
+// is still compiled first, so its errors are reported and its scopes
+// balanced, and nothing outside it jumps into it. Constants and property
+// caches first added by that code go with it, so dead code doesn't use up
+// the pool.
+void Compiler::dropCode(const CodeMark &start) {
+  Chunk &code = chunk();
+  code.code.resize(start.code);
+  code.lines.resize(start.code);
+  for (size_t k = start.constants; k < code.constants.size(); ++k) {
+    state_->constant_indices.erase(code.constants[k].bits());
+  }
+  code.constants.resize(start.constants);
+  code.property_caches.resize(start.property_caches);
+}
+
+// Drops an unused result. An instruction computing it still runs, since it
+// may fail, as reading an undefined variable does; a trailing MOVE can't and
+// is removed.
+void Compiler::discard(ExprDesc &e) {
+  if (e.kind != ExprDesc::Kind::Reloc) {
+    return;
+  }
+  if (opOf(chunk().code[e.info]) == OpCode::MOVE &&
+      e.info == chunk().code.size() - 1) {
+    chunk().code.pop_back();
+    chunk().lines.pop_back();
+  } else {
+    toNextRegister(e);
+  }
+}
+
+// Starts compiling the operands right of e. If e is a local, a register is
+// reserved below theirs for protectOperand(): temporaries above it may be
+// overwritten by the frames of calls among those operands.
+Compiler::OperandGuard Compiler::guardOperand(const ExprDesc &e) {
+  OperandGuard guard{chunk().code.size(), side_effects_, 0};
+  if (e.kind == ExprDesc::Kind::Local) {
+    guard.reserved = allocRegister();
+  }
+  return guard;
+}
+
+// Called once the operands right of e are in registers: if they contain a
+// call or a local assignment, e's local may have changed since e was read,
+// as in `a + (a = 1)`, so its value is copied into the reserved register at
+// guard.pc, where e was read. Every jump after guard.pc is relative and
+// within the shifted span, so none needs fixing.
+void Compiler::protectOperand(ExprDesc &e, const OperandGuard &guard) {
+  if (e.kind != ExprDesc::Kind::Local || side_effects_ == guard.side_effects) {
+    return;
+  }
+  Chunk &code = chunk();
+  code.code.insert(code.code.begin() + guard.pc,
+                   encodeABC(OpCode::MOVE, guard.reserved,
+                             static_cast<uint8_t>(e.info), 0));
+  code.lines.insert(code.lines.begin() + guard.pc, tokens_[previous_].line);
+  e.info = guard.reserved;
+}
+
+// --- Functions and scopes ---
+
+void Compiler::beginFunction(FunctionState &state, FunctionType type) {
+  state.enclosing = state_;
+  state.function = heap_.newFunction();
+  state.type = type;
+  state_ = &state;
+  if (type != FunctionType::Script) {
+    state.function->name = heap_.makeString(lexeme(previous_));
+  }
+  // R[0] holds the callee, or `this` in methods.
+  state.locals.push_back(
+      Local{type == FunctionType::Function || type == FunctionType::Script
+                ? std::string_view()
+                : std::string_view("this"),
+            0, false});
+  state.free_register = 1;
+}
+
+ObjFunction *Compiler::endFunction() {
+  emitReturn();
+  ObjFunction *function = state_->function;
+  optimizeJumps(function->chunk);
+  if (options_.superinstructions) {
+    fuseSuperinstructions(function->chunk);
+  }
+  state_ = state_->enclosing;
+  return function;
+}
+
+void Compiler::endScope() {
+  --state_->scope_depth;
+  std::vector<Local> &locals = state_->locals;
+  bool captured = false;
+  while (!locals.empty() && locals.back().depth > state_->scope_depth) {
+    captured |= locals.back().is_captured;
+    locals.pop_back();
+  }
+  // One instruction closes every captured local of the scope.
+  if (captured) {
+    emit(encodeABC(OpCode::CLOSE_UPVALUES,
+                   static_cast<uint8_t>(locals.size()), 0, 0));
+  }
+  resetRegisters();
+}
+
+// --- Variables ---
+
+int Compiler::resolveLocal(FunctionState &state, std::string_view name) {
+  for (int i = static_cast<int>(state.locals.size()) - 1; i >= 0; --i) {
+    const Local &local = state.locals[i];
+    if (local.name == name) {
+      if (local.depth == -1) {
+        error("Can't read local variable in its own initializer.");
+      }
+      return i;
+    }
+  }
+  return -1;
+}
+
+int Compiler::addUpvalue(FunctionState &state, uint8_t index, bool is_local) {
+  std::vector<UpvalueCapture> &captures = state.function->captures;
+  for (size_t i = 0; i < captures.size(); ++i) {
+    if (captures[i].index == index && captures[i].is_local == is_local) {
+      return static_cast<int>(i);
+    }
+  }
+  if (captures.size() == kMaxUpvalues) {
+    error("Too many closure variables in function.");
+    return 0;
+  }
+  captures.push_back(UpvalueCapture{is_local, index});
+  return static_cast<int>(captures.size()) - 1;
+}
+
+int Compiler::resolveUpvalue(FunctionState &state, std::string_view name) {
+  if (state.enclosing == nullptr) {
+    return -1;
+  }
+  if (int local = resolveLocal(*state.enclosing, name); local != -1) {
+    state.enclosing->locals[local].is_captured = true;
+    return addUpvalue(state, static_cast<uint8_t>(local), true);
+  }
+  if (int upvalue = resolveUpvalue(*state.enclosing, name); upvalue != -1) {
+    return addUpvalue(state, static_cast<uint8_t>(upvalue), false);
+  }
+  return -1;
+}
+
+void Compiler::addLocal(std::string_view name) {
+  if (state_->locals.size() == kMaxLocals) {
+    error("Too many local variables in function.");
+    return;
+  }
+  state_->locals.push_back(Local{name, -1, false});
+}
+
+void Compiler::declareVariable() {
+  if (state_->scope_depth == 0) {
+    return; // Globals are late bound
+  }
+  std::string_view name = lexeme(previous_);
+  for (auto it = state_->locals.rbegin(); it != state_->locals.rend(); ++it) {
+    if (it->depth != -1 && it->depth < state_->scope_depth) {
+      break;
+    }
+    if (it->name == name) {
+      error("Already a variable with this name in this scope.");
+    }
+  }
+  addLocal(name);
+}
+
+uint16_t Compiler::globalSlot(std::string_view name) {
+  int slot = globals_.slotOf(heap_.makeString(name));
+  if (slot == -1) {
+    error("Too many global variables.");
+    return 0;
+  }
+  return static_cast<uint16_t>(slot);
+}
+
+uint16_t Compiler::parseVariable(const char *message) {
+  consume(TokenType::IDENTIFIER, message);
+  declareVariable();
+  if (state_->scope_depth > 0) {
+    return 0;
+  }
+  return globalSlot(lexeme(previous_));
+}
+
+void Compiler::markInitialized() {
+  if (state_->scope_depth == 0) {
+    return;
+  }
+  state_->locals.back().depth = state_->scope_depth;
+}
+
+void Compiler::namedVariable(ExprDesc &e, std::string_view name,
+                             bool can_assign) {
+  bool assign = can_assign && match(TokenType::EQUAL);
+  if (int local = resolveLocal(*state_, name); local != -1) {
+    if (assign) {
+      int base = state_->free_register;
+      ExprDesc value;
+      expression(value);
+      dischargeTo(value, static_cast<uint8_t>(local)); // Straight into place
+      state_->free_register = base;
+      ++side_effects_;
+    }
+    e = ExprDesc{ExprDesc::Kind::Local, static_cast<uint32_t>(local)};
+    return;
+  }
+
+  OpCode get_op = OpCode::GET_GLOBAL;
+  OpCode set_op = OpCode::SET_GLOBAL;
+  int arg = resolveUpvalue(*state_, name);
+  if (arg != -1) {
+    get_op = OpCode::GET_UPVALUE;
+    set_op = OpCode::SET_UPVALUE;
+  } else {
+    arg = globalSlot(name);
+    if (assign) {
+      global_functions_.erase(static_cast<uint16_t>(arg));
+    }
+  }
+  if (assign) {
+    // The assignment's value is the value assigned, wherever it is.
+    expression(e);
+    uint8_t reg = toAnyRegister(e);
+    emit(encodeABx(set_op, reg, static_cast<uint16_t>(arg)));
+  } else {
+    e = ExprDesc{ExprDesc::Kind::Reloc,
+                 static_cast<uint32_t>(
+                     emit(encodeABx(get_op, 0, static_cast<uint16_t>(arg))))};
+  }
+}
+
+// Compiles the arguments into the registers after the callee's.
+uint8_t Compiler::argumentList() {
+  int count = 0;
+  if (!check(TokenType::RIGHT_PAREN)) {
+    do {
+      ExprDesc argument;
+      expression(argument);
+      toNextRegister(argument);
+      if (count == 255) {
+        error("Can't have more than 255 arguments.");
+      }
+      ++count;
+    } while (match(TokenType::COMMA));
+  }
+  consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
+  return static_cast<uint8_t>(count);
+}
+
+// --- Declarations and statements ---
+
+void Compiler::declaration() {
+  if (match(TokenType::CLASS)) {
+    classDeclaration();
+  } else if (match(TokenType::FUN)) {
+    funDeclaration();
+  } else if (match(TokenType::VAR)) {
+    varDeclaration();
+  } else {
+    statement();
+  }
+  if (panic_mode_) {
+    synchronize();
+  }
+  resetRegisters();
+}
+
+void Compiler::classDeclaration() {
+  consume(TokenType::IDENTIFIER, "Expect class name.");
+  std::string_view class_name = lexeme(previous_);
+  uint8_t name_constant = nameConstant(class_name);
+  bool is_global = state_->scope_depth == 0;
+  declareVariable();
+  markInitialized();
+
+  // The class body gets a scope for `super`. A global class also needs a
+  // register while its methods are added: an unnamed local in that scope.
+  beginScope();
+  if (is_global) {
+    addLocal("");
+    markInitialized();
+  }
+  auto class_register = static_cast<uint8_t>(state_->locals.size() - 1);
+  resetRegisters();
+  emit(encodeABx(OpCode::CLASS, class_register, name_constant));
+  if (is_global) {
+    uint16_t global = globalSlot(class_name);
+    emit(encodeABx(OpCode::DEFINE_GLOBAL, class_register, global));
+    global_functions_.erase(global);
+  }
+
+  ClassState class_state{class_, false};
+  class_ = &class_state;
+
+  if (match(TokenType::LESS)) {
+    consume(TokenType::IDENTIFIER, "Expect superclass name.");
+    if (class_name == lexeme(previous_)) {
+      error("A class can't inherit from itself.");
+    }
+    // `super` is a local each method closure captures.
+    ExprDesc superclass;
+    variable(superclass, false);
+    addLocal("super");
+    markInitialized();
+    auto super_register = static_cast<uint8_t>(state_->locals.size() - 1);
+    dischargeTo(superclass, super_register);
+    resetRegisters();
+    emit(encodeABC(OpCode::INHERIT, class_register, super_register, 0));
+    class_state.has_superclass = true;
+  }
+
+  consume(TokenType::LEFT_BRACE, "Expect '{' before class body.");
+  while (!check(TokenType::RIGHT_BRACE) && !check(TokenType::END_OF_FILE)) {
+    method(class_register);
+  }
+  consume(TokenType::RIGHT_BRACE, "Expect '}' after class body.");
+
+  endScope();
+  class_ = class_->enclosing;
+}
+
+void Compiler::method(uint8_t class_register) {
+  consume(TokenType::IDENTIFIER, "Expect method name.");
+  uint8_t constant = nameConstant(lexeme(previous_));
+  FunctionType type = lexeme(previous_) == "init" ? FunctionType::Initializer
+                                                  : FunctionType::Method;
+  uint8_t closure = function(type);
+  emit(encodeABC(OpCode::METHOD, class_register, constant, closure));
+  resetRegisters();
+}
+
+void Compiler::funDeclaration() {
+  uint16_t global = parseVariable("Expect function name.");
+  markInitialized(); // A function may refer to itself
+  // A local function's closure lands in its own register, the next free one.
+  uint8_t closure = function(FunctionType::Function);
+  if (state_->scope_depth == 0) {
+    // The function is the constant of the CLOSURE just emitted.
+    global_functions_[global] =
+        asFunction(chunk().constants[argBx(chunk().code.back())]);
+    emit(encodeABx(OpCode::DEFINE_GLOBAL, closure, global));
+  }
+}
+
+// Compiles a function body and emits the CLOSURE that creates it into the
+// next free register, which is returned.
+uint8_t Compiler::function(FunctionType type) {
+  FunctionState state;
+  beginFunction(state, type);
+  beginScope();
+
+  consume(TokenType::LEFT_PAREN, "Expect '(' after function name.");
+  if (!check(TokenType::RIGHT_PAREN)) {
+    do {
+      ++state.function->arity;
+      if (state.function->arity > 255) {
+        errorAt(current_, "Can't have more than 255 parameters.");
+      }
+      parseVariable("Expect parameter name.");
+      markInitialized();
+    } while (match(TokenType::COMMA));
+  }
+  resetRegisters();
+  consume(TokenType::RIGHT_PAREN, "Expect ')' after parameters.");
+  consume(TokenType::LEFT_BRACE, "Expect '{' before function body.");
+  block();
+
+  // No endScope(): the frame's registers are discarded on return.
+  ObjFunction *function = endFunction();
+  uint8_t reg = allocRegister();
+  emit(encodeABx(OpCode::CLOSURE, reg,
+                 makeConstant(Value::object(function))));
+  return reg;
+}
+
+void Compiler::varDeclaration() {
+  uint16_t global = parseVariable("Expect variable name.");
+  ExprDesc value; // nil without an initializer
+  if (match(TokenType::EQUAL)) {
+    expression(value);
+  }
+  consume(TokenType::SEMICOLON, "Expect ';' after variable declaration.");
+  if (state_->scope_depth > 0) {
+    // The new local's register is the first free one, where the
+    // initializer's temporaries started.
+    dischargeTo(value, static_cast<uint8_t>(state_->locals.size() - 1));
+    markInitialized();
+  } else {
+    emit(encodeABx(OpCode::DEFINE_GLOBAL, toAnyRegister(value), global));
+    global_functions_.erase(global);
+  }
+}
+
+void Compiler::statement() {
+  if (match(TokenType::PRINT)) {
+    printStatement();
+  } else if (match(TokenType::FOR)) {
+    forStatement();
+  } else if (match(TokenType::IF)) {
+    ifStatement();
+  } else if (match(TokenType::RETURN)) {
+    returnStatement();
+  } else if (match(TokenType::WHILE)) {
+    whileStatement();
+  } else if (match(TokenType::LEFT_BRACE)) {
+    beginScope();
+    block();
+    endScope();
+  } else {
+    expressionStatement();
+  }
+}
+
+void Compiler::printStatement() {
+  ExprDesc value;
+  expression(value);
+  consume(TokenType::SEMICOLON, "Expect ';' after value.");
+  emit(encodeABC(OpCode::PRINT, toAnyRegister(value), 0, 0));
+}
+
+void Compiler::returnStatement() {
+  if (state_->type == FunctionType::Script) {
+    error("Can't return from top-level code.");
+  }
+  if (match(TokenType::SEMICOLON)) {
+    emitReturn();
+    return;
+  }
+  if (state_->type == FunctionType::Initializer) {
+    error("Can't return a value from an initializer.");
+  }
+  ExprDesc value;
+  expression(value);
+  consume(TokenType::SEMICOLON, "Expect ';' after return value.");
+  emit(encodeABC(OpCode::RETURN, toAnyRegister(value), 0, 0));
+}
+
+void Compiler::ifStatement() {
+  consume(TokenType::LEFT_PAREN, "Expect '(' after 'if'.");
+  ExprDesc condition;
+  expression(condition);
+  consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
+
+  if (condition.isConstant()) {
+    // Only one branch can run.
+    bool truthy = !constantValue(condition).isFalsey();
+    CodeMark then_start = mark();
+    statement();
+    if (!truthy) {
+      dropCode(then_start);
+    }
+    if (match(TokenType::ELSE)) {
+      CodeMark else_start = mark();
+      statement();
+      if (truthy) {
+        dropCode(else_start);
+      }
+    }
+    return;
+  }
+
+  size_t then_jump = emitJumpIfFalse(condition);
+  resetRegisters();
+  statement();
+  if (match(TokenType::ELSE)) {
+    size_t else_jump = emitJump(OpCode::JUMP);
+    patchJump(then_jump);
+    statement();
+    patchJump(else_jump);
+  } else {
+    patchJump(then_jump);
+  }
+}
+
+void Compiler::whileStatement() {
+  CodeMark start = mark();
+  size_t loop_start = start.code;
+  consume(TokenType::LEFT_PAREN, "Expect '(' after 'while'.");
+  ExprDesc condition;
+  expression(condition);
+  consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
+
+  if (condition.isConstant()) {
+    // Either an infinite loop, needing no test, or one that never runs.
+    statement();
+    if (constantValue(condition).isFalsey()) {
+      dropCode(start);
+    } else {
+      emitLoop(loop_start);
+    }
+    return;
+  }
+
+  size_t exit_jump = emitJumpIfFalse(condition);
+  resetRegisters();
+  statement();
+  emitLoop(loop_start);
+  patchJump(exit_jump);
+}
+
+void Compiler::forStatement() {
+  beginScope();
+  consume(TokenType::LEFT_PAREN, "Expect '(' after 'for'.");
+  if (match(TokenType::SEMICOLON)) {
+    // No initializer
+  } else if (match(TokenType::VAR)) {
+    varDeclaration();
+  } else {
+    expressionStatement();
+  }
+  resetRegisters();
+
+  CodeMark condition_start = mark();
+  size_t loop_start = condition_start.code;
+  std::optional<size_t> exit_jump;
+  bool never_runs = false; // The condition is a falsey constant
+  if (!match(TokenType::SEMICOLON)) {
+    ExprDesc condition;
+    expression(condition);
+    consume(TokenType::SEMICOLON, "Expect ';' after loop condition.");
+    if (condition.isConstant()) {
+      never_runs = constantValue(condition).isFalsey();
+    } else {
+      exit_jump = emitJumpIfFalse(condition);
+    }
+    resetRegisters();
+  }
+
+  // The increment is compiled before the body but runs after it: jump over
+  // it into the body, and loop back to it from the body's end.
+  if (!match(TokenType::RIGHT_PAREN)) {
+    size_t body_jump = emitJump(OpCode::JUMP);
+    size_t increment_start = chunk().code.size();
+    ExprDesc increment;
+    expression(increment);
+    discard(increment);
+    resetRegisters();
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after for clauses.");
+
+    emitLoop(loop_start);
+    loop_start = increment_start;
+    patchJump(body_jump);
+  }
+
+  statement();
+  emitLoop(loop_start);
+
+  if (exit_jump) {
+    patchJump(*exit_jump);
+  }
+  if (never_runs) {
+    dropCode(condition_start);
+  }
+  endScope();
+}
+
+void Compiler::block() {
+  while (!check(TokenType::RIGHT_BRACE) && !check(TokenType::END_OF_FILE)) {
+    declaration();
+  }
+  consume(TokenType::RIGHT_BRACE, "Expect '}' after block.");
+}
+
+void Compiler::expressionStatement() {
+  ExprDesc value;
+  expression(value);
+  discard(value);
+  consume(TokenType::SEMICOLON, "Expect ';' after expression.");
+}
+
+// --- Expressions ---
+
+void Compiler::parsePrecedence(Precedence precedence, ExprDesc &e) {
+  advance();
+  ParseFn prefix = ruleFor(previousType()).prefix;
+  if (prefix == nullptr) {
+    error("Expect expression.");
+    return;
+  }
+  // Only the loosest binding context may treat a following '=' as
+  // assignment; `a + b = c` must not compile as `a + (b = c)`.
+  bool can_assign = precedence <= Precedence::Assignment;
+  (this->*prefix)(e, can_assign);
+
+  while (precedence <= ruleFor(peekType()).precedence) {
+    advance();
+    (this->*ruleFor(previousType()).infix)(e, can_assign);
+  }
+
+  if (can_assign && match(TokenType::EQUAL)) {
+    error("Invalid assignment target.");
+  }
+}
+
+void Compiler::number(ExprDesc &e, bool) {
+  // The literal was validated when the file was scanned.
+  e = ExprDesc{ExprDesc::Kind::Constant, 0,
+               Value::number(scanner_.numberValue(previous_).value_or(0))};
+}
+
+void Compiler::string(ExprDesc &e, bool) {
+  e = ExprDesc{ExprDesc::Kind::Constant, 0,
+               Value::object(heap_.makeString(
+                   scanner_.stringValue(tokens_[previous_])))};
+}
+
+void Compiler::literal(ExprDesc &e, bool) {
+  switch (previousType()) {
+  case TokenType::FALSE:
+    e.kind = ExprDesc::Kind::False;
+    break;
+  case TokenType::TRUE:
+    e.kind = ExprDesc::Kind::True;
+    break;
+  default:
+    e.kind = ExprDesc::Kind::Nil;
+    break;
+  }
+}
+
+void Compiler::grouping(ExprDesc &e, bool) {
+  expression(e);
+  consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
+}
+
+void Compiler::unary(ExprDesc &e, bool) {
+  TokenType op = previousType();
+  int base = state_->free_register;
+  parsePrecedence(Precedence::Unary, e);
+  if (e.isConstant()) {
+    Value value = constantValue(e);
+    if (op == TokenType::BANG) {
+      setConstant(e, Value::boolean(value.isFalsey()));
+      return;
+    }
+    if (value.isNumber()) {
+      setConstant(e, Value::number(-value.asNumber()));
+      return;
+    }
+  }
+  uint8_t operand = toAnyRegister(e);
+  state_->free_register = base;
+  OpCode opcode = op == TokenType::MINUS ? OpCode::NEGATE : OpCode::NOT;
+  e = ExprDesc{ExprDesc::Kind::Reloc, static_cast<uint32_t>(emit(
+                                          encodeABC(opcode, 0, operand, 0)))};
+}
+
+void Compiler::binary(ExprDesc &e, bool) {
+  TokenType op = previousType();
+  int base = e.kind == ExprDesc::Kind::Temp ? static_cast<int>(e.info)
+                                            : state_->free_register;
+  OperandGuard guard = guardOperand(e);
+  // A constant stays one until the right operand shows whether they fold.
+  if (e.kind != ExprDesc::Kind::Local && !e.isConstant()) {
+    toAnyRegister(e);
+  }
+
+  // Left-associative: the right operand binds one level tighter.
+  ExprDesc right;
+  parsePrecedence(static_cast<Precedence>(
+                      static_cast<uint8_t>(ruleFor(op).precedence) + 1),
+                  right);
+  if (e.isConstant() && right.isConstant()) {
+    if (std::optional<Value> folded = foldBinary(
+            op, constantValue(e), constantValue(right), heap_)) {
+      setConstant(e, *folded);
+      return;
+    }
+  }
+  std::optional<uint8_t> constant = constantOperand(right);
+  uint8_t c = constant ? *constant : toAnyRegister(right);
+  uint8_t b;
+  std::optional<TokenType> mirrored = mirroredOperator(op);
+  if (e.isConstant() && !constant && mirrored &&
+      (constant = constantOperand(e))) {
+    // `1 < x` runs as `x > 1`, so the constant needn't be loaded.
+    op = *mirrored;
+    b = c;
+    c = *constant;
+  } else {
+    if (e.isConstant()) {
+      toAnyRegister(e); // Loading a constant can't change the right operand
+    }
+    protectOperand(e, guard);
+    b = static_cast<uint8_t>(e.info);
+  }
+
+  struct Opcodes {
+    OpCode registers;
+    OpCode constant;
+  };
+  Opcodes opcodes;
+  switch (op) {
+  case TokenType::BANG_EQUAL:
+    opcodes = {OpCode::NOT_EQUAL, OpCode::NOT_EQUAL_K};
+    break;
+  case TokenType::EQUAL_EQUAL:
+    opcodes = {OpCode::EQUAL, OpCode::EQUAL_K};
+    break;
+  case TokenType::GREATER:
+    opcodes = {OpCode::GREATER, OpCode::GREATER_K};
+    break;
+  case TokenType::GREATER_EQUAL:
+    opcodes = {OpCode::GREATER_EQUAL, OpCode::GREATER_EQUAL_K};
+    break;
+  case TokenType::LESS:
+    opcodes = {OpCode::LESS, OpCode::LESS_K};
+    break;
+  case TokenType::LESS_EQUAL:
+    opcodes = {OpCode::LESS_EQUAL, OpCode::LESS_EQUAL_K};
+    break;
+  case TokenType::PLUS:
+    opcodes = {OpCode::ADD, OpCode::ADD_K};
+    break;
+  case TokenType::MINUS:
+    opcodes = {OpCode::SUBTRACT, OpCode::SUBTRACT_K};
+    break;
+  case TokenType::STAR:
+    opcodes = {OpCode::MULTIPLY, OpCode::MULTIPLY_K};
+    break;
+  default:
+    opcodes = {OpCode::DIVIDE, OpCode::DIVIDE_K};
+    break;
+  }
+
+  state_->free_register = base;
+  e = ExprDesc{ExprDesc::Kind::Reloc,
+               static_cast<uint32_t>(emit(encodeABC(
+                   constant ? opcodes.constant : opcodes.registers, 0, b,
+                   c)))};
+}
+
+void Compiler::andExpr(ExprDesc &e, bool) {
+  if (e.isConstant()) {
+    shortCircuitConstant(e, Precedence::And,
+                         constantValue(e).isFalsey());
+    return;
+  }
+  // The result register holds the left operand; if that is falsey it is the
+  // result, otherwise the right operand overwrites it.
+  uint8_t reg = toNextRegister(e);
+  size_t end_jump = emitJump(OpCode::JUMP_IF_FALSE, reg);
+  state_->free_register = reg;
+  ExprDesc right;
+  parsePrecedence(Precedence::And, right);
+  dischargeTo(right, reg);
+  state_->free_register = reg + 1;
+  patchJump(end_jump);
+  e = ExprDesc{ExprDesc::Kind::Temp, reg};
+}
+
+void Compiler::orExpr(ExprDesc &e, bool) {
+  if (e.isConstant()) {
+    shortCircuitConstant(e, Precedence::Or, !constantValue(e).isFalsey());
+    return;
+  }
+  uint8_t reg = toNextRegister(e);
+  size_t end_jump = emitJump(OpCode::JUMP_IF_TRUE, reg);
+  state_->free_register = reg;
+  ExprDesc right;
+  parsePrecedence(Precedence::Or, right);
+  dischargeTo(right, reg);
+  state_->free_register = reg + 1;
+  patchJump(end_jump);
+  e = ExprDesc{ExprDesc::Kind::Temp, reg};
+}
+
+// `and`/`or` with a constant left operand e: it is the result if
+// short_circuits, and the right operand, whose code is then dropped, is not
+// evaluated; otherwise the right operand is the result.
+void Compiler::shortCircuitConstant(ExprDesc &e, Precedence precedence,
+                                    bool short_circuits) {
+  int base = state_->free_register;
+  CodeMark right_start = mark();
+  ExprDesc right;
+  parsePrecedence(precedence, right);
+  if (short_circuits) {
+    dropCode(right_start);
+    state_->free_register = base;
+  } else {
+    e = right;
+  }
+}
+
+void Compiler::variable(ExprDesc &e, bool can_assign) {
+  namedVariable(e, lexeme(previous_), can_assign);
+}
+
+void Compiler::thisExpr(ExprDesc &e, bool) {
+  if (class_ == nullptr) {
+    error("Can't use 'this' outside of a class.");
+    return;
+  }
+  namedVariable(e, "this", false);
+}
+
+void Compiler::superExpr(ExprDesc &e, bool) {
+  if (class_ == nullptr) {
+    error("Can't use 'super' outside of a class.");
+  } else if (!class_->has_superclass) {
+    error("Can't use 'super' in a class with no superclass.");
+  }
+  consume(TokenType::DOT, "Expect '.' after 'super'.");
+  consume(TokenType::IDENTIFIER, "Expect superclass method name.");
+  uint8_t name = nameConstant(lexeme(previous_));
+
+  namedVariable(e, "this", false);
+  uint8_t base = toNextRegister(e);
+  ExprDesc superclass;
+  if (match(TokenType::LEFT_PAREN)) {
+    uint8_t arg_count = argumentList();
+    namedVariable(superclass, "super", false);
+    toNextRegister(superclass);
+    emit(encodeABC(OpCode::SUPER_INVOKE, base, name, arg_count));
+    ++side_effects_;
+  } else {
+    namedVariable(superclass, "super", false);
+    toNextRegister(superclass);
+    emit(encodeABC(OpCode::GET_SUPER, base, name, 0));
+  }
+  state_->free_register = base + 1;
+}
+
+void Compiler::call(ExprDesc &e, bool) {
+  std::optional<uint16_t> global;
+  if (e.kind == ExprDesc::Kind::Reloc &&
+      opOf(chunk().code[e.info]) == OpCode::GET_GLOBAL) {
+    global = argBx(chunk().code[e.info]);
+  }
+  uint8_t base = toNextRegister(e);
+  uint8_t arg_count = argumentList();
+  if (!global || !inlineCall(*global, base, arg_count)) {
+    emit(encodeABC(OpCode::CALL, base, arg_count, 0));
+  }
+  ++side_effects_;
+  state_->free_register = base + 1;
+}
+
+// Compiles a call to a global whose function is known and small as a copy of
+// that function's body, run in the registers its frame would have had, from
+// R[base] on. The copy is guarded: if the global holds anything else by the
+// time the call runs, it is called as usual instead.
+//
+//       JUMP_IF_FUNCTION base, K[function], 2
+//       CALL base, arg_count
+//       JUMP done
+//       <body; each return moves its value to R[base] and jumps to done>
+//   done:
+//
+// Only leaf-like functions are copied: no closures, upvalues or classes, and
+// no calls to themselves. Runtime errors in the copy report the function's
+// own lines, as they would from its frame. Returns false, having emitted
+// nothing, if the call is not inlined.
+bool Compiler::inlineCall(uint16_t global, uint8_t base, uint8_t arg_count) {
+  auto it = global_functions_.find(global);
+  if (it == global_functions_.end()) {
+    return false;
+  }
+  ObjFunction *function = it->second;
+  const Chunk &body = function->chunk;
+  if (function->arity != arg_count || !function->captures.empty() ||
+      body.code.size() > kMaxInlineSize ||
+      base + function->max_registers > kMaxRegisters ||
+      chunk().constants.size() + body.constants.size() >= kMaxConstants) {
+    return false;
+  }
+  std::vector<bool> targets(body.code.size(), false);
+  for (size_t pc = 0; pc < body.code.size();
+       pc += instructionLength(unfusedOpCode(opOf(body.code[pc])))) {
+    OpCode op = unfusedOpCode(opOf(body.code[pc]));
+    if (!inlinable(op) ||
+        (op == OpCode::GET_GLOBAL && argBx(body.code[pc]) == global)) {
+      return false;
+    }
+    if (branches(op)) {
+      targets[jumpTarget(body.code, pc)] = true;
+    }
+  }
+
+  uint8_t k = makeConstant(Value::object(function));
+  emit(encodeABC(OpCode::JUMP_IF_FUNCTION, base, k, 2));
+  emit(encodeABC(OpCode::CALL, base, arg_count, 0));
+  std::vector<size_t> exits{emitJump(OpCode::JUMP)};
+
+  // Where each instruction of the body starts in the copy, and the copied
+  // branches with the body pc they go to.
+  std::vector<size_t> copied_pc(body.code.size());
+  std::vector<std::pair<size_t, size_t>> branch_targets;
+  // The previous instruction of the body, and where its copy starts.
+  OpCode last_op = OpCode::COUNT;
+  size_t last = 0;
+  auto shift = [base](uint8_t reg) { return static_cast<uint8_t>(base + reg); };
+  auto constant = [&](uint8_t index) {
+    return makeConstant(body.constants[index]);
+  };
+  for (size_t pc = 0; pc < body.code.size();) {
+    Instruction i = body.code[pc];
+    OpCode op = unfusedOpCode(opOf(i));
+    int line = body.lines[pc];
+    copied_pc[pc] = chunk().code.size();
+    uint8_t a = shift(argA(i));
+    switch (op) {
+    case OpCode::RETURN:
+      // Usually the instruction before computed the result for the return
+      // alone, so it can put it in R[base] itself.
+      if (!targets[pc] && setsOnlyA(last_op) &&
+          argA(chunk().code[last]) == a) {
+        chunk().code[last] = withArgA(chunk().code[last], base);
+      } else {
+        chunk().write(encodeABC(OpCode::MOVE, base, a, 0), line);
+      }
+      exits.push_back(chunk().write(encodeAsBx(OpCode::JUMP, 0, 0), line));
+      break;
+    case OpCode::RETURN_NIL:
+      chunk().write(encodeABC(OpCode::LOADNIL, base, 0, 0), line);
+      exits.push_back(chunk().write(encodeAsBx(OpCode::JUMP, 0, 0), line));
+      break;
+    case OpCode::JUMP:
+    case OpCode::JUMP_IF_FALSE:
+    case OpCode::JUMP_IF_TRUE:
+      branch_targets.emplace_back(
+          chunk().write(encodeAsBx(op, op == OpCode::JUMP ? 0 : a, 0), line),
+          jumpTarget(body.code, pc));
+      break;
+    case OpCode::JUMP_IF_FUNCTION:
+      branch_targets.emplace_back(
+          chunk().write(encodeABC(op, a, constant(argB(i)), 0), line),
+          jumpTarget(body.code, pc));
+      break;
+    case OpCode::LOADK:
+      chunk().write(encodeABx(op, a, constant(static_cast<uint8_t>(argBx(i)))),
+                    line);
+      break;
+    case OpCode::LOADNIL:
+    case OpCode::LOADTRUE:
+    case OpCode::LOADFALSE:
+    case OpCode::PRINT:
+      chunk().write(encodeABC(op, a, 0, 0), line);
+      break;
+    case OpCode::GET_GLOBAL:
+    case OpCode::SET_GLOBAL:
+      chunk().write(encodeABx(op, a, argBx(i)), line);
+      break;
+    case OpCode::CALL:
+      chunk().write(encodeABC(op, a, argB(i), 0), line);
+      break;
+    case OpCode::GET_PROPERTY:
+      chunk().write(encodeABC(op, a, shift(argB(i)), constant(argC(i))),
+                    line);
+      break;
+    case OpCode::SET_PROPERTY:
+      chunk().write(encodeABC(op, a, constant(argB(i)), shift(argC(i))),
+                    line);
+      break;
+    case OpCode::INVOKE:
+      chunk().write(encodeABC(op, a, constant(argB(i)), argC(i)), line);
+      break;
+    case OpCode::MOVE:
+    case OpCode::NOT:
+    case OpCode::NEGATE:
+      chunk().write(encodeABC(op, a, shift(argB(i)), 0), line);
+      break;
+    case OpCode::EQUAL_K:
+    case OpCode::NOT_EQUAL_K:
+    case OpCode::GREATER_K:
+    case OpCode::GREATER_EQUAL_K:
+    case OpCode::LESS_K:
+    case OpCode::LESS_EQUAL_K:
+    case OpCode::ADD_K:
+    case OpCode::SUBTRACT_K:
+    case OpCode::MULTIPLY_K:
+    case OpCode::DIVIDE_K:
+      chunk().write(encodeABC(op, a, shift(argB(i)), constant(argC(i))),
+                    line);
+      break;
+    default: // The binary operators on two registers
+      chunk().write(encodeABC(op, a, shift(argB(i)), shift(argC(i))), line);
+      break;
+    }
+    if (instructionLength(op) == 2) {
+      chunk().write(chunk().addPropertyCache(), body.lines[pc + 1]);
+    }
+    last_op = op;
+    last = copied_pc[pc];
+    pc += instructionLength(op);
+  }
+
+  for (auto [pc, target] : branch_targets) {
+    auto offset = static_cast<ptrdiff_t>(copied_pc[target]) -
+                  static_cast<ptrdiff_t>(pc) - 1;
+    chunk().code[pc] = withJumpOffset(chunk().code[pc], offset);
+  }
+  for (size_t pc : exits) {
+    patchJump(pc);
+  }
+  state_->function->max_registers = std::max(
+      state_->function->max_registers, base + function->max_registers);
+  return true;
+}
+
+void Compiler::dot(ExprDesc &e, bool can_assign) {
+  consume(TokenType::IDENTIFIER, "Expect property name after '.'.");
+  uint8_t name = nameConstant(lexeme(previous_));
+  int base = e.kind == ExprDesc::Kind::Temp ? static_cast<int>(e.info)
+                                            : state_->free_register;
+
+  if (can_assign && match(TokenType::EQUAL)) {
+    OperandGuard guard = guardOperand(e);
+    if (e.kind != ExprDesc::Kind::Local) {
+      toAnyRegister(e);
+    }
+    ExprDesc value;
+    expression(value);
+    uint8_t value_register = toAnyRegister(value);
+    protectOperand(e, guard);
+    emitCached(encodeABC(OpCode::SET_PROPERTY, static_cast<uint8_t>(e.info),
+                         name, value_register));
+    state_->free_register = base;
+    // The value is the result. A temporary one sits above the object, so it
+    // is moved down to wherever the result is wanted; as a statement, the
+    // MOVE is dropped again.
+    if (value.kind == ExprDesc::Kind::Temp) {
+      value = ExprDesc{ExprDesc::Kind::Reloc,
+                       static_cast<uint32_t>(emit(encodeABC(
+                           OpCode::MOVE, 0, value_register, 0)))};
+    }
+    e = value;
+  } else if (match(TokenType::LEFT_PAREN)) {
+    // obj.method(args) calls the method without creating a bound method.
+    uint8_t receiver = toNextRegister(e);
+    uint8_t arg_count = argumentList();
+    emitCached(encodeABC(OpCode::INVOKE, receiver, name, arg_count));
+    ++side_effects_;
+    state_->free_register = receiver + 1;
+  } else {
+    uint8_t object = toAnyRegister(e);
+    state_->free_register = base;
+    e = ExprDesc{ExprDesc::Kind::Reloc,
+                 static_cast<uint32_t>(emitCached(
+                     encodeABC(OpCode::GET_PROPERTY, 0, object, name)))};
+  }
+}
+
+} // namespace
+
+ObjFunction *compileProgram(Scanner &scanner, Heap &heap, Globals &globals,
+                            std::vector<ParseDiagnostic> &diagnostics,
+                            const CompileOptions &options) {
+  return Compiler(scanner, heap, globals, diagnostics, options)
+      .compileScript();
+}
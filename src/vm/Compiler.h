@@ -0,0 +1,41 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <vector>
+
+#include "parser/Parser.h" // For ParseDiagnostic
+#include "runtime/Heap.h"
+#include "scanner/Scanner.h"
+#include "vm/Globals.h"
+
+// Compiles a whole program to bytecode in a single pass, clox-style: it reads
+// the Scanner's token buffer directly and emits instructions as it parses,
+// with no AST in between. Local variables are resolved to stack slots,
+// captured variables to upvalue indices and globals to slots in globals as
+// they are compiled. Operators on constants are folded, as far as they would
+// not fail at run time, and code that a constant condition rules out (an
+// untaken branch, a `while (false)` body, the right operand of `false and`)
+// is dropped. A call to a small function declared by a top-level `fun` is
+// compiled as a copy of its body, guarded to make the call after all if the
+// global has been reassigned by the time it runs.
+//
+// Each finished function then gets a peephole pass: jumps to jumps are
+// threaded to the final target, code no path reaches is removed, and so are
+// jumps that only skip removed code. Hot instruction pairs are then fused
+// into superinstructions (see Chunk.h) unless options turn that off.
+//
+// Returns the top-level script function, or nullptr if there were syntax or
+// resolution errors; those are appended to diagnostics (after each one the
+// compiler resynchronizes at the next statement, as the Parser does).
+// Functions and constants are allocated in heap.
+struct CompileOptions {
+  // Off when profiling opcode pairs, so the profile is of the base
+  // instruction set.
+  bool superinstructions = true;
+};
+
+ObjFunction *compileProgram(Scanner &scanner, Heap &heap, Globals &globals,
+                            std::vector<ParseDiagnostic> &diagnostics,
+                            const CompileOptions &options = {});
+
+#endif // COMPILER_H
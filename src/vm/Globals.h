@@ -0,0 +1,56 @@
+#ifndef GLOBALS_H
+#define GLOBALS_H
+
+#include <cstdint>
+#include <vector>
+
+#include "runtime/Heap.h"
+#include "runtime/Table.h"
+#include "runtime/Value.h"
+
+// The VM's global variables, each in a fixed slot. The compiler gives a name
+// its slot the first time it compiles a declaration of or reference to it, so
+// GET_GLOBAL, SET_GLOBAL and DEFINE_GLOBAL index an array instead of hashing
+// the name. Globals are late bound: a slot holds Value::undefined() until its
+// DEFINE_GLOBAL runs, and reading or assigning it before then is an error.
+class Globals {
+public:
+  // Slots are a 16-bit Bx operand.
+  static constexpr size_t kMaxSlots = UINT16_MAX + 1;
+
+  // The slot of the global named name, assigned if it has none yet, or -1
+  // if every slot is taken.
+  int slotOf(ObjString *name) {
+    Value slot;
+    if (slots_.get(name, slot)) {
+      return static_cast<int>(slot.asNumber());
+    }
+    if (names_.size() == kMaxSlots) {
+      return -1;
+    }
+    slots_.set(name, Value::number(static_cast<double>(names_.size())));
+    names_.push_back(name);
+    values_.push_back(Value::undefined());
+    return static_cast<int>(names_.size() - 1);
+  }
+
+  Value &operator[](uint32_t slot) { return values_[slot]; }
+  ObjString *name(uint32_t slot) const { return names_[slot]; }
+
+  void mark(Heap &heap) {
+    heap.markTable(slots_);
+    for (ObjString *&name : names_) {
+      heap.markObject(name);
+    }
+    for (Value &value : values_) {
+      heap.markValue(value);
+    }
+  }
+
+private:
+  Table slots_; // Name to slot index, as a number
+  std::vector<ObjString *> names_;
+  std::vector<Value> values_;
+};
+
+#endif // GLOBALS_H
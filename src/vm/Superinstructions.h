@@ -0,0 +1,18 @@
+// Generated by bench/superinstructions.sh from bench/profiles; do not edit.
+#ifndef SUPERINSTRUCTIONS_H
+#define SUPERINSTRUCTIONS_H
+
+// Fused opcode pairs, hottest first, with their share of dispatches.
+#define LOX_SUPERINSTRUCTIONS(X)                                               \
+  X(LESS_K, JUMP_IF_FALSE) /* 10.9% */                                         \
+  X(ADD_K, JUMP) /* 5.7% */                                                    \
+  X(SUBTRACT_K, CALL) /* 3.8% */                                               \
+  X(GET_GLOBAL, SUBTRACT_K) /* 3.8% */                                         \
+  X(MULTIPLY_K, ADD) /* 3.1% */                                                \
+  X(ADD, JUMP) /* 3.1% */                                                      \
+  X(ADD, RETURN) /* 1.9% */                                                    \
+  X(SUBTRACT, GREATER_EQUAL_K) /* 1.9% */                                      \
+  X(GREATER_EQUAL_K, JUMP_IF_FALSE) /* 1.9% */                                 \
+  X(NOT_EQUAL_K, JUMP_IF_FALSE) /* 1.6% */                                     \
+
+#endif // SUPERINSTRUCTIONS_H
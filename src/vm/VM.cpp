@@ -0,0 +1,819 @@
+#include "VM.h"
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <print>
+
+#if defined(__GNUC__) && !defined(LOX_SWITCH_DISPATCH)
+#define LOX_COMPUTED_GOTO 1
+#endif
+
+namespace {
+
+// Output is buffered and written in chunks of about this size.
+constexpr size_t kOutputFlushSize = 64 * 1024;
+
+Value clockNative(int, Value *) {
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+  return Value::number(std::chrono::duration<double>(now).count());
+}
+
+} // namespace
+
+VM::VM()
+    : stack_(std::make_unique<Value[]>(kStackMax)), stack_top_(stack_.get()),
+      init_string_(heap_.makeString("init")) {
+  defineNative("clock", clockNative);
+}
+
+std::optional<RuntimeError> VM::run(ObjFunction *script) {
+  stack_top_ = stack_.get();
+  frame_count_ = 0;
+  open_upvalues_ = nullptr;
+  error_.reset();
+
+  ObjClosure *closure = heap_.newClosure(script);
+  stack_[0] = Value::object(closure);
+  if (call(closure, stack_.get(), 0)) {
+    execute();
+  }
+  flushOutput();
+  return std::move(error_);
+}
+
+bool VM::execute() {
+  // The innermost frame's ip, registers and constants live in locals so the
+  // compiler can keep them in machine registers; frame->ip is only written
+  // back before anything that may report an error or push a frame.
+  CallFrame *frame;
+  Instruction *ip; // Writable, for quickening
+  Value *slots;
+  const Value *constants;
+  PropertyCache *caches;
+  Instruction instruction;
+
+#define LOAD_FRAME()                                                           \
+  do {                                                                         \
+    frame = &frames_[frame_count_ - 1];                                        \
+    ip = frame->ip;                                                            \
+    slots = frame->slots;                                                      \
+    constants = frame->closure->function->chunk.constants.data();              \
+    caches = frame->closure->function->chunk.property_caches.data();           \
+  } while (false)
+#define SAVE_IP() (frame->ip = ip)
+#define RA slots[argA(instruction)]
+#define RB slots[argB(instruction)]
+#define RC slots[argC(instruction)]
+#define KB constants[argB(instruction)]
+#define KC constants[argC(instruction)]
+#define KBX constants[argBx(instruction)]
+// The inline cache of a property instruction, from the word after it.
+#define CACHE() caches[*ip++]
+#define FAIL(...)                                                              \
+  do {                                                                         \
+    SAVE_IP();                                                                 \
+    runtimeError(std::format(__VA_ARGS__));                                    \
+    return false;                                                              \
+  } while (false)
+// Only used once the allocating instruction's result is in its register.
+#define SAFEPOINT()                                                            \
+  do {                                                                         \
+    if (heap_.shouldCollect()) {                                               \
+      collectGarbage();                                                        \
+    }                                                                          \
+  } while (false)
+#define NUMERIC_OP(make, op, rhs)                                              \
+  do {                                                                         \
+    Value left = RB;                                                           \
+    Value right = rhs;                                                         \
+    if (!left.isNumber() || !right.isNumber()) {                               \
+      FAIL("Operands must be numbers.");                                       \
+    }                                                                          \
+    RA = make(left.asNumber() op right.asNumber());                            \
+  } while (false)
+#define ADD_OP(rhs)                                                            \
+  do {                                                                         \
+    Value left = RB;                                                           \
+    Value right = rhs;                                                         \
+    if (left.isNumber() && right.isNumber()) {                                 \
+      RA = Value::number(left.asNumber() + right.asNumber());                  \
+    } else if (isString(left) && isString(right)) {                            \
+      RA = Value::object(heap_.concatenate(asString(left), asString(right)));  \
+      SAFEPOINT();                                                             \
+    } else {                                                                   \
+      FAIL("Operands must be two numbers or two strings.");                    \
+    }                                                                          \
+  } while (false)
+#ifdef LOX_VM_STATS
+  uint8_t previous_op = 0;
+#define COUNT_DISPATCH()                                                       \
+  do {                                                                         \
+    auto op = static_cast<uint8_t>(emittedOpCode(opOf(instruction)));         \
+    if (dispatch_count_++ != 0) {                                              \
+      ++(*pair_counts_)[previous_op][op];                                      \
+    }                                                                          \
+    previous_op = op;                                                          \
+  } while (false)
+#else
+#define COUNT_DISPATCH() ((void)0)
+#endif
+
+  // The work of every opcode that always goes on to the next instruction,
+  // shared by its handler and the superinstructions that begin with it.
+#define BODY_MOVE() (RA = RB)
+#define BODY_LOADK() (RA = KBX)
+#define BODY_LOADNIL() (RA = Value())
+#define BODY_LOADTRUE() (RA = Value::boolean(true))
+#define BODY_LOADFALSE() (RA = Value::boolean(false))
+#define BODY_GET_GLOBAL()                                                      \
+  do {                                                                         \
+    Value value = globals_[argBx(instruction)];                                \
+    if (value.isUndefined()) {                                                 \
+      FAIL("Undefined variable '{}'.",                                         \
+           globals_.name(argBx(instruction))->view());                         \
+    }                                                                          \
+    RA = value;                                                                \
+  } while (false)
+#define BODY_DEFINE_GLOBAL() (globals_[argBx(instruction)] = RA)
+#define BODY_SET_GLOBAL()                                                      \
+  do {                                                                         \
+    Value &global = globals_[argBx(instruction)];                              \
+    if (global.isUndefined()) { /* Assignment never declares */                \
+      FAIL("Undefined variable '{}'.",                                         \
+           globals_.name(argBx(instruction))->view());                         \
+    }                                                                          \
+    global = RA;                                                               \
+  } while (false)
+#define BODY_GET_UPVALUE()                                                     \
+  (RA = *frame->closure->upvalues[argB(instruction)]->location)
+#define BODY_SET_UPVALUE()                                                     \
+  do {                                                                         \
+    ObjUpvalue *upvalue = frame->closure->upvalues[argB(instruction)];         \
+    *upvalue->location = RA;                                                   \
+    heap_.writeBarrier(upvalue);                                               \
+  } while (false)
+#define BODY_GET_PROPERTY()                                                    \
+  do {                                                                         \
+    PropertyCache &cache = CACHE();                                            \
+    Value object = RB;                                                         \
+    if (!isObjType(object, ObjType::Instance)) {                               \
+      FAIL("Only instances have properties.");                                 \
+    }                                                                          \
+    ObjInstance *instance = asInstance(object);                                \
+    const PropertyCache::Entry *entry = cache.find(instance->shape);           \
+    if (entry == nullptr &&                                                    \
+        (entry = cacheProperty(cache, instance, asString(KC))) == nullptr) {   \
+      FAIL("Undefined property '{}'.", asString(KC)->view());                  \
+    }                                                                          \
+    if (entry->method == nullptr) {                                            \
+      RA = instance->fields[entry->slot];                                      \
+    } else {                                                                   \
+      RA = Value::object(heap_.newBoundMethod(object, entry->method));         \
+      SAFEPOINT();                                                             \
+    }                                                                          \
+  } while (false)
+#define BODY_SET_PROPERTY()                                                    \
+  do {                                                                         \
+    PropertyCache &cache = CACHE();                                            \
+    if (!isObjType(RA, ObjType::Instance)) {                                   \
+      FAIL("Only instances have fields.");                                     \
+    }                                                                          \
+    ObjInstance *instance = asInstance(RA);                                    \
+    const PropertyCache::Entry *entry = cache.find(instance->shape);           \
+    if (entry == nullptr) {                                                    \
+      entry = cacheFieldStore(cache, instance, asString(KB));                  \
+    }                                                                          \
+    if (entry->transition == nullptr) {                                        \
+      instance->fields[entry->slot] = RC;                                      \
+    } else {                                                                   \
+      instance->shape = entry->transition;                                     \
+      instance->fields.push_back(RC);                                          \
+    }                                                                          \
+    heap_.writeBarrier(instance);                                              \
+  } while (false)
+#define BODY_GET_SUPER()                                                       \
+  do {                                                                         \
+    ObjClass *superclass = asClass(slots[argA(instruction) + 1]);              \
+    SAVE_IP();                                                                 \
+    if (!bindMethod(superclass, asString(KB), RA, &RA)) {                      \
+      return false;                                                            \
+    }                                                                          \
+    SAFEPOINT();                                                               \
+  } while (false)
+#define BODY_EQUAL() (RA = Value::boolean(valuesEqual(RB, RC)))
+#define BODY_NOT_EQUAL() (RA = Value::boolean(!valuesEqual(RB, RC)))
+#define BODY_GREATER() NUMERIC_OP(Value::boolean, >, RC)
+#define BODY_GREATER_EQUAL() NUMERIC_OP(Value::boolean, >=, RC)
+#define BODY_LESS() NUMERIC_OP(Value::boolean, <, RC)
+#define BODY_LESS_EQUAL() NUMERIC_OP(Value::boolean, <=, RC)
+#define BODY_ADD() ADD_OP(RC)
+#define BODY_SUBTRACT() NUMERIC_OP(Value::number, -, RC)
+#define BODY_MULTIPLY() NUMERIC_OP(Value::number, *, RC)
+#define BODY_DIVIDE() NUMERIC_OP(Value::number, /, RC)
+#define BODY_EQUAL_K() (RA = Value::boolean(valuesEqual(RB, KC)))
+#define BODY_NOT_EQUAL_K() (RA = Value::boolean(!valuesEqual(RB, KC)))
+#define BODY_GREATER_K() NUMERIC_OP(Value::boolean, >, KC)
+#define BODY_GREATER_EQUAL_K() NUMERIC_OP(Value::boolean, >=, KC)
+#define BODY_LESS_K() NUMERIC_OP(Value::boolean, <, KC)
+#define BODY_LESS_EQUAL_K() NUMERIC_OP(Value::boolean, <=, KC)
+#define BODY_ADD_K() ADD_OP(KC)
+#define BODY_SUBTRACT_K() NUMERIC_OP(Value::number, -, KC)
+#define BODY_MULTIPLY_K() NUMERIC_OP(Value::number, *, KC)
+#define BODY_DIVIDE_K() NUMERIC_OP(Value::number, /, KC)
+#define BODY_NOT() (RA = Value::boolean(RB.isFalsey()))
+#define BODY_NEGATE()                                                          \
+  do {                                                                         \
+    if (!RB.isNumber()) {                                                      \
+      FAIL("Operand must be a number.");                                       \
+    }                                                                          \
+    RA = Value::number(-RB.asNumber());                                        \
+  } while (false)
+#define BODY_PRINT()                                                           \
+  do {                                                                         \
+    writeValue(RA, out_);                                                      \
+    out_ += '\n';                                                              \
+    if (out_.size() >= kOutputFlushSize) {                                     \
+      flushOutput();                                                           \
+    }                                                                          \
+  } while (false)
+#define BODY_CLOSURE()                                                         \
+  do {                                                                         \
+    ObjFunction *function = asFunction(KBX);                                   \
+    ObjClosure *closure = heap_.newClosure(function);                          \
+    RA = Value::object(closure);                                               \
+    for (size_t i = 0; i < function->captures.size(); ++i) {                   \
+      UpvalueCapture capture = function->captures[i];                          \
+      closure->upvalues[i] = capture.is_local                                  \
+                                 ? captureUpvalue(slots + capture.index)       \
+                                 : frame->closure->upvalues[capture.index];    \
+    }                                                                          \
+    SAFEPOINT();                                                               \
+  } while (false)
+#define BODY_CLOSE_UPVALUES() closeUpvalues(&RA)
+#define BODY_CLASS()                                                           \
+  do {                                                                         \
+    RA = Value::object(heap_.newClass(asString(KBX)));                         \
+    SAFEPOINT();                                                               \
+  } while (false)
+  // Copy-down inheritance: methods are copied into the subclass before its
+  // own are added, so lookups never walk the superclass chain.
+#define BODY_INHERIT()                                                         \
+  do {                                                                         \
+    if (!isObjType(RB, ObjType::Class)) {                                      \
+      FAIL("Superclass must be a class.");                                     \
+    }                                                                          \
+    asClass(RA)->methods.addAll(asClass(RB)->methods);                         \
+    heap_.writeBarrier(asClass(RA));                                           \
+  } while (false)
+#define BODY_METHOD()                                                          \
+  do {                                                                         \
+    asClass(RA)->methods.set(asString(KB), RC);                                \
+    heap_.writeBarrier(asClass(RA));                                           \
+  } while (false)
+// Those whose handler is generated from their body; the opcodes that quicken
+// have their own below.
+#define LOX_STRAIGHT_LINE_OPCODES(X)                                           \
+  X(MOVE)                                                                      \
+  X(LOADK)                                                                     \
+  X(LOADNIL)                                                                   \
+  X(LOADTRUE)                                                                  \
+  X(LOADFALSE)                                                                 \
+  X(GET_GLOBAL)                                                                \
+  X(DEFINE_GLOBAL)                                                             \
+  X(SET_GLOBAL)                                                                \
+  X(GET_UPVALUE)                                                               \
+  X(SET_UPVALUE)                                                               \
+  X(GET_PROPERTY)                                                              \
+  X(SET_PROPERTY)                                                              \
+  X(GET_SUPER)                                                                 \
+  X(GREATER)                                                                   \
+  X(GREATER_EQUAL)                                                             \
+  X(LESS)                                                                      \
+  X(LESS_EQUAL)                                                                \
+  X(SUBTRACT)                                                                  \
+  X(MULTIPLY)                                                                  \
+  X(DIVIDE)                                                                    \
+  X(GREATER_K)                                                                 \
+  X(GREATER_EQUAL_K)                                                           \
+  X(LESS_K)                                                                    \
+  X(LESS_EQUAL_K)                                                              \
+  X(SUBTRACT_K)                                                                \
+  X(MULTIPLY_K)                                                                \
+  X(DIVIDE_K)                                                                  \
+  X(NOT)                                                                       \
+  X(NEGATE)                                                                    \
+  X(PRINT)                                                                     \
+  X(CLOSURE)                                                                   \
+  X(CLOSE_UPVALUES)                                                            \
+  X(CLASS)                                                                     \
+  X(INHERIT)                                                                   \
+  X(METHOD)
+
+#ifdef LOX_COMPUTED_GOTO
+  static void *const kDispatchTable[] = {
+#define LOX_OPCODE_LABEL(name) &&op_##name,
+#define LOX_QUICKENED_OPCODE_LABEL(name, generic) &&op_##name,
+#define LOX_FUSED_OPCODE_LABEL(first, second) &&op_##first##_THEN_##second,
+      LOX_OPCODES(LOX_OPCODE_LABEL)
+      LOX_QUICKENED_OPCODES(LOX_QUICKENED_OPCODE_LABEL)
+      LOX_SUPERINSTRUCTIONS(LOX_FUSED_OPCODE_LABEL)
+#undef LOX_OPCODE_LABEL
+#undef LOX_QUICKENED_OPCODE_LABEL
+#undef LOX_FUSED_OPCODE_LABEL
+  };
+  static_assert(std::size(kDispatchTable) == kOpCodeCount);
+#define CASE(name) op_##name
+#define DISPATCH()                                                             \
+  do {                                                                         \
+    instruction = *ip++;                                                       \
+    COUNT_DISPATCH();                                                          \
+    goto *kDispatchTable[instruction & 0xff];                                  \
+  } while (false)
+// The second half of a superinstruction: a direct jump to its handler, which
+// the branch predictor never has to guess, unless the instruction may have
+// been quickened since.
+#define THEN(name)                                                             \
+  do {                                                                         \
+    instruction = *ip++;                                                       \
+    if constexpr (quickens(OpCode::name)) {                                    \
+      goto *kDispatchTable[instruction & 0xff];                                \
+    } else {                                                                   \
+      goto op_##name;                                                          \
+    }                                                                          \
+  } while (false)
+  LOAD_FRAME();
+  DISPATCH();
+#else
+#define CASE(name) case OpCode::name
+#define DISPATCH() continue
+// The switch has no labels to jump to, so the second half is dispatched on
+// its own.
+#define THEN(name) DISPATCH()
+  LOAD_FRAME();
+  for (;;) {
+    instruction = *ip++;
+    COUNT_DISPATCH();
+    switch (opOf(instruction)) {
+#endif
+
+#define LOX_STRAIGHT_LINE_HANDLER(name)                                        \
+  CASE(name) : {                                                               \
+    BODY_##name();                                                             \
+    DISPATCH();                                                                \
+  }
+  LOX_STRAIGHT_LINE_OPCODES(LOX_STRAIGHT_LINE_HANDLER)
+#undef LOX_STRAIGHT_LINE_HANDLER
+
+#define LOX_FUSED_HANDLER(first, second)                                       \
+  CASE(first##_THEN_##second) : {                                              \
+    BODY_##first();                                                            \
+    THEN(second);                                                              \
+  }
+  LOX_SUPERINSTRUCTIONS(LOX_FUSED_HANDLER)
+#undef LOX_FUSED_HANDLER
+
+  // Quickening: a generic instruction rewrites itself to the specialization
+  // for the operand types it sees first, then does the generic work this
+  // once. A specialization whose guard fails rewrites it to the generic _ANY
+  // form for good, so a polymorphic site settles instead of flip-flopping.
+#define QUICKEN(op) (ip[-1] = withOp(instruction, OpCode::op))
+#define GUARD(condition, generic)                                              \
+  if (!(condition)) {                                                          \
+    QUICKEN(generic##_ANY);                                                    \
+    BODY_##generic();                                                          \
+    DISPATCH();                                                                \
+  }
+  CASE(ADD) : {
+    if (RB.isNumber() && RC.isNumber()) {
+      QUICKEN(ADD_NUM_NUM);
+    } else if (isString(RB) && isString(RC)) {
+      QUICKEN(ADD_STR_STR);
+    }
+    BODY_ADD();
+    DISPATCH();
+  }
+  CASE(ADD_NUM_NUM) : {
+    GUARD(RB.isNumber() && RC.isNumber(), ADD);
+    RA = Value::number(RB.asNumber() + RC.asNumber());
+    DISPATCH();
+  }
+  CASE(ADD_STR_STR) : {
+    GUARD(isString(RB) && isString(RC), ADD);
+    RA = Value::object(heap_.concatenate(asString(RB), asString(RC)));
+    SAFEPOINT();
+    DISPATCH();
+  }
+  // Constants never change, so the _K specializations only guard R[B].
+  CASE(ADD_K) : {
+    if (RB.isNumber() && KC.isNumber()) {
+      QUICKEN(ADD_K_NUM_NUM);
+    } else if (isString(RB) && isString(KC)) {
+      QUICKEN(ADD_K_STR_STR);
+    }
+    BODY_ADD_K();
+    DISPATCH();
+  }
+  CASE(ADD_K_NUM_NUM) : {
+    GUARD(RB.isNumber(), ADD_K);
+    RA = Value::number(RB.asNumber() + KC.asNumber());
+    DISPATCH();
+  }
+  CASE(ADD_K_STR_STR) : {
+    GUARD(isString(RB), ADD_K);
+    RA = Value::object(heap_.concatenate(asString(RB), asString(KC)));
+    SAFEPOINT();
+    DISPATCH();
+  }
+  // Equality between anything other than two numbers is a bit comparison
+  // already, so only numbers get a specialization.
+#define LOX_EQUALITY_HANDLERS(generic, rhs, guard, op)                         \
+  CASE(generic) : {                                                            \
+    if (guard) {                                                               \
+      QUICKEN(generic##_NUM_NUM);                                              \
+    } else {                                                                   \
+      QUICKEN(generic##_ANY);                                                  \
+    }                                                                          \
+    BODY_##generic();                                                          \
+    DISPATCH();                                                                \
+  }                                                                            \
+  CASE(generic##_NUM_NUM) : {                                                  \
+    GUARD(guard, generic);                                                     \
+    RA = Value::boolean(RB.asNumber() op rhs.asNumber());                      \
+    DISPATCH();                                                                \
+  }
+  LOX_EQUALITY_HANDLERS(EQUAL, RC, RB.isNumber() && RC.isNumber(), ==)
+  LOX_EQUALITY_HANDLERS(NOT_EQUAL, RC, RB.isNumber() && RC.isNumber(), !=)
+  LOX_EQUALITY_HANDLERS(EQUAL_K, KC, RB.isNumber() && KC.isNumber(), ==)
+  LOX_EQUALITY_HANDLERS(NOT_EQUAL_K, KC, RB.isNumber() && KC.isNumber(), !=)
+#undef LOX_EQUALITY_HANDLERS
+#define LOX_GENERIC_HANDLER(generic)                                           \
+  CASE(generic##_ANY) : {                                                      \
+    BODY_##generic();                                                          \
+    DISPATCH();                                                                \
+  }
+  LOX_GENERIC_HANDLER(ADD)
+  LOX_GENERIC_HANDLER(ADD_K)
+  LOX_GENERIC_HANDLER(EQUAL)
+  LOX_GENERIC_HANDLER(NOT_EQUAL)
+  LOX_GENERIC_HANDLER(EQUAL_K)
+  LOX_GENERIC_HANDLER(NOT_EQUAL_K)
+#undef LOX_GENERIC_HANDLER
+
+  CASE(JUMP) : {
+    ip += argSBx(instruction);
+    DISPATCH();
+  }
+  CASE(JUMP_IF_FALSE) : {
+    if (RA.isFalsey()) {
+      ip += argSBx(instruction);
+    }
+    DISPATCH();
+  }
+  CASE(JUMP_IF_TRUE) : {
+    if (!RA.isFalsey()) {
+      ip += argSBx(instruction);
+    }
+    DISPATCH();
+  }
+  // Guards a call the compiler inlined: the copy of the body runs only while
+  // the global still holds the function it was copied from.
+  CASE(JUMP_IF_FUNCTION) : {
+    if (isObjType(RA, ObjType::Closure) &&
+        asClosure(RA)->function == asFunction(KB)) {
+      ip += argC(instruction);
+    }
+    DISPATCH();
+  }
+  CASE(CALL) : {
+    SAVE_IP();
+    if (!callValue(&RA, argB(instruction))) {
+      return false;
+    }
+    LOAD_FRAME();
+    SAFEPOINT();
+    DISPATCH();
+  }
+  CASE(INVOKE) : {
+    PropertyCache &cache = CACHE();
+    SAVE_IP();
+    if (!invoke(&RA, asString(KB), argC(instruction), cache)) {
+      return false;
+    }
+    LOAD_FRAME();
+    SAFEPOINT();
+    DISPATCH();
+  }
+  CASE(SUPER_INVOKE) : {
+    int arg_count = argC(instruction);
+    ObjClass *superclass = asClass(slots[argA(instruction) + arg_count + 1]);
+    SAVE_IP();
+    if (!invokeFromClass(superclass, asString(KB), &RA, arg_count)) {
+      return false;
+    }
+    LOAD_FRAME();
+    DISPATCH();
+  }
+  CASE(RETURN) : {
+    Value result = RA;
+    closeUpvalues(slots);
+    if (--frame_count_ == 0) {
+      return true;
+    }
+    slots[0] = result; // The caller's R[A] of the CALL
+    stack_top_ = frames_[frame_count_ - 1].top;
+    LOAD_FRAME();
+    DISPATCH();
+  }
+  CASE(RETURN_NIL) : {
+    closeUpvalues(slots);
+    if (--frame_count_ == 0) {
+      return true;
+    }
+    slots[0] = Value();
+    stack_top_ = frames_[frame_count_ - 1].top;
+    LOAD_FRAME();
+    DISPATCH();
+  }
+
+#ifndef LOX_COMPUTED_GOTO
+    case OpCode::COUNT:
+      break;
+    }
+    FAIL("Unknown opcode.");
+  }
+#endif
+#undef LOAD_FRAME
+#undef SAVE_IP
+#undef RA
+#undef RB
+#undef RC
+#undef KB
+#undef KC
+#undef KBX
+#undef CACHE
+#undef FAIL
+#undef SAFEPOINT
+#undef NUMERIC_OP
+#undef ADD_OP
+#undef COUNT_DISPATCH
+#undef CASE
+#undef DISPATCH
+#undef THEN
+#undef QUICKEN
+#undef GUARD
+#undef LOX_STRAIGHT_LINE_OPCODES
+#undef BODY_MOVE
+#undef BODY_LOADK
+#undef BODY_LOADNIL
+#undef BODY_LOADTRUE
+#undef BODY_LOADFALSE
+#undef BODY_GET_GLOBAL
+#undef BODY_DEFINE_GLOBAL
+#undef BODY_SET_GLOBAL
+#undef BODY_GET_UPVALUE
+#undef BODY_SET_UPVALUE
+#undef BODY_GET_PROPERTY
+#undef BODY_SET_PROPERTY
+#undef BODY_GET_SUPER
+#undef BODY_EQUAL
+#undef BODY_NOT_EQUAL
+#undef BODY_GREATER
+#undef BODY_GREATER_EQUAL
+#undef BODY_LESS
+#undef BODY_LESS_EQUAL
+#undef BODY_ADD
+#undef BODY_SUBTRACT
+#undef BODY_MULTIPLY
+#undef BODY_DIVIDE
+#undef BODY_EQUAL_K
+#undef BODY_NOT_EQUAL_K
+#undef BODY_GREATER_K
+#undef BODY_GREATER_EQUAL_K
+#undef BODY_LESS_K
+#undef BODY_LESS_EQUAL_K
+#undef BODY_ADD_K
+#undef BODY_SUBTRACT_K
+#undef BODY_MULTIPLY_K
+#undef BODY_DIVIDE_K
+#undef BODY_NOT
+#undef BODY_NEGATE
+#undef BODY_PRINT
+#undef BODY_CLOSURE
+#undef BODY_CLOSE_UPVALUES
+#undef BODY_CLASS
+#undef BODY_INHERIT
+#undef BODY_METHOD
+}
+
+bool VM::callValue(Value *base, int arg_count) {
+  Value callee = *base;
+  if (callee.isObject()) {
+    switch (callee.asObject()->type) {
+    case ObjType::BoundMethod: {
+      auto *bound = static_cast<ObjBoundMethod *>(callee.asObject());
+      *base = bound->receiver;
+      return call(bound->method, base, arg_count);
+    }
+    case ObjType::Class: {
+      ObjClass *klass = asClass(callee);
+      *base = Value::object(heap_.newInstance(klass));
+      Value initializer;
+      if (klass->methods.get(init_string_, initializer)) {
+        return call(asClosure(initializer), base, arg_count);
+      }
+      if (arg_count != 0) {
+        runtimeError(
+            std::format("Expected 0 arguments but got {}.", arg_count));
+        return false;
+      }
+      return true;
+    }
+    case ObjType::Closure:
+      return call(asClosure(callee), base, arg_count);
+    case ObjType::Native: {
+      NativeFn native = static_cast<ObjNative *>(callee.asObject())->function;
+      *base = native(arg_count, base + 1);
+      return true;
+    }
+    default:
+      break;
+    }
+  }
+  runtimeError("Can only call functions and classes.");
+  return false;
+}
+
+bool VM::call(ObjClosure *closure, Value *base, int arg_count) {
+  ObjFunction *function = closure->function;
+  if (arg_count != function->arity) {
+    runtimeError(std::format("Expected {} arguments but got {}.",
+                             function->arity, arg_count));
+    return false;
+  }
+  Value *frame_end = base + function->max_registers;
+  if (frame_count_ == kFramesMax || frame_end > stack_.get() + kStackMax) {
+    runtimeError("Stack overflow.");
+    return false;
+  }
+  // Registers past the arguments may hold stale values from finished
+  // frames, whose objects may since have been freed; the collector must not
+  // see those.
+  std::fill(base + arg_count + 1, frame_end, Value());
+  stack_top_ = std::max(stack_top_, frame_end);
+  frames_[frame_count_++] =
+      CallFrame{closure, function->chunk.code.data(), base, stack_top_};
+  return true;
+}
+
+bool VM::invoke(Value *base, ObjString *name, int arg_count,
+                PropertyCache &cache) {
+  Value receiver = *base;
+  if (!isObjType(receiver, ObjType::Instance)) {
+    runtimeError("Only instances have methods.");
+    return false;
+  }
+  ObjInstance *instance = asInstance(receiver);
+  const PropertyCache::Entry *entry = cache.find(instance->shape);
+  if (entry == nullptr &&
+      (entry = cacheProperty(cache, instance, name)) == nullptr) {
+    runtimeError(std::format("Undefined property '{}'.", name->view()));
+    return false;
+  }
+  if (entry->method != nullptr) {
+    return call(entry->method, base, arg_count);
+  }
+  *base = instance->fields[entry->slot];
+  return callValue(base, arg_count);
+}
+
+// Resolves name on the instance and adds what it found to cache: the field,
+// which shadows a method of the same name, or else the class's method. Methods
+// can be cached by shape because each class has its own shapes and its
+// methods are all added before it can have instances. Returns nullptr if
+// there is neither.
+const PropertyCache::Entry *VM::cacheProperty(PropertyCache &cache,
+                                              ObjInstance *instance,
+                                              ObjString *name) {
+  PropertyCache::Entry entry{.shape = instance->shape};
+  if (int slot = instance->shape->slotOf(name); slot >= 0) {
+    entry.slot = static_cast<uint32_t>(slot);
+  } else {
+    Value method;
+    if (!instance->klass->methods.get(name, method)) {
+      return nullptr;
+    }
+    entry.method = asClosure(method);
+  }
+  heap_.writeBarrier(frames_[frame_count_ - 1].closure->function);
+  return &cache.add(entry);
+}
+
+// Adds to cache how a store to name changes an instance of the instance's
+// shape: it overwrites the field's slot, or adds the field and moves to the
+// next shape.
+const PropertyCache::Entry *VM::cacheFieldStore(PropertyCache &cache,
+                                                ObjInstance *instance,
+                                                ObjString *name) {
+  PropertyCache::Entry entry{.shape = instance->shape};
+  if (int slot = instance->shape->slotOf(name); slot >= 0) {
+    entry.slot = static_cast<uint32_t>(slot);
+  } else {
+    entry.slot = instance->shape->slotCount();
+    entry.transition = instance->shape->addField(name);
+    heap_.writeBarrier(instance->klass); // Its shape tree holds name now
+  }
+  heap_.writeBarrier(frames_[frame_count_ - 1].closure->function);
+  return &cache.add(entry);
+}
+
+bool VM::invokeFromClass(ObjClass *klass, ObjString *name, Value *base,
+                         int arg_count) {
+  Value method;
+  if (!klass->methods.get(name, method)) {
+    runtimeError(std::format("Undefined property '{}'.", name->view()));
+    return false;
+  }
+  return call(asClosure(method), base, arg_count);
+}
+
+bool VM::bindMethod(ObjClass *klass, ObjString *name, Value receiver,
+                    Value *result) {
+  Value method;
+  if (!klass->methods.get(name, method)) {
+    runtimeError(std::format("Undefined property '{}'.", name->view()));
+    return false;
+  }
+  *result = Value::object(heap_.newBoundMethod(receiver, asClosure(method)));
+  return true;
+}
+
+// Closures that capture the same variable share one upvalue, so the list is
+// searched before a new one is made.
+ObjUpvalue *VM::captureUpvalue(Value *local) {
+  ObjUpvalue *previous = nullptr;
+  ObjUpvalue *upvalue = open_upvalues_;
+  while (upvalue != nullptr && upvalue->location > local) {
+    previous = upvalue;
+    upvalue = upvalue->next_open;
+  }
+  if (upvalue != nullptr && upvalue->location == local) {
+    return upvalue;
+  }
+
+  ObjUpvalue *created = heap_.newUpvalue(local);
+  created->next_open = upvalue;
+  if (previous == nullptr) {
+    open_upvalues_ = created;
+  } else {
+    previous->next_open = created;
+  }
+  return created;
+}
+
+// Moves every variable at or above `last` out of the registers into its
+// upvalue.
+void VM::closeUpvalues(const Value *last) {
+  while (open_upvalues_ != nullptr && open_upvalues_->location >= last) {
+    ObjUpvalue *upvalue = open_upvalues_;
+    upvalue->closed = *upvalue->location;
+    upvalue->location = &upvalue->closed;
+    heap_.writeBarrier(upvalue);
+    open_upvalues_ = upvalue->next_open;
+  }
+}
+
+void VM::defineNative(std::string_view name, NativeFn function) {
+  ObjString *string = heap_.makeString(name);
+  globals_[globals_.slotOf(string)] = Value::object(heap_.newNative(function));
+}
+
+void VM::runtimeError(std::string message) {
+  const CallFrame &frame = frames_[frame_count_ - 1];
+  const Chunk &chunk = frame.closure->function->chunk;
+  size_t instruction = frame.ip - chunk.code.data() - 1;
+  error_ = RuntimeError{chunk.lines[instruction], std::move(message)};
+}
+
+void VM::collectGarbage() {
+  heap_.collect([this](Heap &heap) {
+    for (Value *slot = stack_.get(); slot < stack_top_; ++slot) {
+      heap.markValue(*slot);
+    }
+    for (int i = 0; i < frame_count_; ++i) {
+      heap.markObject(frames_[i].closure);
+    }
+    // Updating each link as it goes, since the upvalues may move.
+    for (ObjUpvalue **link = &open_upvalues_; *link != nullptr;
+         link = &(*link)->next_open) {
+      heap.markObject(*link);
+    }
+    globals_.mark(heap);
+    heap.markObject(init_string_);
+  });
+}
+
+void VM::flushOutput() {
+  std::print("{}", out_);
+  out_.clear();
+}
@@ -0,0 +1,115 @@
+#ifndef VM_H
+#define VM_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "runtime/Heap.h"
+#include "runtime/RuntimeError.h"
+#include "runtime/Value.h"
+#include "vm/Chunk.h"
+#include "vm/Globals.h"
+
+// Register-based bytecode interpreter for the `run` command, in the style of
+// Lua 5: each instruction names its source and destination registers in the
+// frame (see Chunk.h), so `sum = sum + i` is a single ADD instead of the four
+// pushes and pops a stack machine needs. Each opcode's handler jumps straight
+// to the next one's through a table of label addresses (GCC/Clang computed
+// goto), so every handler ends in its own indirect branch and the predictor
+// learns per-opcode successors. Configuring with -DLOX_SWITCH_DISPATCH=ON
+// builds the portable switch loop instead. Superinstructions (see Chunk.h)
+// run their second half through a direct jump to its handler.
+//
+// The garbage collector only runs at safepoints: right after an instruction
+// that allocated, once its result is in a register, so every live value is
+// reachable from the registers, the call frames, open upvalues or globals.
+// Collection moves young objects, so nothing but those roots may hold an
+// object across a safepoint, and every store into an object's fields is
+// followed by Heap::writeBarrier.
+class VM {
+public:
+  VM();
+
+  VM(const VM &) = delete;
+  VM &operator=(const VM &) = delete;
+
+  // Functions and constants are compiled into this VM's heap, and global
+  // variables are given their slots in its globals.
+  Heap &heap() { return heap_; }
+  Globals &globals() { return globals_; }
+
+  // Runs a compiled script, printing the output of `print` statements to
+  // stdout. Returns the error that stopped it, if any.
+  std::optional<RuntimeError> run(ObjFunction *script);
+
+  // Instructions dispatched so far; only counted in builds configured with
+  // -DLOX_VM_STATS=ON, since the count costs an add per instruction.
+  uint64_t dispatchCount() const { return dispatch_count_; }
+
+  // How often each opcode was dispatched right after another, indexed
+  // [previous][next]: the profile superinstructions are chosen from (see
+  // bench/superinstructions.sh). Counted along with dispatchCount().
+  using PairCounts =
+      std::array<std::array<uint64_t, kOpCodeCount>, kOpCodeCount>;
+  const PairCounts &pairCounts() const { return *pair_counts_; }
+
+private:
+  static constexpr int kFramesMax = 1024;
+  static constexpr size_t kStackMax = kFramesMax * 256;
+
+  struct CallFrame {
+    ObjClosure *closure;
+    Instruction *ip; // Written through by quickening
+    Value *slots; // R[0]; the callee, then the arguments
+    // End of the registers in use by this frame and every frame below it,
+    // which bounds what the collector scans.
+    Value *top;
+  };
+
+  // Interpreter loop; returns false on a runtime error (left in error_).
+  bool execute();
+
+  // Calls *base with the arg_count values after it as arguments. The result
+  // replaces *base when the call returns.
+  bool callValue(Value *base, int arg_count);
+  bool call(ObjClosure *closure, Value *base, int arg_count);
+  bool invoke(Value *base, ObjString *name, int arg_count,
+              PropertyCache &cache);
+  bool invokeFromClass(ObjClass *klass, ObjString *name, Value *base,
+                       int arg_count);
+  const PropertyCache::Entry *cacheProperty(PropertyCache &cache,
+                                            ObjInstance *instance,
+                                            ObjString *name);
+  const PropertyCache::Entry *cacheFieldStore(PropertyCache &cache,
+                                              ObjInstance *instance,
+                                              ObjString *name);
+  bool bindMethod(ObjClass *klass, ObjString *name, Value receiver,
+                  Value *result);
+  ObjUpvalue *captureUpvalue(Value *local);
+  void closeUpvalues(const Value *last);
+  void defineNative(std::string_view name, NativeFn function);
+
+  // Records the error at the current instruction of the innermost frame.
+  void runtimeError(std::string message);
+  void collectGarbage();
+  void flushOutput();
+
+  Heap heap_;
+  std::array<CallFrame, kFramesMax> frames_;
+  int frame_count_ = 0;
+  std::unique_ptr<Value[]> stack_; // Every frame's registers
+  Value *stack_top_;               // The innermost frame's top
+  Globals globals_;
+  ObjString *init_string_;
+  ObjUpvalue *open_upvalues_ = nullptr; // Sorted by slot, highest first
+  std::optional<RuntimeError> error_;
+  std::string out_;
+  uint64_t dispatch_count_ = 0;
+  std::unique_ptr<PairCounts> pair_counts_ = std::make_unique<PairCounts>();
+};
+
+#endif // VM_H